@@ -4,17 +4,45 @@
 #include "EntityManager.h"
 #include "MeshManager.h"
 #include "MaterialManager.h"
+#include "TextureManager.h"
+#include "TextureCache.h"
+#include "TextureBaker.h"
 #include "Window.h"
 #include "InputManager.h"
 #include "UI.h"
 #include "Config.h"
+#include "ConvergenceBenchmark.h"
+#include "RenderWorker.h"
+#include "Checkpoint.h"
+#include "AsyncImageWriter.h"
+#include "ImageWriter.h"
+#include "SharedFrameRing.h"
+#include "PreviewServer.h"
+
+#include <limits>
+#include <algorithm>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <iomanip>
 
 void AetherTracer::run() {
 
+	if (!config.workerAddress.empty()) {
+		runWorker();
+		return;
+	}
+
 	init();
 
+	if (config.resume && !resume()) return;
+
 	auto frameStartTime = std::chrono::high_resolution_clock::now();
 	auto physicsTime = std::chrono::high_resolution_clock::now();
+	auto accumulationStartTime = std::chrono::high_resolution_clock::now();
+	auto checkpointTime = std::chrono::high_resolution_clock::now();
+	auto sharedFrameTime = std::chrono::high_resolution_clock::now();
+	auto streamTime = std::chrono::high_resolution_clock::now();
 	std::chrono::microseconds frameEndTime;
 
 	SDL_Event event;
@@ -30,6 +58,7 @@ void AetherTracer::run() {
 			inputManager->processInput(event);
 		}
 		inputManager->processInputContinuous(event, std::chrono::duration<double>(deltaTime).count());
+		if (previewServer) applyRemoteInput();
 
 		// physics
 		// rebuild bvh
@@ -44,18 +73,366 @@ void AetherTracer::run() {
 			window->acknowledgeResize();
 		}
 
+		if (UI::runBenchmark) {
+			benchmark->start();
+			UI::runBenchmark = false;
+		}
+		if (UI::runLightSamplingComparison) {
+			benchmark->startLightSampling();
+			UI::runLightSamplingComparison = false;
+		}
+		benchmark->update();
+
+		// the frame after the target was reached adds no samples, copy its accumulation out
+		finishing = !finished && config.sampleTarget > 0 && dx12Renderer->rm->iterations >= static_cast<UINT>(config.sampleTarget);
+		if (finishing) dx12Renderer->rm->accumulationReadbackRequested = true;
+
+		// the copy is queued with this frame, the file is written on the checkpoint's own thread
+		bool checkpointing = config.checkpointInterval > 0.0f && !checkpoint->busy() && !entityManager->camera->camMoved
+			&& std::chrono::duration<float>(frameStartTime - checkpointTime).count() >= config.checkpointInterval;
+		if (checkpointing) {
+			dx12Renderer->rm->accumulationReadbackRequested = true;
+			dx12Renderer->rm->varianceReadbackRequested = true;
+			checkpointTime = frameStartTime;
+		}
+
+		if (UI::saveSnapshot) {
+			std::filesystem::path path = config.snapshotPath;
+			path.replace_filename(path.stem().string() + "_" + std::to_string(dx12Renderer->rm->iterations) + "spp" + path.extension().string());
+			snapshotPath = path.string();
+			UI::saveSnapshot = false;
+		}
+
+		// same for snapshots, encoding happens on the image writer's thread while the next frames render
+		bool snapshotting = !snapshotPath.empty();
+		if (snapshotting) dx12Renderer->rm->accumulationReadbackRequested = true;
+
+		bool sharingFrame = sharedFrames && std::chrono::duration<float>(frameStartTime - sharedFrameTime).count() >= config.sharedFrameInterval;
+		if (sharingFrame) {
+			dx12Renderer->rm->accumulationReadbackRequested = true;
+			sharedFrameTime = frameStartTime;
+		}
+
+		bool streaming = previewServer && previewServer->connected() && std::chrono::duration<float>(frameStartTime - streamTime).count() >= config.streamInterval;
+		if (streaming) {
+			dx12Renderer->rm->accumulationReadbackRequested = true;
+			streamTime = frameStartTime;
+		}
+
 		dx12Renderer->render();
 		dx12Renderer->present();
 
+		if (checkpointing) {
+			writeCheckpoint();
+		}
+
+		if (snapshotting) {
+			if (!writeSnapshot(snapshotPath) && outputSnapshot) saveRenderFallback(snapshotPath);
+			snapshotPath.clear();
+			outputSnapshot = false;
+			if (quitAfterSnapshot) running = false;
+		}
+
+		if (sharingFrame) {
+			publishSharedFrame();
+		}
+
+		if (streaming) {
+			streamFrame();
+		}
+
+		benchmark->collect();
 
 		frameEndTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - frameStartTime);
 		UI::frameTime = std::chrono::duration<float>(frameEndTime).count();
-		UI::numRays = config.accumulate && !entityManager->camera->camMoved ? UI::numRays + config.raysPerPixel : config.raysPerPixel;
+
+		// deadline counts from the start of the current accumulation
+		if (dx12Renderer->rm->accumulationRestarted) {
+			accumulationStartTime = frameStartTime;
+			finished = false;
+		}
+
+		if (finishing) {
+			finishRender();
+		}
+
+		float remainingMs = std::numeric_limits<float>::max();
+		if (config.renderDeadline > 0.0f) {
+			float elapsed = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - accumulationStartTime).count();
+			remainingMs = (config.renderDeadline - elapsed) * 1000.0f;
+
+			if (remainingMs <= 0.0f) {
+				// HDR output needs the accumulation itself, it's read back with the next frame
+				bool hdr = ImageWriter::isHDR(config.outputPath);
+				if (hdr) {
+					snapshotPath = config.outputPath;
+					outputSnapshot = true;
+				}
+				else dx12Renderer->saveRender(config.outputPath);
+				config.renderDeadline = 0.0f;
+				if (config.quitWhenFinished) {
+					if (hdr) quitAfterSnapshot = true;
+					else running = false;
+				}
+			}
+		}
+
+		dx12Renderer->updateFrameBudget(UI::frameTime * 1000.0f, remainingMs);
+		UI::passCost = dx12Renderer->rm->passCostMs;
+		dx12Renderer->updateResolution(UI::frameTime * 1000.0f, entityManager->camera->camMoved);
+		UI::internalWidth = dx12Renderer->rm->internalWidth;
+		UI::internalHeight = dx12Renderer->rm->internalHeight;
+		UI::numRays = config.accumulate && !entityManager->camera->camMoved ? UI::numRays + dx12Renderer->rm->samplePasses : dx12Renderer->rm->samplePasses;
+		UI::activeTiles = dx12Renderer->rm->activeTiles;
+		UI::numTiles = dx12Renderer->rm->numTiles;
+		if (textureCache) {
+			TextureCache::Stats stats = textureCache->stats();
+			UI::textureCacheHits = stats.hits;
+			UI::textureCacheMisses = stats.misses;
+			UI::textureCacheEvictions = stats.evictions;
+			UI::textureCachePages = stats.residentPages;
+		}
 		entityManager->camera->camMoved = false;
 		UI::accelUpdate = false;
 		UI::accumulationUpdate = false;
 	}
 
+	// don't cut off a checkpoint halfway through the rename
+	checkpoint->wait();
+	imageWriter->wait();
+}
+
+void AetherTracer::runWorker() {
+
+	RenderWorker worker;
+	RenderProtocol::SceneMessage scene;
+	if (!worker.connect(config.workerAddress) || !worker.receiveScene(scene)) return;
+
+	// every worker has to produce the same sample for the same index, anything view or time dependent is off
+	config.resX = scene.width;
+	config.resY = scene.height;
+	config.sampler = scene.sampler;
+	config.minBounces = scene.minBounces;
+	config.maxBounces = scene.maxBounces;
+	config.sky = scene.sky != 0;
+	config.skyBrightness = scene.skyBrightness;
+	config.lightSampling = scene.lightSampling != 0;
+	config.deterministic = true;
+	config.accumulate = true;
+	config.denoise = false;
+	config.dynamicResolution = false;
+	config.temporalReprojection = false;
+
+	init();
+
+	ResourceManager* rm = dx12Renderer->rm;
+
+	if (entityManager->sceneHash() != scene.sceneHash) {
+		worker.sendError("scene does not match the coordinator's");
+		return;
+	}
+	if (rm->width != scene.width || rm->height != scene.height) {
+		worker.sendError("window is " + std::to_string(rm->width) + "x" + std::to_string(rm->height));
+		return;
+	}
+
+	entityManager->camera->position = { scene.position[0], scene.position[1], scene.position[2] };
+	entityManager->camera->rotation = { scene.rotation[0], scene.rotation[1] };
+
+	SDL_Event event;
+	auto frame = [&]() {
+		while (SDL_PollEvent(&event)) {
+			ImGui_ImplSDL3_ProcessEvent(&event);
+			window->pollEvents(event);
+		}
+		renderImgui();
+		dx12Renderer->render();
+		dx12Renderer->present();
+	};
+
+	std::vector<float> pixels;
+	RenderProtocol::JobMessage job;
+
+	while (running && !window->shouldClose() && worker.nextJob(job)) {
+
+		rm->sampleOffset = job.sampleStart;
+		config.sampleTarget = static_cast<int>(job.sampleCount);
+		UI::accumulationUpdate = true;
+
+		while (true) {
+			// the frame after the target was reached adds no samples, copy its accumulation out
+			bool done = !UI::accumulationUpdate && rm->iterations >= job.sampleCount;
+			if (done) rm->accumulationReadbackRequested = true;
+			frame();
+			if (done) break;
+		}
+
+		dx12Renderer->computeStage->readAccumulation(pixels);
+		if (!worker.sendResult(job, rm->width, rm->height, pixels)) break;
+	}
+
+	std::cout << "Worker: finished" << std::endl;
+}
+
+bool AetherTracer::resume() {
+
+	std::string path = config.resumePath.empty() ? config.checkpointPath : config.resumePath;
+
+	Checkpoint::Header header;
+	std::vector<float> accumulation;
+	std::vector<float> variance;
+	if (!Checkpoint::read(path, header, accumulation, variance)) return false;
+
+	ResourceManager* rm = dx12Renderer->rm;
+
+	if (header.sceneHash != entityManager->sceneHash()) {
+		std::cerr << "Resume: " << path << " was rendered from a different scene" << std::endl;
+		return false;
+	}
+	if (header.width != rm->width || header.height != rm->height) {
+		std::cerr << "Resume: " << path << " is " << header.width << "x" << header.height << ", window is " << rm->width << "x" << rm->height << std::endl;
+		return false;
+	}
+
+	// same view and sample sequence, the samples that follow continue the ones in the file
+	entityManager->camera->position = { header.position[0], header.position[1], header.position[2] };
+	entityManager->camera->rotation = { header.rotation[0], header.rotation[1] };
+	config.sampler = header.sampler;
+	config.deterministic = header.deterministic != 0;
+
+	dx12Renderer->restoreAccumulation(accumulation, variance);
+	rm->iterations = header.iterations;
+	rm->seed = header.seed;
+	rm->sequenceSeed = header.sequenceSeed;
+	UI::numRays = static_cast<int>(header.iterations);
+
+	std::cout << "Resumed " << header.iterations << " spp from " << path << std::endl;
+	return true;
+}
+
+void AetherTracer::writeCheckpoint() {
+
+	ResourceManager* rm = dx12Renderer->rm;
+
+	// below native resolution only the top left of the textures is the image
+	if (rm->internalWidth != rm->width || rm->internalHeight != rm->height) {
+		rm->accumulationReadbackRequested = false;
+		rm->varianceReadbackRequested = false;
+		return;
+	}
+
+	std::vector<float> accumulation;
+	std::vector<float> variance;
+	dx12Renderer->computeStage->readAccumulation(accumulation);
+	dx12Renderer->computeStage->readVariance(variance);
+
+	Checkpoint::Header header = {
+		.magic = { 'A', 'E', 'T', 'C' },
+		.version = Checkpoint::VERSION,
+		.width = rm->width,
+		.height = rm->height,
+		.iterations = rm->iterations,
+		.seed = rm->seed,
+		.sequenceSeed = rm->sequenceSeed,
+		.sampler = config.sampler,
+		.deterministic = config.deterministic ? 1u : 0u,
+		.sceneHash = entityManager->sceneHash(),
+		.position = { entityManager->camera->position.x, entityManager->camera->position.y, entityManager->camera->position.z },
+		.rotation = { entityManager->camera->rotation.x, entityManager->camera->rotation.y },
+	};
+
+	checkpoint->writeAsync(config.checkpointPath, header, std::move(accumulation), std::move(variance));
+}
+
+bool AetherTracer::writeSnapshot(const std::string& path) {
+
+	ResourceManager* rm = dx12Renderer->rm;
+
+	if (rm->internalWidth != rm->width || rm->internalHeight != rm->height) {
+		rm->accumulationReadbackRequested = false;
+		std::cerr << "Snapshot: skipped " << path << ", rendering below native resolution" << std::endl;
+		return false;
+	}
+
+	// the readback heap already holds a copy, moving it out leaves the live accumulation to the GPU
+	std::vector<float> accumulation;
+	dx12Renderer->computeStage->readAccumulation(accumulation);
+	imageWriter->submit(path, rm->width, rm->height, dx12Renderer->exposure(), std::move(accumulation));
+	return true;
+}
+
+void AetherTracer::saveRenderFallback(const std::string& path) {
+
+	// the render target is upscaled to full size, so the image still gets written, just tone mapped
+	std::filesystem::path png = path;
+	png.replace_extension(".png");
+	std::cerr << "Output: rendering below native resolution, writing " << png.string() << " instead of " << path << std::endl;
+	dx12Renderer->saveRender(png.string());
+}
+
+void AetherTracer::publishSharedFrame() {
+
+	ResourceManager* rm = dx12Renderer->rm;
+
+	// below native resolution only the top left of the textures is the image, viewers keep the last full frame
+	SharedFrameRing::Frame frame;
+	if (rm->internalWidth == rm->width && rm->internalHeight == rm->height) {
+		frame = sharedFrames->begin(rm->width, rm->height, rm->iterations);
+	}
+	if (!frame.hdr) {
+		rm->accumulationReadbackRequested = false;
+		return;
+	}
+
+	// straight from the readback heap into the slot, no copy in between
+	dx12Renderer->computeStage->readAccumulation(frame.hdr);
+	sharedFrames->publish(dx12Renderer->exposure());
+}
+
+void AetherTracer::streamFrame() {
+
+	ResourceManager* rm = dx12Renderer->rm;
+
+	// below native resolution only the top left of the textures is the image, the viewer keeps the last full frame
+	if (rm->internalWidth != rm->width || rm->internalHeight != rm->height) {
+		rm->accumulationReadbackRequested = false;
+		return;
+	}
+
+	// tone mapping and compression happen on the server's thread
+	dx12Renderer->computeStage->readAccumulation(streamBuffer);
+	previewServer->submitFrame(streamBuffer, rm->width, rm->height, rm->iterations, dx12Renderer->exposure());
+}
+
+void AetherTracer::applyRemoteInput() {
+
+	PreviewServer::Input input;
+	if (!previewServer->takeInput(input)) return;
+
+	EntityManager::Camera* camera = entityManager->camera;
+	if (input.move[0] > 0.0f) camera->moveForward(input.move[0]);
+	if (input.move[1] > 0.0f) camera->moveBack(input.move[1]);
+	if (input.move[2] > 0.0f) camera->moveLeft(input.move[2]);
+	if (input.move[3] > 0.0f) camera->moveRight(input.move[3]);
+	if (input.move[4] > 0.0f) camera->moveUp(input.move[4]);
+	if (input.move[5] > 0.0f) camera->moveDown(input.move[5]);
+	if (input.mouseX != 0.0f || input.mouseY != 0.0f) camera->updateDirection(input.mouseX, input.mouseY);
+}
+
+void AetherTracer::finishRender() {
+
+	finishing = false;
+	finished = true;
+
+	uint64_t hash = dx12Renderer->hashAccumulation();
+	std::cout << "Finished " << dx12Renderer->rm->iterations << " spp, accumulation hash: " << std::hex << std::setw(16) << std::setfill('0') << hash << std::dec << std::setfill(' ') << std::endl;
+
+	// the readback for the hash is still mapped, HDR formats are encoded from it off this thread
+	if (ImageWriter::isHDR(config.outputPath)) {
+		if (!writeSnapshot(config.outputPath)) saveRenderFallback(config.outputPath);
+	}
+	else dx12Renderer->saveRender(config.outputPath);
+	if (config.quitWhenFinished) running = false;
 }
 
 void AetherTracer::updateConfig() {
@@ -73,20 +450,103 @@ void AetherTracer::renderImgui() {
 }
 
 void AetherTracer::init() {
+	loadScene();
+	initRenderer();
+}
+
+void AetherTracer::loadScene() {
 
 	meshManager = new MeshManager();
 	materialManager = new MaterialManager();
+	textureManager = new TextureManager();
 	entityManager = new EntityManager(materialManager);
-	inputManager = new InputManager(this);
-	window = new Window{ "Aether Tracer", config.resX, config.resY };
 
-	meshManager->initMeshes();
 	materialManager->initDefaultMaterials();
+	materialManager->initTextures();
 	entityManager->initScene();
 
+	// textures decode on their own threads while the meshes load, neither touches the other's data
+	std::future<void> textures;
+	if (config.textureCacheMB > 0) {
+		textureCache = new TextureCache(static_cast<size_t>(config.textureCacheMB) * 1024 * 1024);
+		textures = std::async(std::launch::async, [this]() { textureCache->addMaterialTextures(materialManager); });
+	}
+	else if (config.compressTextures) {
+		textureBaker = new TextureBaker();
+		textures = std::async(std::launch::async, [this]() { textureBaker->bakeMaterialTextures(materialManager); });
+	}
+	else {
+		textures = std::async(std::launch::async, [this]() { textureManager->loadMaterialTextures(materialManager); });
+	}
+
+	meshManager->initMeshes();
+
+	textures.get();
+}
+
+void AetherTracer::initRenderer() {
+
+	inputManager = new InputManager(this);
+	window = new Window{ "Aether Tracer", config.resX, config.resY };
 
 	dx12Renderer = new DX12Renderer{ entityManager, meshManager, materialManager, window };
 
 	dx12Renderer->init();
+	benchmark = new ConvergenceBenchmark{ dx12Renderer };
+	checkpoint = new Checkpoint();
+	imageWriter = new AsyncImageWriter();
+	if (config.sharedFrames) {
+		sharedFrames = new SharedFrameRing();
+		uint32_t maxWidth = std::max(config.sharedFrameMaxWidth, dx12Renderer->rm->width);
+		uint32_t maxHeight = std::max(config.sharedFrameMaxHeight, dx12Renderer->rm->height);
+		if (!sharedFrames->create(config.sharedFrameName, maxWidth, maxHeight)) {
+			delete sharedFrames;
+			sharedFrames = nullptr;
+		}
+	}
+	if (!config.streamAddress.empty()) {
+		previewServer = new PreviewServer();
+		if (!previewServer->start(config.streamAddress)) {
+			delete previewServer;
+			previewServer = nullptr;
+		}
+	}
 	UI::numRays = 0;
-}
\ No newline at end of file
+	if (config.headless) UI::renderUI = false;
+}
+
+void AetherTracer::shutdown() {
+
+	checkpoint->wait();
+	dx12Renderer->flush();
+
+	delete dx12Renderer;
+	dx12Renderer = nullptr;
+	delete window;
+	window = nullptr;
+	delete inputManager;
+	inputManager = nullptr;
+	delete benchmark;
+	benchmark = nullptr;
+	delete checkpoint;
+	checkpoint = nullptr;
+	delete imageWriter;
+	imageWriter = nullptr;
+	delete sharedFrames;
+	sharedFrames = nullptr;
+	delete previewServer;
+	previewServer = nullptr;
+}
+
+AetherTracer::~AetherTracer() {
+
+	if (dx12Renderer) shutdown();
+
+	// the scene, shutdown leaves it for renderer rebuilds
+	delete textureCache;
+	delete textureBaker;
+	delete textureManager;
+	delete entityManager;
+	delete meshManager;
+	delete materialManager;
+}
@@ -6,33 +6,69 @@
 #include "imgui_impl_dx12.h"
 #include <chrono>
 #include <cstdint>
+#include <string>
+#include <vector>
 
 class InputManager;
 class Window;
 class MaterialManager;
 class MeshManager;
+class TextureManager;
+class TextureCache;
+class TextureBaker;
 class EntityManager;
 class DX12Renderer;
+class ConvergenceBenchmark;
+class Checkpoint;
+class AsyncImageWriter;
+class SharedFrameRing;
+class PreviewServer;
 
 class AetherTracer {
 
 public:
 
 	AetherTracer() {}
-	~AetherTracer() {}
+	~AetherTracer(); // shuts the renderer down if it's still up, then frees the scene
 
 	void init();
+	void loadScene(); // meshes, materials and entities, no window or device so it outlives renderer rebuilds
+	void initRenderer();
+	void shutdown(); // window and renderer, the scene is left alone for the destructor
 	void updateConfig();
 
 	void renderImgui();
+	void finishRender(); // sample target reached, hash the accumulation and write the image
+	bool resume(); // continue the accumulation from config.resumePath
+	void writeCheckpoint(); // hands the accumulation read back this frame to the checkpoint writer
+	bool writeSnapshot(const std::string& path); // hands the accumulation read back this frame to the image writer, false when skipped
+	void saveRenderFallback(const std::string& path); // final HDR output below native resolution, the upscaled render target as PNG
+	void publishSharedFrame(); // copies the accumulation read back this frame into the shared frame ring
+	void streamFrame(); // hands the accumulation read back this frame to the preview server
+	void applyRemoteInput(); // camera input from the preview viewer
 
 	void run();
+	void runWorker(); // renders jobs for a render coordinator instead of the interactive loop
 
 	bool running = true;
-	MeshManager* meshManager;
-	MaterialManager* materialManager;
-	EntityManager* entityManager;
-	InputManager* inputManager;
-	Window* window;
-	DX12Renderer* dx12Renderer;
+	bool finishing = false;
+	bool finished = false;
+	std::string snapshotPath; // set when the next frame should read its accumulation back for the image writer
+	bool quitAfterSnapshot = false;
+	bool outputSnapshot = false; // the pending snapshot is config.outputPath, it isn't dropped below native resolution
+	MeshManager* meshManager = nullptr;
+	MaterialManager* materialManager = nullptr;
+	TextureManager* textureManager = nullptr;
+	TextureCache* textureCache = nullptr; // replaces the whole textures when config.textureCacheMB is set
+	TextureBaker* textureBaker = nullptr; // block compressed textures when config.compressTextures is set
+	EntityManager* entityManager = nullptr;
+	InputManager* inputManager = nullptr;
+	Window* window = nullptr;
+	DX12Renderer* dx12Renderer = nullptr; // set once initRenderer has run
+	ConvergenceBenchmark* benchmark = nullptr;
+	Checkpoint* checkpoint = nullptr;
+	AsyncImageWriter* imageWriter = nullptr;
+	SharedFrameRing* sharedFrames = nullptr; // set when config.sharedFrames is
+	PreviewServer* previewServer = nullptr; // set when config.streamAddress is
+	std::vector<float> streamBuffer; // swapped with the preview server's, reused every streamed frame
 };
\ No newline at end of file
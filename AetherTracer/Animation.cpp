@@ -0,0 +1,212 @@
+#include "Animation.h"
+
+#include "EntityManager.h"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+namespace {
+
+	bool parseVector(const std::string& value, PT::Vector3& out, int count) {
+		float values[3] = {};
+		std::stringstream stream(value);
+		std::string item;
+		int i = 0;
+		while (std::getline(stream, item, ',')) {
+			if (i == count) return false;
+			values[i++] = std::stof(item);
+		}
+		out = { values[0], values[1], values[2] };
+		return i == count;
+	}
+
+	PT::Vector3 lerp(const PT::Vector3& a, const PT::Vector3& b, float t) {
+		return a + (b - a) * t;
+	}
+
+	// uniform Catmull-Rom between p1 and p2
+	PT::Vector3 catmullRom(const PT::Vector3& p0, const PT::Vector3& p1, const PT::Vector3& p2, const PT::Vector3& p3, float t) {
+		float t2 = t * t;
+		float t3 = t2 * t;
+		return (p1 * 2.0f + (p2 - p0) * t + (p0 * 2.0f - p1 * 5.0f + p2 * 4.0f - p3) * t2 + (p1 * 3.0f - p0 - p2 * 3.0f + p3) * t3) * 0.5f;
+	}
+}
+
+bool Animation::load(const std::string& path) {
+
+	std::ifstream file(path);
+	if (!file) {
+		std::cerr << "Animation: can't open " << path << std::endl;
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line)) {
+		lineNumber++;
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) line.erase(comment);
+
+		std::stringstream tokens(line);
+		std::string kind;
+		if (!(tokens >> kind)) continue;
+
+		try {
+			if (kind == "sequence") {
+				std::string token;
+				while (tokens >> token) {
+					size_t equals = token.find('=');
+					std::string key = token.substr(0, equals);
+					std::string value = equals == std::string::npos ? "" : token.substr(equals + 1);
+
+					if (key == "fps") fps = std::stof(value);
+					else if (key == "start") startFrame = std::stoi(value);
+					else if (key == "end") endFrame = std::stoi(value);
+					else throw std::invalid_argument(key);
+				}
+				continue;
+			}
+
+			int entity = -1;
+			if (kind == "entity") tokens >> entity;
+			else if (kind != "camera") throw std::invalid_argument(kind);
+
+			if (kind == "entity" && (tokens.fail() || entity < 0)) throw std::invalid_argument("entity index");
+
+			Key key;
+			bool hasTime = false;
+			std::string token;
+			while (tokens >> token) {
+				size_t equals = token.find('=');
+				std::string name = token.substr(0, equals);
+				std::string value = equals == std::string::npos ? "" : token.substr(equals + 1);
+
+				if (name == "t") {
+					key.time = std::stof(value);
+					hasTime = true;
+				}
+				else if (name == "pos") key.hasPosition = parseVector(value, key.position, 3);
+				else if (name == "rot") key.hasRotation = parseVector(value, key.rotation, entity < 0 ? 2 : 3);
+				else if (name == "fov" && entity < 0) {
+					key.fov = std::stof(value);
+					key.hasFov = true;
+				}
+				else throw std::invalid_argument(name);
+
+				if ((name == "pos" && !key.hasPosition) || (name == "rot" && !key.hasRotation)) throw std::invalid_argument(name);
+			}
+			if (!hasTime) throw std::invalid_argument("t");
+
+			auto track = std::find_if(tracks.begin(), tracks.end(), [entity](const Track& t) { return t.entity == entity; });
+			if (track == tracks.end()) {
+				tracks.push_back({ entity, {} });
+				track = tracks.end() - 1;
+			}
+			track->keys.push_back(key);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Animation: line " << lineNumber << ": can't parse " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	for (Track& track : tracks) {
+		std::stable_sort(track.keys.begin(), track.keys.end(), [](const Key& a, const Key& b) { return a.time < b.time; });
+	}
+
+	if (fps <= 0.0f || endFrame < startFrame) {
+		std::cerr << "Animation: " << path << " has no frames to render" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void Animation::bind(EntityManager* entityManager) {
+
+	for (auto it = tracks.begin(); it != tracks.end();) {
+
+		if (it->entity >= static_cast<int>(entityManager->count())) {
+			std::cerr << "Animation: no entity " << it->entity << " in the scene, track ignored" << std::endl;
+			it = tracks.erase(it);
+			continue;
+		}
+
+		// the scene's placement is the value before the first key
+		Key previous;
+		if (it->entity < 0) {
+			EntityManager::Camera* camera = entityManager->camera;
+			previous.position = camera->position;
+			previous.rotation = { camera->rotation.x, camera->rotation.y, 0.0f };
+			previous.fov = camera->fovYDegrees;
+		}
+		else {
+			previous.position = entityManager->positions[it->entity];
+			previous.rotation = entityManager->rotations[it->entity];
+		}
+
+		for (Key& key : it->keys) {
+			if (!key.hasPosition) key.position = previous.position;
+			if (!key.hasRotation) key.rotation = previous.rotation;
+			if (!key.hasFov) key.fov = previous.fov;
+			key.hasPosition = key.hasRotation = key.hasFov = true;
+			previous = key;
+		}
+
+		++it;
+	}
+}
+
+Animation::Key Animation::sample(const Track& track, float time) const {
+
+	const std::vector<Key>& keys = track.keys;
+
+	if (time <= keys.front().time) return keys.front();
+	if (time >= keys.back().time) return keys.back();
+
+	size_t next = 1;
+	while (keys[next].time < time) next++;
+
+	size_t i1 = next - 1;
+	size_t i2 = next;
+	size_t i0 = i1 > 0 ? i1 - 1 : i1;
+	size_t i3 = i2 + 1 < keys.size() ? i2 + 1 : i2;
+
+	float span = keys[i2].time - keys[i1].time;
+	float t = span > 0.0f ? (time - keys[i1].time) / span : 1.0f;
+
+	Key key;
+	key.time = time;
+	key.position = catmullRom(keys[i0].position, keys[i1].position, keys[i2].position, keys[i3].position, t);
+	key.rotation = lerp(keys[i1].rotation, keys[i2].rotation, t);
+	key.fov = keys[i1].fov + (keys[i2].fov - keys[i1].fov) * t;
+	return key;
+}
+
+void Animation::apply(float time, EntityManager* entityManager) const {
+
+	for (const Track& track : tracks) {
+
+		if (track.keys.empty()) continue;
+		Key key = sample(track, time);
+
+		if (track.entity < 0) {
+			EntityManager::Camera* camera = entityManager->camera;
+			camera->position = key.position;
+			camera->rotation = { key.rotation.x, key.rotation.y };
+			camera->fovYDegrees = key.fov;
+			continue;
+		}
+
+		const PT::Vector3& position = entityManager->positions[track.entity];
+		const PT::Vector3& rotation = entityManager->rotations[track.entity];
+		bool moved = position.x != key.position.x || position.y != key.position.y || position.z != key.position.z
+			|| rotation.x != key.rotation.x || rotation.y != key.rotation.y || rotation.z != key.rotation.z;
+
+		// only a real move sets the dirty bit, a held key costs nothing downstream
+		if (moved) entityManager->setTransform(static_cast<EntityManager::Handle>(track.entity), key.position, key.rotation);
+	}
+}
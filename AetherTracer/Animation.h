@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "Vector.h"
+
+class EntityManager;
+
+// Keyframed entity transforms and camera path. The file has one key per line, # starts a comment:
+//
+//   sequence fps=24 start=0 end=95
+//   camera t=0 pos=15,3,0 rot=-1,0 fov=45
+//   camera t=4 pos=5,4,8 rot=40,-10
+//   entity 7 t=0 rot=0,-0.4,0
+//   entity 7 t=4 rot=0,5.9,0
+//
+// Times are seconds. Positions follow a Catmull-Rom spline through the keys, rotations and fov are linear.
+// A value left out of a key holds the previous key's, or the scene's for the first key of a track.
+
+class Animation {
+public:
+
+	struct Key {
+		float time = 0.0f;
+		PT::Vector3 position;
+		PT::Vector3 rotation; // camera uses x and y, degrees. entities radians
+		float fov = 0.0f;
+		bool hasPosition = false;
+		bool hasRotation = false;
+		bool hasFov = false;
+	};
+
+	struct Track {
+		int entity = -1; // -1 = camera
+		std::vector<Key> keys; // sorted by time
+	};
+
+	bool load(const std::string& path);
+	void bind(EntityManager* entityManager); // fills values the keys left out, once the scene is loaded
+
+	void apply(float time, EntityManager* entityManager) const; // sets transforms, marks them dirty if an entity moved
+
+	float frameTime(int frame) const { return static_cast<float>(frame) / fps; }
+
+	float fps = 24.0f;
+	int startFrame = 0;
+	int endFrame = 0; // inclusive
+
+private:
+
+	Key sample(const Track& track, float time) const;
+
+	std::vector<Track> tracks;
+};
@@ -0,0 +1,77 @@
+#include "AsyncImageWriter.h"
+
+#include "ImageWriter.h"
+
+#include <chrono>
+#include <iostream>
+
+AsyncImageWriter::AsyncImageWriter() {
+	writer = std::thread(&AsyncImageWriter::writerLoop, this);
+}
+
+AsyncImageWriter::~AsyncImageWriter() {
+
+	stopping.store(true, std::memory_order_release);
+	signal.fetch_add(1, std::memory_order_release);
+	signal.notify_one();
+	if (writer.joinable()) writer.join();
+}
+
+bool AsyncImageWriter::submit(const std::string& path, uint32_t width, uint32_t height, float exposure, std::vector<float>&& accumulation) {
+
+	if (full()) {
+		std::cerr << "Image writer busy, dropped " << path << std::endl;
+		return false;
+	}
+
+	// the slot is ours until tail moves past it, the writer never reads beyond tail
+	uint32_t index = tail.load(std::memory_order_relaxed);
+	Job& job = jobs[index % CAPACITY];
+	job.path = path;
+	job.width = width;
+	job.height = height;
+	job.exposure = exposure;
+	job.accumulation = std::move(accumulation);
+	tail.store(index + 1, std::memory_order_release);
+
+	signal.fetch_add(1, std::memory_order_release);
+	signal.notify_one();
+	return true;
+}
+
+void AsyncImageWriter::wait() {
+
+	uint32_t target = tail.load(std::memory_order_relaxed);
+	uint32_t done = head.load(std::memory_order_acquire);
+	while (done != target) {
+		head.wait(done, std::memory_order_acquire);
+		done = head.load(std::memory_order_acquire);
+	}
+}
+
+void AsyncImageWriter::writerLoop() {
+
+	while (true) {
+
+		// read the signal before looking at the ring, a submit after the check changes it and the wait falls through
+		uint32_t seen = signal.load(std::memory_order_acquire);
+		uint32_t index = head.load(std::memory_order_relaxed);
+
+		if (index == tail.load(std::memory_order_acquire)) {
+			if (stopping.load(std::memory_order_acquire)) break;
+			signal.wait(seen, std::memory_order_acquire);
+			continue;
+		}
+
+		Job& job = jobs[index % CAPACITY];
+		auto start = std::chrono::high_resolution_clock::now();
+		ImageWriter::writeAccumulation(job.path, job.width, job.height, job.accumulation, job.exposure);
+		float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		std::cout << "Image writer: encoded in " << ms << " ms" << std::endl;
+
+		// free the snapshot before handing the slot back
+		job.accumulation = std::vector<float>();
+		head.store(index + 1, std::memory_order_release);
+		head.notify_all();
+	}
+}
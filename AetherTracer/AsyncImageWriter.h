@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+
+// Image output off the render thread. The frame that wants an image queues an accumulation readback, the copy the
+// GPU leaves in the readback heap is the snapshot, so rendering carries on into the live accumulation while the file
+// is encoded. submit moves that snapshot into a single producer, single consumer ring and returns, one writer thread
+// drains it and picks the format from the extension (ImageWriter::writeAccumulation).
+
+class AsyncImageWriter {
+public:
+
+	static constexpr uint32_t CAPACITY = 4; // snapshots in flight, a full ring drops the new one
+
+	AsyncImageWriter();
+	~AsyncImageWriter(); // writes whatever is still queued
+
+	AsyncImageWriter(const AsyncImageWriter&) = delete;
+	AsyncImageWriter& operator=(const AsyncImageWriter&) = delete;
+
+	// render thread only. takes the buffer, false if the ring is full
+	bool submit(const std::string& path, uint32_t width, uint32_t height, float exposure, std::vector<float>&& accumulation);
+	bool full() const { return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) >= CAPACITY; }
+	void wait(); // until everything submitted so far is on disk
+
+private:
+
+	struct Job {
+		std::string path;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		float exposure = 1.0f; // of the tone map at submit, HDR files ignore it
+		std::vector<float> accumulation; // rgb sum, samples
+	};
+
+	void writerLoop();
+
+	Job jobs[CAPACITY];
+	std::atomic<uint32_t> head = 0; // next job the writer takes, only the writer moves it
+	std::atomic<uint32_t> tail = 0; // next free slot, only submit moves it
+	std::atomic<uint32_t> signal = 0; // bumped on every submit and on stop, what the writer sleeps on
+	std::atomic<bool> stopping = false;
+	std::thread writer;
+};
@@ -0,0 +1,225 @@
+#include "BatchRenderer.h"
+
+#include "AetherTracer.h"
+#include "DX12Renderer.h"
+#include "EntityManager.h"
+#include "Window.h"
+#include "UI.h"
+#include "Config.h"
+
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <iostream>
+#include <chrono>
+
+namespace {
+
+	// "x,y,z" into count floats
+	bool parseFloats(const std::string& value, float* out, int count) {
+		std::stringstream stream(value);
+		std::string item;
+		int i = 0;
+		while (std::getline(stream, item, ',')) {
+			if (i == count) return false;
+			out[i++] = std::stof(item);
+		}
+		return i == count;
+	}
+}
+
+bool BatchRenderer::parseJobs(const std::string& path, std::vector<Job>& jobs) {
+
+	std::ifstream file(path);
+	if (!file) {
+		std::cerr << "Batch: can't open " << path << std::endl;
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line)) {
+		lineNumber++;
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) line.erase(comment);
+
+		Job job;
+		job.line = lineNumber;
+		job.width = config.resX;
+		job.height = config.resY;
+		job.samples = config.sampleTarget;
+		job.seconds = config.renderDeadline;
+
+		std::stringstream tokens(line);
+		std::string token;
+		bool empty = true;
+		bool valid = true;
+
+		while (tokens >> token) {
+			empty = false;
+
+			size_t equals = token.find('=');
+			if (equals == std::string::npos) {
+				std::cerr << "Batch: line " << lineNumber << ": expected key=value, got " << token << std::endl;
+				valid = false;
+				break;
+			}
+
+			std::string key = token.substr(0, equals);
+			std::string value = token.substr(equals + 1);
+
+			try {
+				if (key == "output") job.output = value;
+				else if (key == "width") job.width = static_cast<uint32_t>(std::stoul(value));
+				else if (key == "height") job.height = static_cast<uint32_t>(std::stoul(value));
+				else if (key == "spp") job.samples = std::stoi(value);
+				else if (key == "time") job.seconds = std::stof(value);
+				else if (key == "fov") job.fov = std::stof(value);
+				else if (key == "pos") valid = job.hasPosition = parseFloats(value, job.position, 3);
+				else if (key == "rot") valid = job.hasRotation = parseFloats(value, job.rotation, 2);
+				else {
+					std::cerr << "Batch: line " << lineNumber << ": unknown key " << key << std::endl;
+					valid = false;
+					break;
+				}
+			}
+			catch (const std::exception&) {
+				valid = false;
+			}
+
+			if (!valid) {
+				std::cerr << "Batch: line " << lineNumber << ": bad value for " << key << std::endl;
+				break;
+			}
+		}
+
+		if (empty) continue;
+
+		if (valid && job.samples <= 0 && job.seconds <= 0.0f) {
+			std::cerr << "Batch: line " << lineNumber << ": needs spp or time" << std::endl;
+			valid = false;
+		}
+		if (valid && (job.width == 0 || job.height == 0)) {
+			std::cerr << "Batch: line " << lineNumber << ": zero resolution" << std::endl;
+			valid = false;
+		}
+		if (!valid) return false;
+
+		if (job.output.empty()) job.output = "shot_" + std::to_string(jobs.size()) + ".png";
+		if (std::filesystem::path(job.output).is_relative()) job.output = (std::filesystem::path("renders") / job.output).string();
+
+		jobs.push_back(job);
+	}
+
+	return true;
+}
+
+int BatchRenderer::run() {
+
+	std::vector<Job> jobs;
+	if (!parseJobs(jobPath, jobs)) return 1;
+	if (jobs.empty()) {
+		std::cerr << "Batch: no jobs in " << jobPath << std::endl;
+		return 1;
+	}
+
+	// nothing carries over between shots and nothing should depend on how fast the last one moved
+	config.accumulate = true;
+	config.temporalReprojection = false;
+	config.dynamicResolution = false;
+	config.quitWhenFinished = false;
+
+	std::cout << "Batch: " << jobs.size() << " shots from " << jobPath << std::endl;
+
+	// every shot renders the same scene, it's loaded once and only the renderer is rebuilt for a new resolution
+	AetherTracer* tracer = new AetherTracer{};
+	tracer->loadScene();
+	EntityManager::Camera sceneCamera = *tracer->entityManager->camera;
+	int failed = 0;
+
+	for (size_t i = 0; i < jobs.size(); i++) {
+
+		const Job& job = jobs[i];
+
+		if (i > 0 && (jobs[i - 1].width != job.width || jobs[i - 1].height != job.height)) {
+			tracer->shutdown();
+		}
+
+		if (!tracer->dx12Renderer) {
+			config.resX = job.width;
+			config.resY = job.height;
+			tracer->initRenderer();
+		}
+
+		// keys the shot leaves out come from the scene's camera, not from wherever the last shot put it
+		*tracer->entityManager->camera = sceneCamera;
+
+		std::cout << "Batch: shot " << i + 1 << "/" << jobs.size() << " (line " << job.line << ") " << job.width << "x" << job.height << " -> " << job.output << std::endl;
+
+		if (!renderJob(tracer, job)) {
+			std::cout << "Batch: window closed, stopping" << std::endl;
+			break;
+		}
+
+		if (!tracer->dx12Renderer->saveRender(job.output)) failed++;
+	}
+
+	delete tracer;
+
+	std::cout << "Batch: done, " << failed << " failed" << std::endl;
+	return failed == 0 ? 0 : 1;
+}
+
+bool BatchRenderer::renderJob(AetherTracer* tracer, const Job& job) {
+
+	ResourceManager* rm = tracer->dx12Renderer->rm;
+	EntityManager::Camera* camera = tracer->entityManager->camera;
+
+	if (rm->width != job.width || rm->height != job.height) {
+		std::cerr << "Batch: window came out " << rm->width << "x" << rm->height << " instead of " << job.width << "x" << job.height << std::endl;
+	}
+
+	if (job.hasPosition) camera->position = { job.position[0], job.position[1], job.position[2] };
+	if (job.hasRotation) camera->rotation = { job.rotation[0], job.rotation[1] };
+	if (job.fov > 0.0f) camera->fovYDegrees = job.fov;
+
+	if (!renderShot(tracer, job.samples, job.seconds)) return false;
+
+	std::cout << "Batch: " << rm->iterations << " spp" << std::endl;
+	return true;
+}
+
+bool BatchRenderer::renderShot(AetherTracer* tracer, int samples, float seconds) {
+
+	ResourceManager* rm = tracer->dx12Renderer->rm;
+
+	config.sampleTarget = samples;
+	config.renderDeadline = 0.0f; // the deadline is kept here, the main loop isn't running
+	UI::accumulationUpdate = true;
+
+	SDL_Event event;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	while (true) {
+
+		while (SDL_PollEvent(&event)) {
+			tracer->window->pollEvents(event);
+		}
+		if (tracer->window->shouldClose()) return false;
+
+		float elapsed = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+		bool reset = UI::accumulationUpdate;
+		bool samplesDone = samples > 0 && rm->iterations >= static_cast<UINT>(samples);
+		bool timeDone = seconds > 0.0f && elapsed >= seconds;
+
+		tracer->renderImgui();
+		tracer->dx12Renderer->render();
+		tracer->dx12Renderer->present();
+
+		if (reset) start = std::chrono::high_resolution_clock::now();
+		else if (samplesDone || timeDone) break;
+	}
+
+	return true;
+}
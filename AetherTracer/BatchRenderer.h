@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+class AetherTracer;
+
+// Renders a list of shots without input. The job file has one shot per line of key=value pairs, # starts a comment:
+//
+//   output=hall.png width=1920 height=1080 spp=512 time=60 pos=0,2,-8 rot=90,-10 fov=50
+//
+// Missing keys fall back to the config and the scene's camera. A shot ends at spp samples or after time seconds, whichever comes first.
+// Relative outputs go in renders/. The scene is loaded once for all shots, shots at the same resolution share a renderer
+// and a new resolution rebuilds only the renderer.
+
+class BatchRenderer {
+public:
+
+	struct Job {
+		std::string output;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		int samples = 0; // 0 = time only
+		float seconds = 0.0f; // 0 = samples only
+		float position[3] = {};
+		float rotation[2] = {}; // degrees, yaw and pitch
+		bool hasPosition = false; // otherwise the scene's camera
+		bool hasRotation = false;
+		float fov = 0.0f; // 0 = the camera's
+		int line = 0;
+	};
+
+	BatchRenderer(const std::string& jobPath) : jobPath(jobPath) {};
+	~BatchRenderer() {};
+
+	int run();
+
+	static bool parseJobs(const std::string& path, std::vector<Job>& jobs);
+	static bool renderShot(AetherTracer* tracer, int samples, float seconds); // restarts the accumulation, false if the window was closed
+
+private:
+
+	bool renderJob(AetherTracer* tracer, const Job& job); // false if the window was closed
+
+	std::string jobPath;
+};
@@ -0,0 +1,122 @@
+#include "BlueNoise.h"
+
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <iostream>
+
+std::vector<float> BlueNoise::buildKernel(uint32_t size, float sigma) {
+
+	// energy contributed at a toroidal offset, indexed by (dx, dy) in [0, size)
+	std::vector<float> kernel(size * size);
+	float invTwoSigmaSq = 1.0f / (2.0f * sigma * sigma);
+
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			float dx = static_cast<float>(std::min(x, size - x));
+			float dy = static_cast<float>(std::min(y, size - y));
+			kernel[x + y * size] = std::exp(-(dx * dx + dy * dy) * invTwoSigmaSq);
+		}
+	}
+
+	return kernel;
+}
+
+void BlueNoise::Pattern::toggle(uint32_t pixel) {
+
+	bits[pixel] ^= 1u;
+	float sign = bits[pixel] ? 1.0f : -1.0f;
+
+	uint32_t px = pixel % size;
+	uint32_t py = pixel / size;
+
+	for (uint32_t y = 0; y < size; y++) {
+		uint32_t dy = (y + size - py) % size;
+		for (uint32_t x = 0; x < size; x++) {
+			uint32_t dx = (x + size - px) % size;
+			energy[x + y * size] += sign * (*kernel)[dx + dy * size];
+		}
+	}
+}
+
+uint32_t BlueNoise::Pattern::tightestCluster() const {
+
+	uint32_t best = 0;
+	float bestEnergy = -std::numeric_limits<float>::max();
+	for (uint32_t i = 0; i < bits.size(); i++) {
+		if (bits[i] && energy[i] > bestEnergy) {
+			bestEnergy = energy[i];
+			best = i;
+		}
+	}
+	return best;
+}
+
+uint32_t BlueNoise::Pattern::largestVoid() const {
+
+	uint32_t best = 0;
+	float bestEnergy = std::numeric_limits<float>::max();
+	for (uint32_t i = 0; i < bits.size(); i++) {
+		if (!bits[i] && energy[i] < bestEnergy) {
+			bestEnergy = energy[i];
+			best = i;
+		}
+	}
+	return best;
+}
+
+std::vector<float> BlueNoise::generate(uint32_t size, uint32_t seed) {
+
+	uint32_t numPixels = size * size;
+	std::vector<float> kernel = buildKernel(size, 1.5f);
+
+	Pattern pattern = { size, std::vector<uint8_t>(numPixels, 0), std::vector<float>(numPixels, 0.0f), &kernel };
+
+	// initial binary pattern, 10% of the pixels set at random
+	std::mt19937 gen(seed);
+	std::uniform_int_distribution<uint32_t> dist(0, numPixels - 1);
+
+	uint32_t numOnes = std::max(numPixels / 10, 1u);
+	for (uint32_t placed = 0; placed < numOnes;) {
+		uint32_t pixel = dist(gen);
+		if (pattern.bits[pixel]) continue;
+		pattern.toggle(pixel);
+		placed++;
+	}
+
+	// move the tightest cluster into the largest void until the pattern settles
+	for (uint32_t iteration = 0; iteration < numPixels; iteration++) {
+		uint32_t cluster = pattern.tightestCluster();
+		pattern.toggle(cluster);
+		uint32_t voidPixel = pattern.largestVoid();
+		pattern.toggle(voidPixel);
+		if (voidPixel == cluster) break;
+	}
+
+	std::vector<uint32_t> rank(numPixels, 0);
+
+	// ranks below the initial pattern, remove the tightest clusters first
+	Pattern removal = pattern;
+	for (uint32_t r = numOnes; r-- > 0;) {
+		uint32_t cluster = removal.tightestCluster();
+		removal.toggle(cluster);
+		rank[cluster] = r;
+	}
+
+	// ranks above, fill the largest voids until every pixel is set
+	for (uint32_t r = numOnes; r < numPixels; r++) {
+		uint32_t voidPixel = pattern.largestVoid();
+		pattern.toggle(voidPixel);
+		rank[voidPixel] = r;
+	}
+
+	std::vector<float> mask(numPixels);
+	for (uint32_t i = 0; i < numPixels; i++) {
+		mask[i] = (static_cast<float>(rank[i]) + 0.5f) / static_cast<float>(numPixels);
+	}
+
+	std::cout << "Blue noise: " << size << "x" << size << " mask generated" << std::endl;
+
+	return mask;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// Tileable blue noise mask generated with void and cluster (Ulichney 1993).
+// Values are the rank of each pixel in [0, 1), neighbouring pixels are spread as far apart as possible.
+
+class BlueNoise {
+public:
+
+	static std::vector<float> generate(uint32_t size, uint32_t seed = 1);
+
+private:
+
+	struct Pattern {
+		uint32_t size;
+		std::vector<uint8_t> bits;
+		std::vector<float> energy; // gaussian weighted sum over the set pixels, wraps around
+		const std::vector<float>* kernel;
+
+		void toggle(uint32_t pixel);
+		uint32_t tightestCluster() const;
+		uint32_t largestVoid() const;
+	};
+
+	static std::vector<float> buildKernel(uint32_t size, float sigma);
+};
@@ -0,0 +1,87 @@
+#include "Checkpoint.h"
+
+#include <fstream>
+#include <filesystem>
+#include <iostream>
+#include <cstring>
+
+bool Checkpoint::writeAsync(const std::string& path, const Header& header, std::vector<float>&& accumulation, std::vector<float>&& variance) {
+
+	if (writing) return false;
+	if (writer.joinable()) writer.join();
+
+	writing = true;
+	writer = std::thread([this, path, header, accumulation = std::move(accumulation), variance = std::move(variance)]() {
+		write(path, header, accumulation, variance);
+		writing = false;
+	});
+	return true;
+}
+
+void Checkpoint::wait() {
+	if (writer.joinable()) writer.join();
+}
+
+bool Checkpoint::write(const std::string& path, const Header& header, const std::vector<float>& accumulation, const std::vector<float>& variance) {
+
+	std::filesystem::path filePath(path);
+	if (filePath.has_parent_path()) std::filesystem::create_directories(filePath.parent_path());
+
+	std::filesystem::path tempPath = filePath;
+	tempPath += ".tmp";
+
+	{
+		std::ofstream file(tempPath, std::ios::binary);
+		if (!file) {
+			std::cerr << "Checkpoint: can't write " << tempPath.string() << std::endl;
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(accumulation.data()), accumulation.size() * sizeof(float));
+		file.write(reinterpret_cast<const char*>(variance.data()), variance.size() * sizeof(float));
+
+		if (!file) {
+			std::cerr << "Checkpoint: write to " << tempPath.string() << " failed" << std::endl;
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, filePath, error);
+	if (error) {
+		std::cerr << "Checkpoint: can't replace " << path << ": " << error.message() << std::endl;
+		return false;
+	}
+
+	std::cout << "Checkpoint: " << header.iterations << " spp written to " << path << std::endl;
+	return true;
+}
+
+bool Checkpoint::read(const std::string& path, Header& header, std::vector<float>& accumulation, std::vector<float>& variance) {
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "Checkpoint: can't open " << path << std::endl;
+		return false;
+	}
+
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || memcmp(header.magic, "AETC", 4) != 0 || header.version != VERSION) {
+		std::cerr << "Checkpoint: " << path << " is not a version " << VERSION << " checkpoint" << std::endl;
+		return false;
+	}
+
+	size_t pixels = static_cast<size_t>(header.width) * header.height;
+	accumulation.resize(pixels * 4);
+	variance.resize(pixels * 2);
+
+	file.read(reinterpret_cast<char*>(accumulation.data()), accumulation.size() * sizeof(float));
+	file.read(reinterpret_cast<char*>(variance.data()), variance.size() * sizeof(float));
+
+	if (!file) {
+		std::cerr << "Checkpoint: " << path << " is truncated" << std::endl;
+		return false;
+	}
+	return true;
+}
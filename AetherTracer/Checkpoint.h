@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+
+// Accumulation snapshot for long renders. The file is a header followed by the raw accumulation (rgb sum, samples)
+// and Welford (mean, M2) planes, no row padding. Writes run on their own thread into a temporary file that replaces
+// the previous checkpoint only once it is complete, so a crash mid write keeps the last good one.
+
+class Checkpoint {
+public:
+
+	struct Header {
+		char magic[4]; // "AETC"
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t iterations; // samples per pixel so far
+		uint32_t seed; // frame seed the next frame would have used
+		uint32_t sequenceSeed; // scramble of the running accumulation
+		int32_t sampler;
+		uint32_t deterministic;
+		uint64_t sceneHash;
+		float position[3];
+		float rotation[2];
+	};
+
+	static constexpr uint32_t VERSION = 1;
+
+	Checkpoint() {};
+	~Checkpoint() { wait(); };
+
+	bool busy() const { return writing; }
+
+	// takes the buffers, returns straight away. false if the previous write is still running
+	bool writeAsync(const std::string& path, const Header& header, std::vector<float>&& accumulation, std::vector<float>&& variance);
+	void wait();
+
+	static bool read(const std::string& path, Header& header, std::vector<float>& accumulation, std::vector<float>& variance);
+
+private:
+
+	static bool write(const std::string& path, const Header& header, const std::vector<float>& accumulation, const std::vector<float>& variance);
+
+	std::thread writer;
+	std::atomic<bool> writing = false;
+};
@@ -3,6 +3,11 @@
 #include <d3dcompiler.h>
 #include <random>
 #include <random>
+#include "Config.h"
+#include "UI.h"
+
+#include <algorithm>
+#include <cmath>
 
 
 ComputeStage::ComputeStage(ResourceManager* resourceManager, MeshManager* meshManager, MaterialManager* materialManager, EntityManager* entityManager)
@@ -15,55 +20,29 @@ void ComputeStage::initStage() {
 	initComputeDescriptors();
 }
 
-void ComputeStage::updateRand() {
-
-	std::cout << "update rand" << std::endl;
-
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_int_distribution<uint64_t> dist;
-
-	std::cout << "width: " << rm->width << ", height: " << rm->height << std::endl;
-
-	rm->randPattern.resize(rm->width * rm->height);
-
-	for (uint64_t x = 0; x < rm->width; x++) {
-		
-		for (uint64_t y = 0; y < rm->height; y++) {
-
-			uint64_t state = ((y << 16u) | x) ^ (rm->seed * 1664525u * static_cast<uint64_t>(GetTickCount64())) ^ 0xdeadbeefu;
-
-			// PCG hash function
-
-			uint64_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
-			word = (word >> 22u) ^ word;
-
-			uint64_t rot = state >> 28u;
-
-			word = (word >> rot) | (word << (32u - rot));
-
-			rm->randPattern[x + y * rm->width] = word;
-			//rm->randPattern[x + y * rm->width] = dist(gen);
-		}
-	}
-
-	size_t randSize = rm->randPattern.size() * sizeof(uint64_t);
-	rm->randBuffer = createBuffers(rm->randPattern.data(), randSize, D3D12_RESOURCE_STATE_COMMON, true);
-	rm->randBuffer->defaultBuffers->SetName(L"rng Defaut Buffer");
-	pushBuffer(rm->randBuffer, randSize, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-
-}
-
-void ComputeStage::initMaxLumBuffer() {
+void ComputeStage::initHistogramBuffer() {
 
-	std::vector<UINT> lum;
-	lum.resize(1);
-	lum[0] = 1u;
-	rm->maxLumBuffer = createBuffers(lum.data(), sizeof(UINT), D3D12_RESOURCE_STATE_COMMON, true);
-	rm->maxLumBuffer->defaultBuffers->SetName(L"Max Luminance Buffer");
-	pushBuffer(rm->maxLumBuffer, sizeof(UINT), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	// empty bins and an exposure of 0 EV, the float bits of 0 are 0
+	std::vector<UINT> histogram(ResourceManager::HISTOGRAM_BINS + 1, 0u);
+	size_t size = histogram.size() * sizeof(UINT);
+	rm->histogramBuffer = createBuffers(histogram.data(), size, D3D12_RESOURCE_STATE_COMMON, true);
+	rm->histogramBuffer->defaultBuffers->SetName(L"Luminance Histogram Buffer");
+	pushBuffer(rm->histogramBuffer, size, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
+	// CPU tone mapping has to use the same exposure as the screen
+	D3D12_RESOURCE_DESC desc = {
+		.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+		.Width = sizeof(float),
+		.Height = 1,
+		.DepthOrArraySize = 1,
+		.MipLevels = 1,
+		.SampleDesc = rm->NO_AA,
+		.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+	};
 
+	HRESULT hr = rm->d3dDevice->CreateCommittedResource(&READBACK_HEAP, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&rm->exposureReadback));
+	checkHR(hr, nullptr, "Create exposure readback buffer");
+	rm->exposureReadback->SetName(L"Exposure Readback Buffer");
 };
 
 void ComputeStage::initRenderTarget() {
@@ -84,8 +63,27 @@ void ComputeStage::initRenderTarget() {
 	checkHR(hr, nullptr, "Create render target");
 	rm->renderTarget->SetName(L"Render Target");
 
-	rm->randPattern.resize(rm->width * rm->height);
+}
+
+void ComputeStage::initDenoiseTextures() {
 
+	// ping pong targets for the a-trous passes, rgb demodulated colour, a luminance variance
+	D3D12_RESOURCE_DESC denoiseDesc = {
+	   .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+	   .Width = rm->width,
+	   .Height = rm->height,
+	   .DepthOrArraySize = 1,
+	   .MipLevels = 1,
+	   .Format = DXGI_FORMAT_R32G32B32A32_FLOAT,
+	   .SampleDesc = rm->NO_AA,
+	   .Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS };
+
+	for (int i = 0; i < 2; i++) {
+		HRESULT hr = rm->d3dDevice->CreateCommittedResource(&DEFAULT_HEAP, D3D12_HEAP_FLAG_NONE, &denoiseDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&rm->denoiseTextures[i]));
+		checkHR(hr, nullptr, "Create denoise texture");
+	}
+	rm->denoiseTextures[0]->SetName(L"Denoise Texture A");
+	rm->denoiseTextures[1]->SetName(L"Denoise Texture B");
 }
 
 void ComputeStage::updateToneParams() {
@@ -97,6 +95,35 @@ void ComputeStage::updateToneParams() {
 	}
 
 	rm->toneMappingParams->numIts = rm->iterations;
+	rm->toneMappingParams->adaptiveSampling = config.adaptiveSampling ? 1u : 0u;
+	rm->toneMappingParams->adaptiveThreshold = config.adaptiveThreshold;
+	rm->toneMappingParams->adaptiveMinSamples = static_cast<UINT>(config.adaptiveMinSamples);
+	rm->toneMappingParams->heatmap = config.adaptiveHeatmap ? 1u : 0u;
+	rm->toneMappingParams->aovView = static_cast<UINT>(config.aovView);
+	rm->toneMappingParams->denoise = config.denoise ? 1u : 0u;
+	// a-trous passes while last frame's costs say they fit the budget, the first always runs. the tone map needs the
+	// count to know which ping pong texture ends up with the result
+	UINT iterations = static_cast<UINT>(std::clamp<int>(config.denoiseIterations, 0, ResourceManager::MAX_DENOISE_ITERATIONS));
+	UINT passes = 0;
+	float spentMs = 0.0f;
+	for (; passes < iterations; passes++) {
+		spentMs += rm->denoisePassMs[passes];
+		if (passes > 0 && config.denoiseBudgetMs > 0.0f && spentMs > config.denoiseBudgetMs) break;
+	}
+	rm->denoisePasses = config.denoise ? passes : 0;
+	rm->toneMappingParams->denoiseIterations = passes;
+	rm->toneMappingParams->sigmaNormal = config.sigmaNormal;
+	rm->toneMappingParams->sigmaDepth = config.sigmaDepth;
+	rm->toneMappingParams->sigmaLuminance = config.sigmaLuminance;
+	rm->toneMappingParams->internalWidth = rm->internalWidth;
+	rm->toneMappingParams->internalHeight = rm->internalHeight;
+	rm->toneMappingParams->exposure = config.exposure;
+	rm->toneMappingParams->autoExposure = config.autoExposure ? 1u : 0u;
+	rm->toneMappingParams->exposureLowPercentile = config.exposureLowPercentile;
+	rm->toneMappingParams->exposureHighPercentile = std::max(config.exposureHighPercentile, config.exposureLowPercentile);
+
+	// frame rate independent, the remaining distance to the target decays at exposureSpeed per second
+	rm->toneMappingParams->exposureAdaptation = rm->exposureAdapted ? 1.0f - std::exp(-config.exposureSpeed * UI::frameTime) : 1.0f;
 
 	if (!rm->toneMappingConstantBuffer) {
 
@@ -134,8 +161,8 @@ void ComputeStage::initComputeRootSignature() {
 		.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
 	};
 
-	// u1, maxLum
-	D3D12_DESCRIPTOR_RANGE maxLumRange = {
+	// u1, luminance histogram
+	D3D12_DESCRIPTOR_RANGE histogramRange = {
 		.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
 		.NumDescriptors = 1,
 		.BaseShaderRegister = 1,
@@ -143,6 +170,92 @@ void ComputeStage::initComputeRootSignature() {
 		.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
 	};
 
+	// u2, variance
+	D3D12_DESCRIPTOR_RANGE varianceRange = {
+		.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		.NumDescriptors = 1,
+		.BaseShaderRegister = 2,
+		.RegisterSpace = 0,
+		.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	// u3, tile mask
+	D3D12_DESCRIPTOR_RANGE tileMaskRange = {
+		.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		.NumDescriptors = 1,
+		.BaseShaderRegister = 3,
+		.RegisterSpace = 0,
+		.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	// u4, active tile counter
+	D3D12_DESCRIPTOR_RANGE counterRange = {
+		.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		.NumDescriptors = 1,
+		.BaseShaderRegister = 4,
+		.RegisterSpace = 0,
+		.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	// u5 - u7, first hit albedo, normal and depth
+	D3D12_DESCRIPTOR_RANGE albedoRange = {
+		.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		.NumDescriptors = 1,
+		.BaseShaderRegister = 5,
+		.RegisterSpace = 0,
+		.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	D3D12_DESCRIPTOR_RANGE normalRange = {
+		.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		.NumDescriptors = 1,
+		.BaseShaderRegister = 6,
+		.RegisterSpace = 0,
+		.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	D3D12_DESCRIPTOR_RANGE depthRange = {
+		.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		.NumDescriptors = 1,
+		.BaseShaderRegister = 7,
+		.RegisterSpace = 0,
+		.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	// u8 - u9, denoise ping pong
+	D3D12_DESCRIPTOR_RANGE denoiseARange = {
+		.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		.NumDescriptors = 1,
+		.BaseShaderRegister = 8,
+		.RegisterSpace = 0,
+		.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	D3D12_DESCRIPTOR_RANGE denoiseBRange = {
+		.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		.NumDescriptors = 1,
+		.BaseShaderRegister = 9,
+		.RegisterSpace = 0,
+		.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	// u10 - u11, first hit ids and motion
+	D3D12_DESCRIPTOR_RANGE idRange = {
+		.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		.NumDescriptors = 1,
+		.BaseShaderRegister = 10,
+		.RegisterSpace = 0,
+		.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	D3D12_DESCRIPTOR_RANGE motionRange = {
+		.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		.NumDescriptors = 1,
+		.BaseShaderRegister = 11,
+		.RegisterSpace = 0,
+		.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
 	// tone map params, cbv
 	D3D12_ROOT_PARAMETER toneParam = {};
 	toneParam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
@@ -150,17 +263,36 @@ void ComputeStage::initComputeRootSignature() {
 	toneParam.Descriptor.RegisterSpace = 0;
 	toneParam.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
 
-	D3D12_ROOT_PARAMETER params[4] = {
+	// stage index and a-trous step width, root constants so every dispatch in the command list sees its own value
+	D3D12_ROOT_PARAMETER stageParam = {};
+	stageParam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+	stageParam.Constants.ShaderRegister = 1;
+	stageParam.Constants.RegisterSpace = 0;
+	stageParam.Constants.Num32BitValues = 2;
+	stageParam.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+
+	D3D12_ROOT_PARAMETER params[15] = {
 		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &accumRange}},
 		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &rtRange}},
-		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &maxLumRange}},
+		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &histogramRange}},
 
 	};
 
 	params[3] = toneParam;
+	params[4] = { .ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &varianceRange} };
+	params[5] = { .ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &tileMaskRange} };
+	params[6] = { .ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &counterRange} };
+	params[7] = stageParam;
+	params[8] = { .ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &albedoRange} };
+	params[9] = { .ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &normalRange} };
+	params[10] = { .ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &depthRange} };
+	params[11] = { .ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &denoiseARange} };
+	params[12] = { .ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &denoiseBRange} };
+	params[13] = { .ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &idRange} };
+	params[14] = { .ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &motionRange} };
 
 	D3D12_ROOT_SIGNATURE_DESC desc = {
-		.NumParameters = 4,
+		.NumParameters = 15,
 		.pParameters = params,
 		.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE
 	};
@@ -192,12 +324,12 @@ void ComputeStage::initComputeDescriptors() {
 
 	std::cout << "initComputeDescriptors" << std::endl;
 
-	UINT numDescriptors = 4; // SRV accumulationTexture, UAV renderTarget, UAV maxLum, CBV params
+	UINT numDescriptors = 14; // SRV accumulationTexture, UAV renderTarget, UAV histogram, CBV params, UAV variance, UAV tile mask, UAV counter, 3 UAV AOVs, 2 UAV denoise, 2 UAV AOVs
 	descriptorIncrementSize = rm->d3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
 	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {
 	.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
-	.NumDescriptors = 4,
+	.NumDescriptors = numDescriptors,
 	.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE
 	};
 
@@ -209,7 +341,7 @@ void ComputeStage::initComputeDescriptors() {
 
 	// slot 0 SRV for accumulationTexture
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	srvDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
 	srvDesc.Texture2D.MipLevels = 1;
@@ -224,13 +356,12 @@ void ComputeStage::initComputeDescriptors() {
 	rm->d3dDevice->CreateUnorderedAccessView(rm->renderTarget, nullptr, &uavDesc, cpuHandle);
 	cpuHandle.ptr += descriptorIncrementSize;
 
-	// slot 2 UAV for maxLumBuffer
+	// slot 2 UAV for histogramBuffer, typed so the bins take atomics
 	uavDesc = {};
-	uavDesc.Format = DXGI_FORMAT_UNKNOWN,
-	uavDesc.Buffer.StructureByteStride = sizeof(UINT),
-	uavDesc.Buffer.NumElements = 1;
+	uavDesc.Format = DXGI_FORMAT_R32_UINT,
+	uavDesc.Buffer.NumElements = ResourceManager::HISTOGRAM_BINS + 1;
 	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER,
-	rm->d3dDevice->CreateUnorderedAccessView(rm->maxLumBuffer->defaultBuffers, nullptr, &uavDesc, cpuHandle);
+	rm->d3dDevice->CreateUnorderedAccessView(rm->histogramBuffer->defaultBuffers, nullptr, &uavDesc, cpuHandle);
 	cpuHandle.ptr += descriptorIncrementSize;
 
 	// CBV post processing params
@@ -240,6 +371,57 @@ void ComputeStage::initComputeDescriptors() {
 	rm->d3dDevice->CreateConstantBufferView(&cbvDesc, cpuHandle);
 	cpuHandle.ptr += descriptorIncrementSize;
 
+	// slot 4 UAV for variance texture
+	uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->varianceTexture, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	// slot 5 UAV for tile mask
+	uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_UINT;
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.NumElements = rm->numTiles;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->tileMaskBuffer->defaultBuffers, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	// slot 6 UAV for active tile counter
+	uavDesc.Buffer.NumElements = 1;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->adaptiveCounterBuffer->defaultBuffers, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	// slot 7 - 9 UAV for the albedo, normal and depth AOVs
+	uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->albedoTexture, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	rm->d3dDevice->CreateUnorderedAccessView(rm->normalTexture, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->depthTexture, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	// slot 10 - 11 UAV for the denoise ping pong
+	uavDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->denoiseTextures[0], nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	rm->d3dDevice->CreateUnorderedAccessView(rm->denoiseTextures[1], nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	// slot 12 - 13 UAV for the id and motion AOVs
+	uavDesc.Format = DXGI_FORMAT_R32_UINT;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->idTexture, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	uavDesc.Format = DXGI_FORMAT_R16G16_FLOAT;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->motionTexture, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
 }
 
 
@@ -264,23 +446,122 @@ void ComputeStage::postProcess() {
 	gpuHandle.ptr += descriptorIncrementSize;
 	rm->cmdList->SetComputeRootDescriptorTable(2, gpuHandle); // u1
 
-	rm->cmdList->SetComputeRootConstantBufferView(3, rm->toneMappingConstantBuffer->defaultBuffers->GetGPUVirtualAddress()); // maxLum, etc
+	rm->cmdList->SetComputeRootConstantBufferView(3, rm->toneMappingConstantBuffer->defaultBuffers->GetGPUVirtualAddress()); // exposure, etc
+	gpuHandle.ptr += descriptorIncrementSize * 2; // skip the CBV slot, bound as a root CBV
+	rm->cmdList->SetComputeRootDescriptorTable(4, gpuHandle); // u2 variance
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(5, gpuHandle); // u3 tile mask
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(6, gpuHandle); // u4 active tiles
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(8, gpuHandle); // u5 albedo
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(9, gpuHandle); // u6 normal
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(10, gpuHandle); // u7 depth
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(11, gpuHandle); // u8 denoise A
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(12, gpuHandle); // u9 denoise B
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(13, gpuHandle); // u10 ids
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(14, gpuHandle); // u11 motion
+
+	updateToneParams();
 
 	// start compute shader
 
 	UINT groupsX = (rm->renderTarget->GetDesc().Width + 15) / 16;
 	UINT groupsY = (rm->renderTarget->GetDesc().Height + 15) / 16;
 
-	rm->toneMappingParams->stage = 0; // max Luminance
-	updateToneParams();
+	// everything before the tone map only covers the traced region
+	UINT internalGroupsX = (rm->internalWidth + 15) / 16;
+	UINT internalGroupsY = (rm->internalHeight + 15) / 16;
 
-	rm->cmdList->Dispatch(groupsX, groupsY, 1);
+	if (config.adaptiveSampling) {
 
-	rm->toneMappingParams->stage  = 1; // tone Map
-	updateToneParams();
+		// one group per tile, the count is read back before the next frame is traced
+		pushBuffer(rm->adaptiveCounterBuffer, sizeof(UINT), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+		rm->cmdList->SetComputeRoot32BitConstant(7, 2, 0); // adaptive tiles
+		rm->cmdList->Dispatch(internalGroupsX, internalGroupsY, 1);
+		uavBarrier(nullptr);
+
+		D3D12_RESOURCE_BARRIER barrier = {};
+		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		barrier.Transition.pResource = rm->adaptiveCounterBuffer->defaultBuffers;
+		barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
+		rm->cmdList->ResourceBarrier(1, &barrier);
+
+		rm->cmdList->CopyBufferRegion(rm->adaptiveReadback, 0, rm->adaptiveCounterBuffer->defaultBuffers, 0, sizeof(UINT));
+
+		barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_SOURCE;
+		barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		rm->cmdList->ResourceBarrier(1, &barrier);
+	}
+
+	if (config.denoise) {
+
+		// demodulate, then a-trous passes with the step width doubling, ping ponging between A and B
+		rm->cmdList->SetComputeRoot32BitConstant(7, 3, 0); // denoise prepare
+		rm->cmdList->Dispatch(internalGroupsX, internalGroupsY, 1);
+		uavBarrier(nullptr);
+		rm->cmdList->EndQuery(rm->timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, ResourceManager::DENOISE_QUERY);
+
+		// as many passes as updateToneParams found room for in the budget
+		for (UINT i = 0; i < rm->denoisePasses; i++) {
+			rm->cmdList->SetComputeRoot32BitConstant(7, 4, 0); // a-trous
+			rm->cmdList->SetComputeRoot32BitConstant(7, 1u << i, 1);
+			rm->cmdList->Dispatch(internalGroupsX, internalGroupsY, 1);
+			uavBarrier(nullptr);
+			rm->cmdList->EndQuery(rm->timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, ResourceManager::DENOISE_QUERY + 1 + i);
+		}
+		rm->cmdList->ResolveQueryData(rm->timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, ResourceManager::DENOISE_QUERY, rm->denoisePasses + 1,
+			rm->timestampReadback, ResourceManager::DENOISE_QUERY * sizeof(UINT64));
+	}
+
+	if (config.autoExposure) {
+
+		rm->cmdList->SetComputeRoot32BitConstant(7, 0, 0); // luminance histogram
+		rm->cmdList->Dispatch(internalGroupsX, internalGroupsY, 1);
+		uavBarrier(nullptr);
+
+		rm->cmdList->SetComputeRoot32BitConstant(7, 5, 0); // adapt exposure
+		rm->cmdList->Dispatch(1, 1, 1);
+		uavBarrier(nullptr);
+
+		D3D12_RESOURCE_BARRIER barrier = {};
+		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		barrier.Transition.pResource = rm->histogramBuffer->defaultBuffers;
+		barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
+		rm->cmdList->ResourceBarrier(1, &barrier);
+
+		rm->cmdList->CopyBufferRegion(rm->exposureReadback, 0, rm->histogramBuffer->defaultBuffers, ResourceManager::HISTOGRAM_BINS * sizeof(UINT), sizeof(float));
 
+		barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_SOURCE;
+		barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		rm->cmdList->ResourceBarrier(1, &barrier);
+
+		rm->exposureAdapted = true;
+	}
+	else {
+		rm->exposureAdapted = false;
+	}
+
+	rm->cmdList->SetComputeRoot32BitConstant(7, 1, 0); // tone Map
 	rm->cmdList->Dispatch(groupsX, groupsY, 1);
 
+	if (rm->accumulationReadbackRequested) {
+		copyAccumulation();
+	}
+
+	if (rm->varianceReadbackRequested) {
+		copyVariance();
+	}
+
 	// transition accumulation texture from SRV TO UAV for next frame
 	D3D12_RESOURCE_BARRIER barrier = {};
 	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
@@ -291,6 +572,153 @@ void ComputeStage::postProcess() {
 
 }
 
+void ComputeStage::copyAccumulation() {
+	copyTexture(rm->accumulationTexture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, rm->accumulationReadback, rm->accumulationFootprint);
+}
+
+void ComputeStage::copyVariance() {
+	copyTexture(rm->varianceTexture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, rm->varianceReadback, rm->varianceFootprint);
+}
+
+void ComputeStage::copyTexture(ID3D12Resource* texture, D3D12_RESOURCE_STATES state, ID3D12Resource*& readback, D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint) {
+
+	D3D12_RESOURCE_DESC texDesc = texture->GetDesc();
+
+	if (!readback) {
+
+		UINT64 totalBytes = 0;
+		rm->d3dDevice->GetCopyableFootprints(&texDesc, 0, 1, 0, &footprint, nullptr, nullptr, &totalBytes);
+
+		D3D12_RESOURCE_DESC desc = {
+			.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+			.Width = totalBytes,
+			.Height = 1,
+			.DepthOrArraySize = 1,
+			.MipLevels = 1,
+			.SampleDesc = rm->NO_AA,
+			.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+		};
+
+		HRESULT hr = rm->d3dDevice->CreateCommittedResource(&READBACK_HEAP, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&readback));
+		checkHR(hr, nullptr, "Create readback buffer");
+		readback->SetName(L"Readback Buffer");
+	}
+
+	D3D12_RESOURCE_BARRIER barrier = {};
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+	barrier.Transition.pResource = texture;
+	barrier.Transition.StateBefore = state;
+	barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
+	rm->cmdList->ResourceBarrier(1, &barrier);
+
+	D3D12_TEXTURE_COPY_LOCATION dst = {};
+	dst.pResource = readback;
+	dst.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+	dst.PlacedFootprint = footprint;
+
+	D3D12_TEXTURE_COPY_LOCATION src = {};
+	src.pResource = texture;
+	src.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+	src.SubresourceIndex = 0;
+
+	rm->cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+
+	barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_SOURCE;
+	barrier.Transition.StateAfter = state;
+	rm->cmdList->ResourceBarrier(1, &barrier);
+}
+
+void ComputeStage::readAccumulation(std::vector<float>& pixels) {
+	readTexture(rm->accumulationReadback, rm->accumulationFootprint, 4, pixels);
+	rm->accumulationReadbackRequested = false;
+}
+
+void ComputeStage::readAccumulation(float* pixels) {
+	readTexture(rm->accumulationReadback, rm->accumulationFootprint, 4, pixels);
+	rm->accumulationReadbackRequested = false;
+}
+
+void ComputeStage::readVariance(std::vector<float>& pixels) {
+	readTexture(rm->varianceReadback, rm->varianceFootprint, 2, pixels);
+	rm->varianceReadbackRequested = false;
+}
+
+void ComputeStage::readTexture(ID3D12Resource* readback, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, UINT channels, std::vector<float>& pixels) {
+	pixels.resize(static_cast<size_t>(footprint.Footprint.Width) * footprint.Footprint.Height * channels);
+	readTexture(readback, footprint, channels, pixels.data());
+}
+
+void ComputeStage::readTexture(ID3D12Resource* readback, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, UINT channels, float* pixels) {
+
+	// only valid once the frame that requested the copy has been presented
+	UINT width = footprint.Footprint.Width;
+	UINT height = footprint.Footprint.Height;
+	UINT rowPitch = footprint.Footprint.RowPitch;
+
+	void* mapped = nullptr;
+	D3D12_RANGE readRange = { 0, static_cast<SIZE_T>(rowPitch) * height };
+	readback->Map(0, &readRange, &mapped);
+
+	for (UINT y = 0; y < height; y++) {
+		const uint8_t* row = static_cast<const uint8_t*>(mapped) + static_cast<size_t>(y) * rowPitch;
+		memcpy(pixels + static_cast<size_t>(y) * width * channels, row, width * channels * sizeof(float));
+	}
+
+	D3D12_RANGE writeRange = { 0, 0 };
+	readback->Unmap(0, &writeRange);
+}
+
+
+void ComputeStage::readTexture(ID3D12Resource* readback, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, UINT bytesPerPixel, std::vector<uint8_t>& pixels) {
+
+	UINT width = footprint.Footprint.Width;
+	UINT height = footprint.Footprint.Height;
+	UINT rowPitch = footprint.Footprint.RowPitch;
+	size_t rowBytes = static_cast<size_t>(width) * bytesPerPixel;
+
+	pixels.resize(rowBytes * height);
+
+	void* mapped = nullptr;
+	D3D12_RANGE readRange = { 0, static_cast<SIZE_T>(rowPitch) * height };
+	readback->Map(0, &readRange, &mapped);
+
+	for (UINT y = 0; y < height; y++) {
+		memcpy(pixels.data() + y * rowBytes, static_cast<const uint8_t*>(mapped) + static_cast<size_t>(y) * rowPitch, rowBytes);
+	}
+
+	D3D12_RANGE writeRange = { 0, 0 };
+	readback->Unmap(0, &writeRange);
+}
+
+void ComputeStage::readAdaptiveStats() {
+
+	// previous frame has been flushed by present, the copy is complete
+	void* mapped = nullptr;
+	D3D12_RANGE readRange = { 0, sizeof(UINT) };
+	rm->adaptiveReadback->Map(0, &readRange, &mapped);
+	rm->activeTiles = *static_cast<UINT*>(mapped);
+	D3D12_RANGE writeRange = { 0, 0 };
+	rm->adaptiveReadback->Unmap(0, &writeRange);
+}
+
+void ComputeStage::readExposure() {
+
+	// previous frame has been flushed by present, the copy is complete
+	void* mapped = nullptr;
+	D3D12_RANGE readRange = { 0, sizeof(float) };
+	rm->exposureReadback->Map(0, &readRange, &mapped);
+	rm->exposureEV = *static_cast<float*>(mapped);
+	D3D12_RANGE writeRange = { 0, 0 };
+	rm->exposureReadback->Unmap(0, &writeRange);
+}
+
+void ComputeStage::uavBarrier(ID3D12Resource* resource) {
+
+	D3D12_RESOURCE_BARRIER barrier = {};
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+	barrier.UAV.pResource = resource;
+	rm->cmdList->ResourceBarrier(1, &barrier);
+}
 
 ResourceManager::Buffer* ComputeStage::createBuffers(const void* data, size_t byteSize, D3D12_RESOURCE_STATES finalState, bool UAV) {
 std::cout << "byteSize: " << byteSize << std::endl;
@@ -13,7 +13,12 @@ class ComputeStage {
 public:
 
 	ComputeStage(ResourceManager* resourceManager, MeshManager* meshManager, MaterialManager* materialManager, EntityManager* entityManager);
-	~ComputeStage() {};
+	~ComputeStage() {
+		if (computePSO) computePSO->Release();
+		if (computeRootSignature) computeRootSignature->Release();
+		if (computeDescHeap) computeDescHeap->Release();
+		if (csBlob) csBlob->Release();
+	};
 
 	void loadShaders();
 	void initComputeRootSignature();
@@ -22,12 +27,24 @@ public:
 
 
 	void initStage();
-	void initMaxLumBuffer();
+	void initHistogramBuffer();
 	void initRenderTarget();
-	void updateRand();
+	void initDenoiseTextures();
 	void updateToneParams();
+	void readAdaptiveStats();
+	void readExposure(); // adapted exposure of the previous frame into rm->exposureEV
 
 	void postProcess();
+	void copyAccumulation();
+	void copyVariance();
+	void copyTexture(ID3D12Resource* texture, D3D12_RESOURCE_STATES state, ID3D12Resource*& readback, D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint);
+	void readAccumulation(std::vector<float>& pixels); // rgb sum and sample count per pixel
+	void readAccumulation(float* pixels); // same, into width * height * 4 floats the caller owns
+	void readVariance(std::vector<float>& pixels); // luminance mean and M2 per pixel
+	void readTexture(ID3D12Resource* readback, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, UINT channels, std::vector<float>& pixels);
+	void readTexture(ID3D12Resource* readback, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, UINT channels, float* pixels);
+	void readTexture(ID3D12Resource* readback, const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, UINT bytesPerPixel, std::vector<uint8_t>& pixels);
+	void uavBarrier(ID3D12Resource* resource);
 
 	void checkHR(HRESULT hr, ID3DBlob* errorblob, std::string context);
 	void flush();
@@ -37,14 +54,14 @@ public:
 	void pushBuffer(ResourceManager::Buffer* buffer, size_t dataSize, D3D12_RESOURCE_STATES state_before, D3D12_RESOURCE_STATES state_after);
 
 	// Compute root signature and ray tracing pso
-	ID3D12RootSignature* computeRootSignature;
-	ID3D12PipelineState* computePSO;
-	ID3D12DescriptorHeap* computeDescHeap;
+	ID3D12RootSignature* computeRootSignature = nullptr;
+	ID3D12PipelineState* computePSO = nullptr;
+	ID3D12DescriptorHeap* computeDescHeap = nullptr;
 
 	UINT descriptorIncrementSize;
 
 	// shader loading
-	ID3DBlob* csBlob;
+	ID3DBlob* csBlob = nullptr;
 
 	ResourceManager* rm;
 	MeshManager* meshManager;
@@ -54,4 +71,5 @@ public:
 	// heap management
 	D3D12_HEAP_PROPERTIES UPLOAD_HEAP = { .Type = D3D12_HEAP_TYPE_UPLOAD };
 	D3D12_HEAP_PROPERTIES DEFAULT_HEAP = { .Type = D3D12_HEAP_TYPE_DEFAULT };
+	D3D12_HEAP_PROPERTIES READBACK_HEAP = { .Type = D3D12_HEAP_TYPE_READBACK };
 };
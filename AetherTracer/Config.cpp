@@ -1,3 +1,136 @@
 #include "Config.h"
 
-Config config;
\ No newline at end of file
+#include <iostream>
+
+Config config;
+
+void parseArguments(Config& config, int argc, char* argv[]) {
+
+	for (int i = 1; i < argc; i++) {
+
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--time-budget" && hasValue) {
+			config.timeBudget = true;
+			config.targetFrameTime = std::stof(argv[++i]);
+		}
+		else if (arg == "--deadline" && hasValue) {
+			config.renderDeadline = std::stof(argv[++i]);
+			config.quitWhenFinished = true;
+		}
+		else if (arg == "--samples" && hasValue) {
+			config.sampleTarget = std::stoi(argv[++i]);
+			config.quitWhenFinished = true;
+		}
+		else if (arg == "--scene" && hasValue) {
+			config.scene = argv[++i];
+		}
+		else if (arg == "--deterministic") {
+			config.deterministic = true;
+		}
+		else if (arg == "--output" && hasValue) {
+			config.outputPath = argv[++i];
+		}
+		else if (arg == "--snapshot-path" && hasValue) {
+			config.snapshotPath = argv[++i];
+		}
+		else if (arg == "--checkpoint" && hasValue) {
+			config.checkpointInterval = std::stof(argv[++i]);
+		}
+		else if (arg == "--checkpoint-path" && hasValue) {
+			config.checkpointPath = argv[++i];
+		}
+		else if (arg == "--resume") {
+			// path is optional, defaults to wherever checkpoints are written
+			config.resume = true;
+			if (hasValue && std::string(argv[i + 1]).rfind("--", 0) != 0) config.resumePath = argv[++i];
+		}
+		else if (arg == "--shared-frames") {
+			// name is optional
+			config.sharedFrames = true;
+			if (hasValue && std::string(argv[i + 1]).rfind("--", 0) != 0) config.sharedFrameName = argv[++i];
+		}
+		else if (arg == "--shared-frame-interval" && hasValue) {
+			config.sharedFrameInterval = std::stof(argv[++i]);
+		}
+		else if (arg == "--shared-frames-max" && hasValue) {
+			// WIDTHxHEIGHT, viewers keep the mapping open so it can't grow with the window
+			std::string size = argv[++i];
+			size_t x = size.find('x');
+			if (x != std::string::npos) {
+				config.sharedFrameMaxWidth = static_cast<uint32_t>(std::stoul(size.substr(0, x)));
+				config.sharedFrameMaxHeight = static_cast<uint32_t>(std::stoul(size.substr(x + 1)));
+			}
+			else {
+				std::cerr << "--shared-frames-max expects WIDTHxHEIGHT, got " << size << std::endl;
+			}
+		}
+		else if (arg == "--batch" && hasValue) {
+			config.batchPath = argv[++i];
+			config.headless = true;
+		}
+		else if (arg == "--animation" && hasValue) {
+			config.animationPath = argv[++i];
+			config.headless = true;
+		}
+		else if (arg == "--tiled" && hasValue) {
+			// WIDTHxHEIGHT
+			std::string size = argv[++i];
+			size_t x = size.find('x');
+			if (x != std::string::npos) {
+				config.tiledWidth = static_cast<uint32_t>(std::stoul(size.substr(0, x)));
+				config.tiledHeight = static_cast<uint32_t>(std::stoul(size.substr(x + 1)));
+				config.headless = true;
+			}
+			else {
+				std::cerr << "--tiled expects WIDTHxHEIGHT, got " << size << std::endl;
+			}
+		}
+		else if (arg == "--tile" && hasValue) {
+			config.tileSize = std::stoi(argv[++i]);
+		}
+		else if (arg == "--texture-cache" && hasValue) {
+			config.textureCacheMB = std::stoi(argv[++i]);
+		}
+		else if (arg == "--compress-textures") {
+			config.compressTextures = true;
+		}
+		else if (arg == "--bake-textures") {
+			config.bakeTextures = true;
+		}
+		else if (arg == "--auto-exposure") {
+			config.autoExposure = true;
+		}
+		else if (arg == "--headless") {
+			config.headless = true;
+		}
+		else if (arg == "--coordinator" && hasValue) {
+			config.coordinatorAddress = argv[++i];
+		}
+		else if (arg == "--worker" && hasValue) {
+			config.workerAddress = argv[++i];
+		}
+		else if (arg == "--chunk" && hasValue) {
+			config.distributedChunk = std::stoi(argv[++i]);
+		}
+		else if (arg == "--stream" && hasValue) {
+			config.streamAddress = argv[++i];
+		}
+		else if (arg == "--viewer" && hasValue) {
+			config.viewerAddress = argv[++i];
+		}
+		else if (arg == "--stream-interval" && hasValue) {
+			config.streamInterval = std::stof(argv[++i]);
+		}
+		else if (arg == "--stream-threshold" && hasValue) {
+			config.streamThreshold = std::stoi(argv[++i]);
+		}
+		else if (arg == "--stream-quantization" && hasValue) {
+			config.streamQuantization = std::stoi(argv[++i]);
+		}
+		else {
+			std::cerr << "Unknown argument: " << arg << std::endl;
+		}
+	}
+}
@@ -1,6 +1,31 @@
 #pragma once
 
 #include <cstdint>
+#include <string>
+
+enum SamplerType : int {
+    SAMPLER_RANDOM = 0,
+    SAMPLER_SOBOL = 1, // Owen scrambled
+    SAMPLER_BLUE_NOISE = 2
+};
+
+enum AOVFlags : uint32_t {
+    AOV_ALBEDO = 1 << 0,
+    AOV_NORMAL = 1 << 1,
+    AOV_DEPTH = 1 << 2,
+    AOV_IDS = 1 << 3, // instance and material index
+    AOV_MOTION = 1 << 4
+};
+
+enum AOVView : int {
+    AOV_VIEW_BEAUTY = 0,
+    AOV_VIEW_ALBEDO = 1,
+    AOV_VIEW_NORMAL = 2,
+    AOV_VIEW_DEPTH = 3,
+    AOV_VIEW_INSTANCE_ID = 4,
+    AOV_VIEW_MATERIAL_ID = 5,
+    AOV_VIEW_MOTION = 6
+};
 
 struct Config {
 
@@ -8,10 +33,11 @@ struct Config {
 
     uint32_t resX = 3440;
     uint32_t resY = 1440;
-    uint32_t internal_resX = 0;
+    uint32_t internal_resX = 0; // lowest internal resolution dynamic resolution drops to, 0 = half the output
     uint32_t internal_resY = 0;
     float aspectX = 21;
     float aspectY = 9;
+    std::string scene = "default"; // entity layout, "backlit" has single sided emitters lit from behind to compare light sampling on and off
 
     // Multiple Importance Sampling
     int raysPerPixel = 1;
@@ -19,6 +45,92 @@ struct Config {
     int maxBounces = 50;
     bool accumulate = true;
     bool jitter = true;
+    bool lightSampling = true; // next event estimation through the light BVH
+    int sampler = SAMPLER_SOBOL;
+
+    // Adaptive sampling
+    bool adaptiveSampling = false;
+    float adaptiveThreshold = 0.02f; // relative standard error of the pixel mean
+    int adaptiveMinSamples = 32;
+    int adaptiveMaxBoost = 8; // max multiple of raysPerPixel given to the remaining tiles
+    bool adaptiveHeatmap = false;
+
+    // AOVs, first hit data, nothing is written for the ones that are off
+    bool aovAlbedo = false;
+    bool aovNormal = false;
+    bool aovDepth = false;
+    bool aovIDs = false;
+    bool aovMotion = false;
+    int aovView = AOV_VIEW_BEAUTY; // shown instead of the tone mapped image
+
+    // Temporal reprojection
+    bool temporalReprojection = true; // camera moves warp the accumulation instead of clearing it
+    int maxHistory = 16; // samples a reprojected pixel keeps, lower reacts faster to lighting it could not see before
+    float historyDepthTolerance = 0.05f; // relative depth difference still treated as the same surface
+
+    // Dynamic resolution
+    bool dynamicResolution = false; // trace below native while the camera moves, sized to the target frame time
+    int resolutionSettleFrames = 4; // still frames before going back to native and accumulating
+
+    // Denoiser
+    bool denoise = false;
+    int denoiseIterations = 5; // a-trous passes, step width doubles each pass
+    float denoiseBudgetMs = 0.0f; // gpu time for the a-trous passes, later passes are skipped past it. 0 runs them all
+    float sigmaNormal = 128.0f;
+    float sigmaDepth = 1.0f;
+    float sigmaLuminance = 4.0f;
+
+    // Progressive rendering
+    bool timeBudget = false; // sample passes per frame follow the measured pass cost
+    float targetFrameTime = 16.0f; // ms
+    int maxPassesPerFrame = 64;
+    float renderDeadline = 0.0f; // seconds after accumulation starts, 0 = none. the final image is written when it passes
+    int sampleTarget = 0; // stop accumulating at this many samples per pixel and write the final image, 0 = none
+    bool quitWhenFinished = false; // set by the command line, quit after the deadline or sample target
+    std::string outputPath = "renders/final.png"; // .exr or .pfm writes the linear accumulation instead of the tone mapped image
+    std::string snapshotPath = "renders/snapshot.exr"; // F12, the sample count is added to the name, extension picks the format
+
+    // Deterministic
+    bool deterministic = false; // fixed seeds, the accumulation only depends on the samples per pixel
+
+    // Checkpointing
+    float checkpointInterval = 0.0f; // seconds between accumulation snapshots, 0 = off
+    std::string checkpointPath = "renders/checkpoint.aetc";
+    bool resume = false; // continue from a checkpoint at startup
+    std::string resumePath; // empty = checkpointPath
+
+    // Shared frames
+    bool sharedFrames = false; // publish converging frames to named shared memory for external viewers
+    std::string sharedFrameName = "AetherTracerFrames";
+    float sharedFrameInterval = 0.1f; // seconds between published frames
+    uint32_t sharedFrameMaxWidth = 0; // largest frame the mapping holds, 0 = the window size at startup
+    uint32_t sharedFrameMaxHeight = 0;
+
+    // Batch rendering
+    std::string batchPath; // job file, one shot per line, rendered headless into renders/
+    bool headless = false; // hidden window, no UI
+    std::string animationPath; // keyframe file, every frame is rendered headless to numbered images
+    uint32_t tiledWidth = 0; // output rendered tile by tile and streamed to outputPath, 0 = off
+    uint32_t tiledHeight = 0;
+    int tileSize = 1024; // square, sets the size of every GPU texture in a tiled render
+
+    // Textures
+    int textureCacheMB = 0; // page budget for textures streamed from disk, 0 = every texture loaded whole
+    bool compressTextures = false; // keep the BC baked textures from assets/textures/cache instead of rgba8
+    bool bakeTextures = false; // bake every material texture into the cache and exit
+
+    // Distributed rendering
+    std::string coordinatorAddress; // "port" or "unix:path", render the sample target on workers and write the sum
+    std::string workerAddress; // "host:port" or "unix:path" of the coordinator to take jobs from
+    int distributedChunk = 16; // samples per job
+    float workerTimeout = 120.0f; // seconds without a result before a worker's job is handed to another
+
+    // Preview streaming
+    std::string streamAddress; // "port" or "unix:path", stream the preview to a viewer and take its camera input
+    std::string viewerAddress; // "host:port" or "unix:path" of a streaming renderer, run as the viewer only
+    float streamInterval = 0.05f; // seconds between streamed frames
+    int streamThreshold = 4; // largest change in a tile, out of 255, that isn't sent
+    int streamQuantization = 2; // low bits dropped from every channel, 0-7
 
     // other
     float fOV = 45;
@@ -27,6 +139,10 @@ struct Config {
     float focalDistance = 15.0f;
  
     float exposure = 1;
+    bool autoExposure = false; // exposure from a log luminance histogram every frame, exposure then compensates
+    float exposureLowPercentile = 0.5f; // histogram range averaged for the exposure
+    float exposureHighPercentile = 0.95f;
+    float exposureSpeed = 1.5f; // adaptation rate per second
     bool sky = false;
     float skyBrightness = 1.0f;
 
@@ -37,4 +153,6 @@ struct Config {
     int maxBouncesMax = 100;
 };
 
+void parseArguments(Config& config, int argc, char* argv[]);
+
 extern Config config;
\ No newline at end of file
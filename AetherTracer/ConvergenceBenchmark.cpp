@@ -0,0 +1,233 @@
+#include "ConvergenceBenchmark.h"
+
+#include "DX12Renderer.h"
+#include "ImageWriter.h"
+#include "UI.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+static const char* samplerNames[] = { "random", "sobol", "blue noise" };
+
+void ConvergenceBenchmark::start() {
+
+	if (running) return;
+
+	std::cout << "Convergence benchmark: " << referenceSamples << " spp reference, up to " << maxSamples << " spp per sampler" << std::endl;
+
+	savedConfig = config;
+
+	// one fixed sample count per pixel, no other source of variance in the measurement
+	config.accumulate = true;
+	config.adaptiveSampling = false;
+	config.adaptiveHeatmap = false;
+
+	sampleCounts.clear();
+	for (uint32_t spp = 1; spp <= maxSamples; spp *= 2) {
+		sampleCounts.push_back(spp);
+	}
+
+	for (std::vector<double>& result : results) {
+		result.clear();
+	}
+
+	comparingLightSampling = false;
+	running = true;
+	beginPhase(REFERENCE);
+}
+
+void ConvergenceBenchmark::startLightSampling() {
+
+	if (running) return;
+
+	std::cout << "Light sampling comparison: " << referenceSamples << " spp with light sampling off, then on" << std::endl;
+
+	savedConfig = config;
+
+	config.accumulate = true;
+	config.adaptiveSampling = false;
+	config.adaptiveHeatmap = false;
+
+	comparingLightSampling = true;
+	running = true;
+	beginPhase(REFERENCE);
+}
+
+void ConvergenceBenchmark::beginPhase(int sampler) {
+
+	phase = sampler;
+	samples = 0;
+
+	// same sampler and sample count for both renders, only the estimator changes
+	if (comparingLightSampling) {
+		config.sampler = SAMPLER_RANDOM;
+		config.raysPerPixel = REFERENCE_SAMPLES_PER_FRAME;
+		config.lightSampling = phase != REFERENCE;
+		return;
+	}
+
+	// the reference uses independent random numbers, so none of the low discrepancy samplers are favoured
+	config.sampler = phase == REFERENCE ? SAMPLER_RANDOM : phase;
+	config.raysPerPixel = phase == REFERENCE ? REFERENCE_SAMPLES_PER_FRAME : 1;
+}
+
+void ConvergenceBenchmark::update() {
+
+	if (!running) return;
+
+	// restart accumulation at the start of every phase
+	if (samples == 0) UI::accumulationUpdate = true;
+
+	uint32_t nextSamples = samples + config.raysPerPixel;
+
+	bool measure = false;
+	if (phase == REFERENCE || comparingLightSampling) {
+		measure = nextSamples >= referenceSamples;
+	}
+	else {
+		measure = (nextSamples & (nextSamples - 1)) == 0; // power of two
+	}
+
+	readbackPending = measure;
+	dx12Renderer->rm->accumulationReadbackRequested = measure;
+}
+
+void ConvergenceBenchmark::collect() {
+
+	if (!running) return;
+
+	samples += dx12Renderer->rm->samplePasses;
+
+	if (!readbackPending) return;
+	readbackPending = false;
+
+	dx12Renderer->computeStage->readAccumulation(accumulation);
+
+	if (phase == REFERENCE) {
+
+		size_t numPixels = accumulation.size() / 4;
+		reference.resize(numPixels * 3);
+
+		for (size_t i = 0; i < numPixels; i++) {
+			float n = std::max(accumulation[i * 4 + 3], 1.0f);
+			reference[i * 3 + 0] = accumulation[i * 4 + 0] / n;
+			reference[i * 3 + 1] = accumulation[i * 4 + 1] / n;
+			reference[i * 3 + 2] = accumulation[i * 4 + 2] / n;
+		}
+
+		if (comparingLightSampling) {
+			writeRender("_off");
+			std::cout << "Light sampling comparison: off done, mean radiance " << meanRadiance(accumulation) << std::endl;
+		}
+		else {
+			std::cout << "Convergence benchmark: reference done" << std::endl;
+		}
+		beginPhase(0);
+		return;
+	}
+
+	if (comparingLightSampling) {
+		writeRender("_on");
+		std::cout << "Light sampling comparison: on done, mean radiance " << meanRadiance(accumulation) << ", RMSE against off " << rmse(accumulation) << std::endl;
+
+		config = savedConfig;
+		UI::accumulationUpdate = true;
+		running = false;
+		return;
+	}
+
+	double error = rmse(accumulation);
+	results[phase].push_back(error);
+
+	std::cout << "Convergence benchmark: " << samplerNames[phase] << " " << samples << " spp, RMSE " << error << std::endl;
+
+	if (samples < maxSamples) return;
+
+	if (phase + 1 < NUM_SAMPLERS) {
+		beginPhase(phase + 1);
+		return;
+	}
+
+	writeResults();
+
+	config = savedConfig;
+	UI::accumulationUpdate = true;
+	running = false;
+}
+
+double ConvergenceBenchmark::rmse(const std::vector<float>& accumulation) const {
+
+	size_t numPixels = std::min(accumulation.size() / 4, reference.size() / 3);
+	if (numPixels == 0) return 0.0;
+
+	double sum = 0.0;
+	for (size_t i = 0; i < numPixels; i++) {
+		float n = std::max(accumulation[i * 4 + 3], 1.0f);
+		for (int c = 0; c < 3; c++) {
+			double diff = static_cast<double>(accumulation[i * 4 + c] / n) - reference[i * 3 + c];
+			sum += diff * diff;
+		}
+	}
+
+	return std::sqrt(sum / static_cast<double>(numPixels * 3));
+}
+
+// over all pixels and channels, a bias between two estimators shows up here long before it does in the RMSE
+double ConvergenceBenchmark::meanRadiance(const std::vector<float>& accumulation) const {
+
+	size_t numPixels = accumulation.size() / 4;
+	if (numPixels == 0) return 0.0;
+
+	double sum = 0.0;
+	for (size_t i = 0; i < numPixels; i++) {
+		float n = std::max(accumulation[i * 4 + 3], 1.0f);
+		sum += static_cast<double>(accumulation[i * 4 + 0] + accumulation[i * 4 + 1] + accumulation[i * 4 + 2]) / n;
+	}
+
+	return sum / static_cast<double>(numPixels * 3);
+}
+
+void ConvergenceBenchmark::writeRender(const std::string& suffix) const {
+
+	std::filesystem::path path = lightSamplingPath;
+	path.replace_filename(path.stem().string() + suffix + path.extension().string());
+
+	ResourceManager* rm = dx12Renderer->rm;
+	if (ImageWriter::writeAccumulation(path.string(), rm->width, rm->height, accumulation, dx12Renderer->exposure())) {
+		std::cout << "Light sampling comparison: wrote " << path.string() << std::endl;
+	}
+}
+
+void ConvergenceBenchmark::writeResults() const {
+
+	std::ofstream file(outputPath);
+
+	file << "spp";
+	for (int s = 0; s < NUM_SAMPLERS; s++) file << "," << samplerNames[s];
+	file << "\n";
+
+	std::cout << std::left << std::setw(8) << "spp";
+	for (int s = 0; s < NUM_SAMPLERS; s++) std::cout << std::setw(14) << samplerNames[s];
+	std::cout << std::endl;
+
+	for (size_t i = 0; i < sampleCounts.size(); i++) {
+
+		file << sampleCounts[i];
+		std::cout << std::setw(8) << sampleCounts[i];
+
+		for (int s = 0; s < NUM_SAMPLERS; s++) {
+			double error = i < results[s].size() ? results[s][i] : 0.0;
+			file << "," << error;
+			std::cout << std::setw(14) << error;
+		}
+
+		file << "\n";
+		std::cout << std::endl;
+	}
+
+	std::cout << "Convergence benchmark written to " << outputPath << std::endl;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "Config.h"
+
+class DX12Renderer;
+
+// RMSE against a high sample count reference for every sampler, at power of two sample counts.
+// Renders the current view one sample per frame, the camera should stay still while it runs.
+// startLightSampling instead renders the reference with next event estimation off and again with it on, both converged
+// renders are written so the two can be compared (--scene backlit has the emitters light sampling is easiest to get wrong).
+
+class ConvergenceBenchmark {
+public:
+
+	ConvergenceBenchmark(DX12Renderer* dx12Renderer) : dx12Renderer(dx12Renderer) {};
+	~ConvergenceBenchmark() {};
+
+	void start();
+	void startLightSampling();
+	void update(); // before the frame is rendered
+	void collect(); // after the frame has been presented
+
+	bool running = false;
+
+	uint32_t referenceSamples = 4096;
+	uint32_t maxSamples = 256;
+	std::string outputPath = "convergence.csv";
+	std::string lightSamplingPath = "renders/light_sampling.pfm"; // _off and _on are added to the name
+
+private:
+
+	static constexpr int NUM_SAMPLERS = 3;
+	static constexpr int REFERENCE = -1;
+	static constexpr uint32_t REFERENCE_SAMPLES_PER_FRAME = 16;
+
+	void beginPhase(int sampler);
+	double rmse(const std::vector<float>& accumulation) const;
+	double meanRadiance(const std::vector<float>& accumulation) const;
+	void writeRender(const std::string& suffix) const;
+	void writeResults() const;
+
+	DX12Renderer* dx12Renderer;
+
+	Config savedConfig;
+
+	bool comparingLightSampling = false; // reference has light sampling off, the one measured phase has it on
+	int phase = REFERENCE; // sampler being measured
+	uint32_t samples = 0;
+	bool readbackPending = false;
+
+	std::vector<float> reference; // mean colour per pixel, rgb
+	std::vector<float> accumulation;
+	std::vector<uint32_t> sampleCounts;
+	std::vector<double> results[NUM_SAMPLERS];
+};
@@ -1,7 +1,12 @@
 ﻿#include "DX12Renderer.h"
 #include <iostream>
 #include <random>
+#include <cmath>
+#include <filesystem>
+#include <ScreenGrab.h>
+#include <wincodec.h>
 #include "Config.h"
+#include "UI.h"
 
 bool debug = true;
 ImGuiDescriptorAllocator* ImGuiDescAlloc;
@@ -48,6 +53,9 @@ void DX12Renderer::init() {
 	raytracingStage->loadShaders();
 	raytracingStage->updateCamera();
 	raytracingStage->initAccumulationTexture();
+	raytracingStage->initAdaptiveBuffers();
+	raytracingStage->initAOVTextures();
+	raytracingStage->initHistoryTextures();
 	raytracingStage->initModelBuffers();
 
 	rm->cmdList->Close();
@@ -62,15 +70,18 @@ void DX12Renderer::init() {
 	raytracingStage->initScene();
 	raytracingStage->initTopLevelAS();
 	raytracingStage->initMaterialBuffer();
+	raytracingStage->initLightBuffers();
+	raytracingStage->initSamplerBuffers();
+	raytracingStage->initTimestampQueries();
 	raytracingStage->initVertexIndexBuffers();
 	raytracingStage->updateTransforms();
 
 	std::cout << "init ComputeResources" << std::endl;
 	computeStage->loadShaders();
 	computeStage->initRenderTarget();
-	computeStage->updateRand();
+	computeStage->initDenoiseTextures();
 	computeStage->updateToneParams();
-	computeStage->initMaxLumBuffer();
+	computeStage->initHistogramBuffer();
 
 	std::cout << "raytracingStage->initStage();" << std::endl;
 	raytracingStage->initStage();
@@ -154,6 +165,7 @@ void DX12Renderer::initSurfaces() {
 
 	// early factory release
 	rm->factory->Release();
+	rm->factory = nullptr;
 
 }
 
@@ -175,19 +187,11 @@ void DX12Renderer::resize() {
 
 	rm->swapChain->ResizeBuffers(0, rm->width, rm->height, DXGI_FORMAT_UNKNOWN, 0);
 
-	// Update render target and accumulation texture
-	
-	if (rm->renderTarget) {
-		rm->randPattern.resize(rm->width * rm->height);
-	}
+	rm->internalWidth = rm->width;
+	rm->internalHeight = rm->height;
 
-	
 	createBackBufferRTVs();
 
-	if (rm->renderTarget) {
-		rm->randPattern.resize(rm->width * rm->height);
-	}
-
 	std::cout << "resize" << std::endl;
 }
 
@@ -261,8 +265,6 @@ DX12Renderer::UploadDefaultBufferPair DX12Renderer::createBuffers(const void* da
 void DX12Renderer::accumulationReset() {
 
 	if (reset) {
-		//updateRand();
-
 		// reset accumulationTexutre
 	}
 	
@@ -272,16 +274,146 @@ void DX12Renderer::accumulationReset() {
 
 void DX12Renderer::render() {
 
+	if (entityManager->transformsDirty) {
+		raytracingStage->refitTopLevelAS();
+		entityManager->transformsDirty = false;
+		UI::accelUpdate = true;
+	}
+
 	raytracingStage->updateCamera();
+	raytracingStage->updateLights();
+	if (config.adaptiveSampling) computeStage->readAdaptiveStats();
+	if (rm->exposureAdapted) computeStage->readExposure(); // the adapt pass ran last frame
 	raytracingStage->traceRays();
 	computeStage->postProcess();
 
-	rm->iterations = (config.accumulate & !entityManager->camera->camMoved) ? rm->iterations + config.raysPerPixel : config.raysPerPixel;
+	rm->iterations = rm->accumulationRestarted ? rm->samplePasses : rm->iterations + rm->samplePasses;
 	rm->seed++;
 
 	ImGui::Render();
 }
 
+void DX12Renderer::updateResolution(float frameTimeMs, bool moving) {
+
+	float scale = 1.0f;
+
+	if (config.dynamicResolution && !config.deterministic) {
+
+		rm->stillFrames = moving ? 0 : rm->stillFrames + 1;
+
+		// internal_resX / internal_resY are the floor, half the output if unset
+		float minScale = 0.5f;
+		if (config.internal_resX > 0 && config.internal_resY > 0) {
+			minScale = std::max(static_cast<float>(config.internal_resX) / rm->width, static_cast<float>(config.internal_resY) / rm->height);
+		}
+		minScale = std::clamp(minScale, 0.1f, 1.0f);
+
+		if (rm->stillFrames < static_cast<UINT>(config.resolutionSettleFrames)) {
+			// pixel count follows the frame time, so the scale moves with its square root
+			float correction = std::clamp(std::sqrt(config.targetFrameTime / std::max(frameTimeMs, 0.1f)), 0.75f, 1.25f);
+			if (moving) rm->movingScale = std::clamp(rm->movingScale * correction, minScale, 1.0f);
+
+			// coarse steps so reprojection survives most frames
+			scale = std::clamp(std::ceil(rm->movingScale * 8.0f) / 8.0f, minScale, 1.0f);
+		}
+	}
+
+	UINT width = std::max<UINT>(static_cast<UINT>(std::lround(rm->width * scale)), 1);
+	UINT height = std::max<UINT>(static_cast<UINT>(std::lround(rm->height * scale)), 1);
+
+	if (width != rm->internalWidth || height != rm->internalHeight) {
+		rm->internalWidth = width;
+		rm->internalHeight = height;
+		rm->resolutionChanged = true;
+	}
+}
+
+float DX12Renderer::exposure() const {
+	return config.autoExposure && rm->exposureAdapted ? config.exposure * std::exp2(rm->exposureEV) : config.exposure;
+}
+
+void DX12Renderer::updateFrameBudget(float frameTimeMs, float remainingMs) {
+
+	// the frame has been flushed, its timestamps are resolved
+	void* mapped = nullptr;
+	D3D12_RANGE readRange = { 0, ResourceManager::TIMESTAMP_QUERIES * sizeof(UINT64) };
+	rm->timestampReadback->Map(0, &readRange, &mapped);
+	UINT64* timestamps = static_cast<UINT64*>(mapped);
+	float ticksToMs = 1000.0f / static_cast<float>(rm->timestampFrequency);
+	rm->traceTimeMs = static_cast<float>(timestamps[1] - timestamps[0]) * ticksToMs;
+
+	const float smoothing = 0.2f;
+
+	// only the passes that ran were resolved, the ones cut by the budget keep the cost of the last one that ran
+	for (UINT i = 0; i < ResourceManager::MAX_DENOISE_ITERATIONS; i++) {
+		if (i < rm->denoisePasses) {
+			float passMs = static_cast<float>(timestamps[ResourceManager::DENOISE_QUERY + 1 + i] - timestamps[ResourceManager::DENOISE_QUERY + i]) * ticksToMs;
+			rm->denoisePassMs[i] = rm->denoisePassMs[i] > 0.0f ? rm->denoisePassMs[i] + (passMs - rm->denoisePassMs[i]) * smoothing : passMs;
+		}
+		else if (rm->denoisePasses > 0) {
+			rm->denoisePassMs[i] = rm->denoisePassMs[rm->denoisePasses - 1];
+		}
+	}
+
+	D3D12_RANGE writeRange = { 0, 0 };
+	rm->timestampReadback->Unmap(0, &writeRange);
+
+	if (rm->samplePasses > 0) {
+		float passCost = rm->traceTimeMs / static_cast<float>(rm->samplePasses);
+		rm->passCostMs = rm->passCostMs > 0.0f ? rm->passCostMs + (passCost - rm->passCostMs) * smoothing : passCost;
+	}
+
+	float overhead = std::max(frameTimeMs - rm->traceTimeMs, 0.0f);
+	rm->frameOverheadMs = rm->frameOverheadMs + (overhead - rm->frameOverheadMs) * smoothing;
+
+	if (!config.timeBudget || rm->passCostMs <= 0.0f) return;
+
+	// never run past the deadline
+	float target = std::min(config.targetFrameTime, remainingMs);
+	float available = target - rm->frameOverheadMs;
+
+	UINT passes = available > 0.0f ? static_cast<UINT>(available / rm->passCostMs) : 1;
+	rm->budgetPasses = std::clamp<UINT>(passes, 1, static_cast<UINT>(config.maxPassesPerFrame));
+}
+
+uint64_t DX12Renderer::hashAccumulation() {
+
+	// FNV-1a over the raw fp32 accumulation, row padding excluded
+	std::vector<float> pixels;
+	computeStage->readAccumulation(pixels);
+
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(pixels.data());
+	size_t size = pixels.size() * sizeof(float);
+
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+bool DX12Renderer::saveRender(const std::string& path) {
+
+	std::filesystem::path filePath(path);
+	if (filePath.has_parent_path()) {
+		std::filesystem::create_directories(filePath.parent_path());
+	}
+
+	// render target is back in UAV state after present
+	HRESULT hr = DirectX::SaveWICTextureToFile(rm->cmdQueue, rm->renderTarget, GUID_ContainerFormatPng, filePath.wstring().c_str(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+	if (FAILED(hr)) {
+		std::cerr << "Failed to write " << path << " HRESULT 0x" << std::hex << hr << std::dec << std::endl;
+		return false;
+	}
+
+	std::cout << "Wrote " << path << std::endl;
+	return true;
+}
+
 void DX12Renderer::imguiPresent(ID3D12Resource* backBuffer) {
 	// set descriptor heap for imgui
 	ID3D12DescriptorHeap* heaps[] = { ImGuiDescAlloc->heap };
@@ -352,6 +484,90 @@ void DX12Renderer::checkHR(HRESULT hr, ID3DBlob* errorblob, std::string context)
 	}
 }
 
+void DX12Renderer::readRenderTarget(std::vector<uint8_t>& pixels) {
+
+	// render target is back in UAV state after present
+	computeStage->copyTexture(rm->renderTarget, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, rm->renderTargetReadback, rm->renderTargetFootprint);
+
+	rm->cmdList->Close();
+	rm->cmdQueue->ExecuteCommandLists(1, reinterpret_cast<ID3D12CommandList**>(&rm->cmdList));
+	flush();
+	rm->cmdAlloc->Reset();
+	rm->cmdList->Reset(rm->cmdAlloc, nullptr);
+
+	computeStage->readTexture(rm->renderTargetReadback, rm->renderTargetFootprint, 4, pixels);
+}
+
+void DX12Renderer::restoreAccumulation(const std::vector<float>& accumulation, const std::vector<float>& variance) {
+
+	// both textures are UAVs between frames
+	ID3D12Resource* uploads[2] = {
+		uploadTexture(rm->accumulationTexture, accumulation.data(), 4, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+		uploadTexture(rm->varianceTexture, variance.data(), 2, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+	};
+
+	rm->cmdList->Close();
+	rm->cmdQueue->ExecuteCommandLists(1, reinterpret_cast<ID3D12CommandList**>(&rm->cmdList));
+	flush();
+	rm->cmdAlloc->Reset();
+	rm->cmdList->Reset(rm->cmdAlloc, nullptr);
+
+	for (ID3D12Resource* upload : uploads) {
+		upload->Release();
+	}
+}
+
+ID3D12Resource* DX12Renderer::uploadTexture(ID3D12Resource* texture, const float* data, UINT channels, D3D12_RESOURCE_STATES state) {
+
+	D3D12_RESOURCE_DESC texDesc = texture->GetDesc();
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+	UINT64 totalBytes = 0;
+	rm->d3dDevice->GetCopyableFootprints(&texDesc, 0, 1, 0, &footprint, nullptr, nullptr, &totalBytes);
+
+	D3D12_RESOURCE_DESC desc = {
+		.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+		.Width = totalBytes,
+		.Height = 1,
+		.DepthOrArraySize = 1,
+		.MipLevels = 1,
+		.SampleDesc = rm->NO_AA,
+		.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+	};
+
+	D3D12_HEAP_PROPERTIES UPLOAD_HEAP = { .Type = D3D12_HEAP_TYPE_UPLOAD };
+	ID3D12Resource* upload = nullptr;
+	HRESULT hr = rm->d3dDevice->CreateCommittedResource(&UPLOAD_HEAP, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&upload));
+	checkHR(hr, nullptr, "Create texture upload buffer");
+
+	// rows are padded to the copy pitch
+	UINT width = footprint.Footprint.Width;
+	void* mapped = nullptr;
+	upload->Map(0, nullptr, &mapped);
+	for (UINT y = 0; y < footprint.Footprint.Height; y++) {
+		uint8_t* row = static_cast<uint8_t*>(mapped) + static_cast<size_t>(y) * footprint.Footprint.RowPitch;
+		memcpy(row, data + static_cast<size_t>(y) * width * channels, width * channels * sizeof(float));
+	}
+	upload->Unmap(0, nullptr);
+
+	barrier(texture, state, D3D12_RESOURCE_STATE_COPY_DEST);
+
+	D3D12_TEXTURE_COPY_LOCATION dst = {};
+	dst.pResource = texture;
+	dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+	dst.SubresourceIndex = 0;
+
+	D3D12_TEXTURE_COPY_LOCATION src = {};
+	src.pResource = upload;
+	src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+	src.PlacedFootprint = footprint;
+
+	rm->cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+
+	barrier(texture, D3D12_RESOURCE_STATE_COPY_DEST, state);
+
+	return upload;
+}
+
 void DX12Renderer::barrier(ID3D12Resource* resource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after) {
 
 	D3D12_RESOURCE_BARRIER rb = {
@@ -93,14 +93,19 @@ public:
 	};
 	DX12Renderer(EntityManager* entityManager, MeshManager* meshManager, MaterialManager* materialManager, Window* window);
 
+	// the caller flushes first, nothing may still be in flight
 	~DX12Renderer() {
 		// imgui
 		ImGui_ImplDX12_Shutdown();
 		ImGui_ImplSDL3_Shutdown();
 		ImGui::DestroyContext();
-		
-		if (rm->rtvHeap) rm->rtvHeap->Release();
-		//delete ImGuiDescAlloc;
+
+		delete ImGuiDescAlloc;
+		ImGuiDescAlloc = nullptr;
+
+		delete raytracingStage;
+		delete computeStage;
+		delete rm; // device last
 	}
 
 	void init();
@@ -114,6 +119,14 @@ public:
 	
 	void render();
 	void present();
+	void updateFrameBudget(float frameTimeMs, float remainingMs);
+	void updateResolution(float frameTimeMs, bool moving); // internal resolution for the next frame
+	float exposure() const; // what the tone map pass scales by, for tone mapping readbacks on the CPU
+	bool saveRender(const std::string& path); // tone mapped image, png
+	void readRenderTarget(std::vector<uint8_t>& pixels); // tone mapped rgba8, between frames
+	uint64_t hashAccumulation(); // needs accumulationReadbackRequested set for the frame just presented
+	void restoreAccumulation(const std::vector<float>& accumulation, const std::vector<float>& variance); // from a checkpoint, before the first frame
+	ID3D12Resource* uploadTexture(ID3D12Resource* texture, const float* data, UINT channels, D3D12_RESOURCE_STATES state); // recorded, the upload buffer is returned to release after the flush
 
 	void initImgui();
 	void createBackBufferRTVs();
@@ -135,6 +148,6 @@ public:
 	ResourceManager* rm;
 	Window* window;
 
-	ComputeStage* computeStage;
-	RayTracingStage* raytracingStage;
+	ComputeStage* computeStage = nullptr;
+	RayTracingStage* raytracingStage = nullptr;
 };
\ No newline at end of file
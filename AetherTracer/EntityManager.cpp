@@ -1,60 +1,219 @@
 #include "EntityManager.h"
+
+#include <DirectXMath.h>
+
 #include <string>
+#include <bit>
+#include <thread>
+#include <future>
 
 
 void EntityManager::initScene() {
 
+    if (config.scene == "backlit") {
+        initBackLitScene();
+        return;
+    }
+
     camera->position = { 15, 3, 0 };
     camera->rotation = { -1 , 0 };
 
     // CORNELL BOX
-    entitys.emplace_back(new Entity{ "cornell", {23, -3, 0}, {0, 0, 0}, materialManager->materials["White Plastic"] }); // floor
+    add("cornell", {23, -3, 0}, {0, 0, 0}, materialManager->materials["White Plastic"]); // floor
 
-    entitys.emplace_back(new Entity{ "cornell", {23, 9, 0}, {0, 0, 0}, materialManager->materials["White Plastic"] }); // roof
+    add("cornell", {23, 9, 0}, {0, 0, 0}, materialManager->materials["White Plastic"]); // roof
 
-    entitys.emplace_back(new Entity{ "cornell", {23, 3, 6}, {0, 0, 0}, materialManager->materials["Red Plastic"] }); // left wall
-    entitys.emplace_back(new Entity{ "cornell", {23, 3, -6}, {0, 0, 0}, materialManager->materials["Green Plastic"] }); // right wall
+    add("cornell", {23, 3, 6}, {0, 0, 0}, materialManager->materials["Red Plastic"]); // left wall
+    add("cornell", {23, 3, -6}, {0, 0, 0}, materialManager->materials["Green Plastic"]); // right wall
 
-    entitys.emplace_back(new Entity{ "cornell", {29, 3, 0}, {0, 0, 0}, materialManager->materials["White Plastic"] }); // back wall
+    add("cornell", {29, 3, 0}, {0, 0, 0}, materialManager->materials["White Plastic"]); // back wall
 
-    entitys.emplace_back(new Entity{ "cube", {23, 6.925, 0}, {0, 0, 0}, materialManager->materials["Light"] }); // light
-    entitys.emplace_back(new Entity{ "cube", {29, 15, 0}, {0, 0, 0}, materialManager->materials["Light"] }); // high
+    add("cube", {23, 6.925, 0}, {0, 0, 0}, materialManager->materials["Light"]); // light
+    add("cube", {29, 15, 0}, {0, 0, 0}, materialManager->materials["Light"]); // high
 
-    entitys.emplace_back(new Entity{ "cube", {24, 1, 1}, {0, -0.4, 0}, materialManager->materials["White Plastic"] });
-    entitys.emplace_back(new Entity{ "cube", {24, 3, 1}, {0, -0.4, 0}, materialManager->materials["White Plastic"] });
+    add("cube", {24, 1, 1}, {0, -0.4, 0}, materialManager->materials["White Plastic"]);
+    add("cube", {24, 3, 1}, {0, -0.4, 0}, materialManager->materials["White Plastic"]);
 
-    entitys.emplace_back(new Entity{ "cube", {22, 1, -1}, {0, 0.4, 0}, materialManager->materials["White Plastic"] });
+    add("cube", {22, 1, -1}, {0, 0.4, 0}, materialManager->materials["White Plastic"]);
     
-    entitys.emplace_back(new Entity{ "floor", {0, 0, 0}, {0, 0, 0}, materialManager->materials["White Plastic"] }); // floor
+    add("floor", {0, 0, 0}, {0, 0, 0}, materialManager->materials["White Plastic"]); // floor
     // CORNELL BOX
 
-    entitys.emplace_back(new Entity{ "sphere", {15, 1, -5}, {0, 0.4, 0}, materialManager->materials["Glass"] });
-    entitys.emplace_back(new Entity{ "sphere", {15, 1, -10}, {0, 0.4, 0}, materialManager->materials["Mirror"] });
-    entitys.emplace_back(new Entity{ "diamondFlat", {10, 0, -7.5}, {0, 0, 0}, materialManager->materials["Diamond"] });
+    add("sphere", {15, 1, -5}, {0, 0.4, 0}, materialManager->materials["Glass"]);
+    add("sphere", {15, 1, -10}, {0, 0.4, 0}, materialManager->materials["Mirror"]);
+    add("diamondFlat", {10, 0, -7.5}, {0, 0, 0}, materialManager->materials["Diamond"]);
 
-    entitys.emplace_back(new Entity{ "lucyScaled", {15, -0.05, 5}, {0, 0, 0}, materialManager->materials["Glass"] });
-    entitys.emplace_back(new Entity{ "TheStanfordDragon", {15, 0, 10}, {0, 200, 0}, materialManager->materials["Orange Glass"] });
+    add("lucyScaled", {15, -0.05, 5}, {0, 0, 0}, materialManager->materials["Glass"]);
+    add("TheStanfordDragon", {15, 0, 10}, {0, 200, 0}, materialManager->materials["Orange Glass"]);
 
-    entitys.emplace_back(new Entity{ "portalGun", {-5, 0, 5}, {0, 0, 0}, materialManager->materials["White Plastic"] });
-    entitys.emplace_back(new Entity{ "portalButton", {-5, 0, 1}, {0, 0, 0}, materialManager->materials["White Plastic"] });
-    entitys.emplace_back(new Entity{ "CompanionCube", {-5, 0, -1.5}, {0, 0, 0}, materialManager->materials["White Plastic"] });
+    add("portalGun", {-5, 0, 5}, {0, 0, 0}, materialManager->materials["White Plastic"]);
+    add("portalButton", {-5, 0, 1}, {0, 0, 0}, materialManager->materials["White Plastic"]);
+    add("CompanionCube", {-5, 0, -1.5}, {0, 0, 0}, materialManager->materials["White Plastic"]);
 
 
    
-    for (Entity* entity : entitys) {
-        if (entity->material == nullptr) entity->material = materialManager->materials["White Plastic"];
+    for (MaterialManager::Material*& material : materials) {
+        if (material == nullptr) material = materialManager->materials["White Plastic"];
     }
 }
 
-void EntityManager::cleanUp() {
+void EntityManager::initBackLitScene() {
+
+    camera->position = { 15, 3, 0 };
+    camera->rotation = { -1 , 0 };
 
-    for (Entity* entity : entitys) {
+    // the same single sided panel twice, the second one turned over, so the box sees the front of one and the back of
+    // the other. light sampling on and off have to converge to the same image
+    add("cornell", {23, -3, 0}, {0, 0, 0}, materialManager->materials["White Plastic"]); // floor
+    add("cornell", {23, 3, 6}, {0, 0, 0}, materialManager->materials["Red Plastic"]); // left wall
+    add("cornell", {23, 3, -6}, {0, 0, 0}, materialManager->materials["Green Plastic"]); // right wall
+    add("cornell", {29, 3, 0}, {0, 0, 0}, materialManager->materials["White Plastic"]); // back wall
 
-        auto it = std::find(entitys.begin(), entitys.end(), entity);
+    add("weirdTriangle", {23, 6, 2}, {0, 0, 0}, materialManager->materials["Light"]);
+    add("weirdTriangle", {23, 6, -2}, {3.14159265f, 0, 0}, materialManager->materials["Light"]);
+
+    add("cube", {24, 1, 1}, {0, -0.4, 0}, materialManager->materials["White Plastic"]);
+    add("cube", {22, 1, -1}, {0, 0.4, 0}, materialManager->materials["White Plastic"]);
+}
+
+EntityManager::Handle EntityManager::add(const std::string& model, PT::Vector3 position, PT::Vector3 rotation, MaterialManager::Material* material) {
+
+    Handle entity = static_cast<Handle>(positions.size());
+
+    auto [name, inserted] = modelIndices.try_emplace(model, static_cast<uint32_t>(modelNames.size()));
+    if (inserted) modelNames.push_back(model);
+
+    positions.push_back(position);
+    rotations.push_back(rotation);
+    worldMatrices.push_back({});
+    models.push_back(name->second);
+    materials.push_back(material);
+
+    if (dirtyBits.size() * 64 < positions.size()) dirtyBits.push_back(0);
+    markDirty(entity);
+    return entity;
+}
 
-        entitys.erase(it);
-        delete entity;
+void EntityManager::setTransform(Handle entity, PT::Vector3 position, PT::Vector3 rotation) {
+
+    positions[entity] = position;
+    rotations[entity] = rotation;
+    markDirty(entity);
+}
+
+void EntityManager::updateTransforms() {
+
+    // whole words at a time, a scene where nothing moved costs one compare per 64 entities
+    changedEntities.clear();
+    for (size_t word = 0; word < dirtyBits.size(); word++) {
+        uint64_t bits = dirtyBits[word];
+        dirtyBits[word] = 0;
+        while (bits) {
+            changedEntities.push_back(static_cast<Handle>(word * 64 + std::countr_zero(bits)));
+            bits &= bits - 1;
+        }
+    }
+
+    if (changedEntities.size() < PARALLEL_REBUILD) {
+        rebuildMatrices(changedEntities.data(), changedEntities.size());
+        return;
     }
 
+    // bands of whole groups of four, no two bands share an entity
+    size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+    size_t band = (changedEntities.size() / threads + 3) & ~size_t(3);
+    std::vector<std::future<void>> bands;
+    for (size_t first = 0; first < changedEntities.size(); first += band) {
+        size_t size = std::min(band, changedEntities.size() - first);
+        bands.push_back(std::async(std::launch::async, [this, first, size]() { rebuildMatrices(changedEntities.data() + first, size); }));
+    }
+    for (std::future<void>& f : bands) f.get();
 }
 
+void EntityManager::rebuildMatrices(const Handle* entities, size_t count) {
+
+    using namespace DirectX;
+
+    // XMMatrixRotationRollPitchYaw followed by the translation, written out so every term is computed for four
+    // entities at once. the tail group repeats its last entity
+    for (size_t i = 0; i < count; i += 4) {
+
+        Handle lanes[4];
+        for (size_t lane = 0; lane < 4; lane++) lanes[lane] = entities[std::min(i + lane, count - 1)];
+
+        const PT::Vector3* r[4] = { &rotations[lanes[0]], &rotations[lanes[1]], &rotations[lanes[2]], &rotations[lanes[3]] };
+
+        XMVECTOR sp, cp, sy, cy, sr, cr;
+        XMVectorSinCos(&sp, &cp, XMVectorSet(r[0]->x, r[1]->x, r[2]->x, r[3]->x));
+        XMVectorSinCos(&sy, &cy, XMVectorSet(r[0]->y, r[1]->y, r[2]->y, r[3]->y));
+        XMVectorSinCos(&sr, &cr, XMVectorSet(r[0]->z, r[1]->z, r[2]->z, r[3]->z));
+
+        XMVECTOR srsp = XMVectorMultiply(sr, sp);
+        XMVECTOR crsp = XMVectorMultiply(cr, sp);
+
+        XMFLOAT4A m[9];
+        XMStoreFloat4A(&m[0], XMVectorMultiplyAdd(srsp, sy, XMVectorMultiply(cr, cy))); // m00
+        XMStoreFloat4A(&m[1], XMVectorMultiply(sr, cp)); // m01
+        XMStoreFloat4A(&m[2], XMVectorNegativeMultiplySubtract(cr, sy, XMVectorMultiply(srsp, cy))); // m02
+        XMStoreFloat4A(&m[3], XMVectorNegativeMultiplySubtract(sr, cy, XMVectorMultiply(crsp, sy))); // m10
+        XMStoreFloat4A(&m[4], XMVectorMultiply(cr, cp)); // m11
+        XMStoreFloat4A(&m[5], XMVectorMultiplyAdd(sr, sy, XMVectorMultiply(crsp, cy))); // m12
+        XMStoreFloat4A(&m[6], XMVectorMultiply(cp, sy)); // m20
+        XMStoreFloat4A(&m[7], XMVectorNegate(sp)); // m21
+        XMStoreFloat4A(&m[8], XMVectorMultiply(cp, cy)); // m22
+
+        // stored transposed, as XMStoreFloat3x4 would, with the translation in the last column
+        for (size_t lane = 0; lane < 4; lane++) {
+            const float* e = reinterpret_cast<const float*>(m) + lane;
+            const PT::Vector3& t = positions[lanes[lane]];
+            Transform& transform = worldMatrices[lanes[lane]];
+            transform = { {
+                { e[0], e[12], e[24], t.x },
+                { e[4], e[16], e[28], t.y },
+                { e[8], e[20], e[32], t.z },
+            } };
+        }
+    }
+}
+
+uint64_t EntityManager::sceneHash() const {
+
+    // FNV-1a over everything initScene places
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    };
+
+    for (Handle entity = 0; entity < count(); entity++) {
+        const std::string& name = modelName(entity);
+        mix(name.data(), name.size());
+        mix(&positions[entity], sizeof(PT::Vector3));
+        mix(&rotations[entity], sizeof(PT::Vector3));
+
+        if (materials[entity]) {
+            const MaterialManager::Material* material = materials[entity];
+            mix(material->name.data(), material->name.size());
+            mix(&material->color, sizeof(material->color));
+            float properties[5] = { material->roughness, material->metallic, material->ior, material->transmission, material->emission };
+            mix(properties, sizeof(properties));
+        }
+    }
+    return hash;
+}
+
+void EntityManager::cleanUp() {
+
+    positions.clear();
+    rotations.clear();
+    worldMatrices.clear();
+    models.clear();
+    materials.clear();
+    dirtyBits.clear();
+    changedEntities.clear();
+    modelNames.clear();
+    modelIndices.clear();
+}
@@ -2,28 +2,27 @@
 
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include <algorithm>
+#include <cstdint>
 
 #include "Vector.h"
 #include "Config.h"
 
 #include "MaterialManager.h"
 
+// Entities are stored as parallel arrays indexed by an entity handle, handles are never reused or reordered so they
+// double as the TLAS instance index. Moving an entity goes through setTransform, which sets its dirty bit;
+// updateTransforms rebuilds the world matrices of the dirty entities only, four at a time across entities, and lists
+// them in changedEntities for whoever copies matrices on to the GPU.
+
 class EntityManager {
 public:
-	struct Entity {
-
-
-		Entity(std::string name) : name(name), position{ 0, 0, 0 }, rotation{ 0, 0, 0 }, material(nullptr) {};
 
-		Entity(std::string name, PT::Vector3 position, PT::Vector3 rotation) : name(name), position(position), rotation(rotation), material(nullptr) {};
+	using Handle = uint32_t;
 
-		Entity(std::string name, PT::Vector3 position, PT::Vector3 rotation, MaterialManager::Material* material) : name(name), position(position), rotation(rotation), material(material) {};
-
-		std::string name; // name in assets folder
-		PT::Vector3 position;
-		PT::Vector3 rotation;
-		MaterialManager::Material* material;
+	struct Transform {
+		float m[3][4]; // row major 3x4, rotation then translation, the layout of a DXR instance desc
 	};
 
 	struct Camera {
@@ -103,15 +102,44 @@ public:
 
 	~EntityManager() {
 		cleanUp();
+		delete camera;
 	};
 
 	void initScene();
+	void initBackLitScene(); // config.scene "backlit"
+	uint64_t sceneHash() const; // identifies the scene in checkpoints and to render workers
+
+	Handle add(const std::string& model, PT::Vector3 position, PT::Vector3 rotation, MaterialManager::Material* material);
+	size_t count() const { return positions.size(); }
+	const std::string& modelName(Handle entity) const { return modelNames[models[entity]]; }
+
+	void setTransform(Handle entity, PT::Vector3 position, PT::Vector3 rotation);
+	void markDirty(Handle entity) { dirtyBits[entity >> 6] |= uint64_t(1) << (entity & 63); transformsDirty = true; }
+	void updateTransforms(); // rebuilds the dirty world matrices and lists them in changedEntities
 
 	void cleanUp();
 
+	static constexpr size_t PARALLEL_REBUILD = 1 << 14; // dirty entities before the rebuild is split across threads
+
+	// one element per entity
+	std::vector<PT::Vector3> positions;
+	std::vector<PT::Vector3> rotations; // pitch, yaw, roll in radians
+	std::vector<Transform> worldMatrices; // current for every entity whose dirty bit is clear
+	std::vector<uint32_t> models; // index into modelNames
+	std::vector<MaterialManager::Material*> materials;
+
+	std::vector<uint64_t> dirtyBits; // one bit per entity
+	std::vector<Handle> changedEntities; // rebuilt by the last updateTransforms
+	std::vector<std::string> modelNames; // mesh names in the assets folder, once each
 
-	std::vector<Entity*> entitys;
+	bool transformsDirty = false; // an entity moved, the renderer refits the TLAS before the next frame
 	MaterialManager* materialManager;
 	Camera* camera;
+
+private:
+
+	void rebuildMatrices(const Handle* entities, size_t count);
+
+	std::unordered_map<std::string, uint32_t> modelIndices; // modelNames back to their index
 };
 
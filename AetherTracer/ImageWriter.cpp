@@ -0,0 +1,345 @@
+#include "ImageWriter.h"
+#include "ToneMapper.h"
+
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <wincodec.h>
+#pragma comment(lib, "windowscodecs")
+#pragma comment(lib, "ole32")
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <cstring>
+#include <cctype>
+
+bool ImageWriter::writePNG(const std::string& path, uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba) {
+
+	ScanlineWriter writer;
+	if (!writer.open(path, width, height)) return false;
+	writer.writeRows(height, rgba.data());
+	return writer.close();
+}
+
+bool ImageWriter::writePFM(const std::string& path, uint32_t width, uint32_t height, const std::vector<float>& accumulation) {
+
+	std::filesystem::path filePath(path);
+	if (filePath.has_parent_path()) std::filesystem::create_directories(filePath.parent_path());
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "Failed to open " << path << std::endl;
+		return false;
+	}
+
+	// little endian rgb, rows bottom to top
+	file << "PF\n" << width << " " << height << "\n-1.0\n";
+
+	std::vector<float> row(static_cast<size_t>(width) * 3);
+	for (int y = static_cast<int>(height) - 1; y >= 0; y--) {
+		for (uint32_t x = 0; x < width; x++) {
+			const float* pixel = &accumulation[(static_cast<size_t>(y) * width + x) * 4];
+			float count = std::max(pixel[3], 1.0f);
+			row[x * 3 + 0] = pixel[0] / count;
+			row[x * 3 + 1] = pixel[1] / count;
+			row[x * 3 + 2] = pixel[2] / count;
+		}
+		file.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+	}
+
+	if (!file) {
+		std::cerr << "Failed to write " << path << std::endl;
+		return false;
+	}
+
+	std::cout << "Wrote " << path << std::endl;
+	return true;
+}
+
+bool ImageWriter::writeEXR(const std::string& path, uint32_t width, uint32_t height, const std::vector<float>& accumulation) {
+
+	// single part scanline file, one line per chunk as RLE requires. lines are compressed in parallel bands,
+	// only the offset table and the writes themselves are serial
+	size_t lineBytes = static_cast<size_t>(width) * 3 * sizeof(float);
+	std::vector<std::vector<uint8_t>> chunks(height);
+
+	auto compressLines = [&](uint32_t first, uint32_t last) {
+		std::vector<float> line(static_cast<size_t>(width) * 3);
+		std::vector<uint8_t> packed;
+		for (uint32_t y = first; y < last; y++) {
+			// channels are stored alphabetically, each as a whole line: B then G then R
+			for (uint32_t x = 0; x < width; x++) {
+				const float* pixel = &accumulation[(static_cast<size_t>(y) * width + x) * 4];
+				float count = std::max(pixel[3], 1.0f);
+				line[x] = pixel[2] / count;
+				line[width + x] = pixel[1] / count;
+				line[width * 2 + x] = pixel[0] / count;
+			}
+
+			const uint8_t* raw = reinterpret_cast<const uint8_t*>(line.data());
+			compressRLE(raw, lineBytes, packed);
+
+			// a chunk that doesn't shrink is stored as is, readers tell by its size
+			std::vector<uint8_t>& chunk = chunks[y];
+			if (packed.size() < lineBytes) chunk.assign(packed.begin(), packed.end());
+			else chunk.assign(raw, raw + lineBytes);
+		}
+	};
+
+	uint32_t threads = std::max(1u, std::min(std::thread::hardware_concurrency(), height));
+	uint32_t band = (height + threads - 1) / threads;
+	std::vector<std::future<void>> bands;
+	for (uint32_t first = 0; first < height; first += band) {
+		bands.push_back(std::async(std::launch::async, compressLines, first, std::min(first + band, height)));
+	}
+	for (std::future<void>& f : bands) f.get();
+
+	std::vector<uint8_t> header;
+	auto put = [&](const void* data, size_t size) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		header.insert(header.end(), bytes, bytes + size);
+	};
+	auto putInt = [&](int32_t value) { put(&value, sizeof(value)); };
+	auto putFloat = [&](float value) { put(&value, sizeof(value)); };
+	auto putAttribute = [&](const char* name, const char* type, int32_t size) {
+		put(name, strlen(name) + 1);
+		put(type, strlen(type) + 1);
+		putInt(size);
+	};
+
+	putInt(20000630); // magic
+	putInt(2); // version 2, scanline, no flags
+
+	putAttribute("channels", "chlist", 3 * 18 + 1);
+	for (const char* channel : { "B", "G", "R" }) {
+		put(channel, 2);
+		putInt(2); // FLOAT
+		putInt(0); // pLinear and reserved
+		putInt(1); // x sampling
+		putInt(1); // y sampling
+	}
+	header.push_back(0);
+
+	putAttribute("compression", "compression", 1);
+	header.push_back(1); // RLE_COMPRESSION
+
+	for (const char* window : { "dataWindow", "displayWindow" }) {
+		putAttribute(window, "box2i", 16);
+		putInt(0);
+		putInt(0);
+		putInt(static_cast<int32_t>(width) - 1);
+		putInt(static_cast<int32_t>(height) - 1);
+	}
+
+	putAttribute("lineOrder", "lineOrder", 1);
+	header.push_back(0); // INCREASING_Y
+
+	putAttribute("pixelAspectRatio", "float", 4);
+	putFloat(1.0f);
+
+	putAttribute("screenWindowCenter", "v2f", 8);
+	putFloat(0.0f);
+	putFloat(0.0f);
+
+	putAttribute("screenWindowWidth", "float", 4);
+	putFloat(1.0f);
+
+	header.push_back(0); // end of header
+
+	// offsets are from the start of the file, each chunk is its y and byte count then the data
+	std::vector<uint64_t> offsets(height);
+	uint64_t offset = header.size() + offsets.size() * sizeof(uint64_t);
+	for (uint32_t y = 0; y < height; y++) {
+		offsets[y] = offset;
+		offset += 2 * sizeof(int32_t) + chunks[y].size();
+	}
+
+	std::filesystem::path filePath(path);
+	if (filePath.has_parent_path()) std::filesystem::create_directories(filePath.parent_path());
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "Failed to open " << path << std::endl;
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(header.data()), header.size());
+	file.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+	for (uint32_t y = 0; y < height; y++) {
+		int32_t chunkHeader[2] = { static_cast<int32_t>(y), static_cast<int32_t>(chunks[y].size()) };
+		file.write(reinterpret_cast<const char*>(chunkHeader), sizeof(chunkHeader));
+		file.write(reinterpret_cast<const char*>(chunks[y].data()), chunks[y].size());
+	}
+
+	if (!file) {
+		std::cerr << "Failed to write " << path << std::endl;
+		return false;
+	}
+
+	std::cout << "Wrote " << path << std::endl;
+	return true;
+}
+
+bool ImageWriter::writeAccumulation(const std::string& path, uint32_t width, uint32_t height, const std::vector<float>& accumulation, float exposure) {
+
+	std::string extension = lowerExtension(path);
+	if (extension == ".exr") return writeEXR(path, width, height, accumulation);
+	if (extension == ".pfm") return writePFM(path, width, height, accumulation);
+
+	ToneMapper toneMapper;
+	std::vector<uint8_t> rgba;
+	toneMapper.apply(accumulation, width, height, exposure, rgba);
+	return writePNG(path, width, height, rgba);
+}
+
+bool ImageWriter::isHDR(const std::string& path) {
+
+	std::string extension = lowerExtension(path);
+	return extension == ".exr" || extension == ".pfm";
+}
+
+std::string ImageWriter::lowerExtension(const std::string& path) {
+
+	std::string extension = std::filesystem::path(path).extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return extension;
+}
+
+void ImageWriter::compressRLE(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+
+	// same steps as OpenEXR's RLE compressor: even bytes then odd bytes, so the exponents of neighbouring floats
+	// end up next to each other, then a byte delta so runs of similar values become runs of equal bytes
+	std::vector<uint8_t> reordered(size);
+	size_t half = (size + 1) / 2;
+	for (size_t i = 0; i < size; i++) {
+		reordered[(i & 1) ? half + i / 2 : i / 2] = data[i];
+	}
+	for (size_t i = size - 1; i > 0; i--) {
+		reordered[i] = static_cast<uint8_t>(reordered[i] - reordered[i - 1] + 128);
+	}
+
+	// runs of 3 to 128 equal bytes are a count - 1 and the byte, anything else a negated count and the bytes as they are
+	constexpr ptrdiff_t MIN_RUN = 3;
+	constexpr ptrdiff_t MAX_RUN = 127;
+
+	out.clear();
+	const uint8_t* end = reordered.data() + size;
+	const uint8_t* runStart = reordered.data();
+	const uint8_t* runEnd = runStart + 1;
+
+	while (runStart < end) {
+
+		while (runEnd < end && *runStart == *runEnd && runEnd - runStart - 1 < MAX_RUN) runEnd++;
+
+		if (runEnd - runStart >= MIN_RUN) {
+			out.push_back(static_cast<uint8_t>(runEnd - runStart - 1));
+			out.push_back(*runStart);
+			runStart = runEnd;
+		}
+		else {
+			while (runEnd < end && (runEnd + 1 >= end || *runEnd != *(runEnd + 1) || runEnd + 2 >= end || *(runEnd + 1) != *(runEnd + 2)) && runEnd - runStart < MAX_RUN) runEnd++;
+
+			out.push_back(static_cast<uint8_t>(runStart - runEnd));
+			out.insert(out.end(), runStart, runEnd);
+			runStart = runEnd;
+		}
+
+		runEnd++;
+	}
+}
+
+bool ScanlineWriter::open(const std::string& path, uint32_t width, uint32_t height) {
+
+	this->path = path;
+	this->width = width;
+	this->height = height;
+	rowsWritten = 0;
+	failed = false;
+
+	std::filesystem::path filePath(path);
+	if (filePath.has_parent_path()) std::filesystem::create_directories(filePath.parent_path());
+
+	// every writer thread needs its own COM apartment
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	comInitialized = SUCCEEDED(hr);
+
+	hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+	if (SUCCEEDED(hr)) hr = factory->CreateStream(&stream);
+	if (SUCCEEDED(hr)) hr = stream->InitializeFromFilename(filePath.wstring().c_str(), GENERIC_WRITE);
+	if (SUCCEEDED(hr)) hr = factory->CreateEncoder(GUID_ContainerFormatPng, nullptr, &encoder);
+	if (SUCCEEDED(hr)) hr = encoder->Initialize(stream, WICBitmapEncoderNoCache);
+	if (SUCCEEDED(hr)) hr = encoder->CreateNewFrame(&frame, nullptr);
+	if (SUCCEEDED(hr)) hr = frame->Initialize(nullptr);
+	if (SUCCEEDED(hr)) hr = frame->SetSize(width, height);
+
+	WICPixelFormatGUID format = GUID_WICPixelFormat32bppRGBA;
+	if (SUCCEEDED(hr)) hr = frame->SetPixelFormat(&format);
+	if (SUCCEEDED(hr) && format != GUID_WICPixelFormat32bppRGBA) hr = E_FAIL; // the encoder wants a conversion we don't do
+
+	if (FAILED(hr)) {
+		std::cerr << "Failed to open " << path << " HRESULT 0x" << std::hex << hr << std::dec << std::endl;
+		failed = true;
+		release();
+		return false;
+	}
+	return true;
+}
+
+bool ScanlineWriter::writeRows(uint32_t rows, const uint8_t* rgba) {
+
+	if (!frame || failed) return false;
+
+	// successive WritePixels calls continue where the last one stopped
+	UINT stride = width * 4;
+	HRESULT hr = frame->WritePixels(rows, stride, stride * rows, const_cast<BYTE*>(rgba));
+	if (FAILED(hr)) {
+		std::cerr << "Failed to write rows " << rowsWritten << "-" << rowsWritten + rows << " of " << path << " HRESULT 0x" << std::hex << hr << std::dec << std::endl;
+		failed = true;
+		return false;
+	}
+
+	rowsWritten += rows;
+	return true;
+}
+
+bool ScanlineWriter::close() {
+
+	if (!frame) return !failed;
+
+	bool complete = !failed && rowsWritten == height;
+	if (complete) {
+		HRESULT hr = frame->Commit();
+		if (SUCCEEDED(hr)) hr = encoder->Commit();
+		complete = SUCCEEDED(hr);
+	}
+
+	release();
+
+	if (!complete) {
+		std::cerr << "Failed to write " << path << std::endl;
+		failed = true;
+		return false;
+	}
+
+	std::cout << "Wrote " << path << std::endl;
+	return true;
+}
+
+void ScanlineWriter::release() {
+
+	if (frame) frame->Release();
+	if (encoder) encoder->Release();
+	if (stream) stream->Release();
+	if (factory) factory->Release();
+	frame = nullptr;
+	encoder = nullptr;
+	stream = nullptr;
+	factory = nullptr;
+
+	if (comInitialized) CoUninitialize();
+	comInitialized = false;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+struct IWICImagingFactory;
+struct IWICStream;
+struct IWICBitmapEncoder;
+struct IWICBitmapFrameEncode;
+
+// Encodes images read back from the renderer on whatever thread calls it, so file output can overlap rendering.
+// The HDR formats take the raw accumulation, rgb sum and sample count per pixel, and divide on the way out.
+
+class ImageWriter {
+public:
+
+	static bool writePNG(const std::string& path, uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba);
+	static bool writePFM(const std::string& path, uint32_t width, uint32_t height, const std::vector<float>& accumulation);
+	static bool writeEXR(const std::string& path, uint32_t width, uint32_t height, const std::vector<float>& accumulation); // fp32 rgb, RLE
+	static bool writeAccumulation(const std::string& path, uint32_t width, uint32_t height, const std::vector<float>& accumulation, float exposure); // by extension, anything not HDR is tone mapped to PNG at exposure
+
+	static bool isHDR(const std::string& path); // .exr or .pfm
+
+private:
+
+	static std::string lowerExtension(const std::string& path);
+
+	static void compressRLE(const uint8_t* data, size_t size, std::vector<uint8_t>& out); // one EXR scanline chunk
+};
+
+// PNG written a band of rows at a time, top to bottom. Only the encoder's own buffers are held,
+// so images far larger than memory can be written as they are rendered.
+
+class ScanlineWriter {
+public:
+
+	ScanlineWriter() {};
+	~ScanlineWriter() { close(); };
+
+	ScanlineWriter(const ScanlineWriter&) = delete;
+	ScanlineWriter& operator=(const ScanlineWriter&) = delete;
+
+	bool open(const std::string& path, uint32_t width, uint32_t height);
+	bool writeRows(uint32_t rows, const uint8_t* rgba); // tightly packed rgba8
+	bool close(); // false if the image is incomplete or anything failed
+
+private:
+
+	void release();
+
+	std::string path;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t rowsWritten = 0;
+	bool failed = false;
+	bool comInitialized = false;
+
+	IWICImagingFactory* factory = nullptr;
+	IWICStream* stream = nullptr;
+	IWICBitmapEncoder* encoder = nullptr;
+	IWICBitmapFrameEncode* frame = nullptr;
+};
@@ -35,6 +35,9 @@ void InputManager::processInput(SDL_Event& event) {
 		if (event.key.scancode == SDL_SCANCODE_F1) {
 			UI::renderUI = UI::renderUI ? false : true;
 		}
+		if (event.key.scancode == SDL_SCANCODE_F12) {
+			UI::saveSnapshot = true;
+		}
 	}
 
 
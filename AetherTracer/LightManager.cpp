@@ -0,0 +1,345 @@
+#include "LightManager.h"
+
+#include <DirectXMath.h>
+#include <numbers>
+#include <cmath>
+
+static constexpr float PI = static_cast<float>(std::numbers::pi);
+static constexpr int NUM_BUCKETS = 12;
+
+void LightManager::build() {
+
+	emissiveTriangles.clear();
+	emitters.clear();
+	lightTriangles.clear();
+	lightNodes.clear();
+
+	// gather emissive triangles from every entity with an emissive material
+	for (size_t i = 0; i < entityManager->count(); i++) {
+
+		MaterialManager::Material* material = entityManager->materials[i];
+		if (material == nullptr || material->emission <= 0.0f) continue;
+
+		auto it = meshManager->loadedModels.find(entityManager->modelName(static_cast<EntityManager::Handle>(i)));
+		if (it == meshManager->loadedModels.end()) continue;
+
+		emitters.push_back({ i, entityManager->positions[i], entityManager->rotations[i] });
+
+		for (MeshManager::Mesh& mesh : it->second->meshes) {
+			for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+
+				const MeshManager::Vertex& v0 = mesh.vertices[mesh.indices[t + 0]];
+				const MeshManager::Vertex& v1 = mesh.vertices[mesh.indices[t + 1]];
+				const MeshManager::Vertex& v2 = mesh.vertices[mesh.indices[t + 2]];
+
+				PT::Vector3 geometricNormal = PT::Cross(v1.position - v0.position, v2.position - v0.position);
+				if (PT::Dot(geometricNormal, geometricNormal) <= 0.0f) continue; // degenerate
+
+				// the shader derives the emitting side from the winding, flip it to agree with the vertex normals
+				PT::Vector3 vertexNormal = v0.normal + v1.normal + v2.normal;
+				EmissiveTriangle triangle = { i, { v0.position, v1.position, v2.position } };
+				if (PT::Dot(geometricNormal, vertexNormal) < 0.0f) std::swap(triangle.local[1], triangle.local[2]);
+
+				emissiveTriangles.push_back(triangle);
+			}
+		}
+	}
+
+	lightTriangles.resize(emissiveTriangles.size());
+
+	std::vector<BuildItem> items;
+	items.reserve(emissiveTriangles.size());
+
+	for (size_t i = 0; i < emissiveTriangles.size(); i++) {
+		transformTriangle(i);
+		LightBounds bounds = triangleBounds(i);
+		if (bounds.power > 0.0f) items.push_back({ static_cast<uint32_t>(i), bounds });
+	}
+
+	std::cout << "Light BVH: " << emitters.size() << " emitters, " << items.size() << " emissive triangles" << std::endl;
+
+	if (items.empty()) return;
+
+	lightNodes.reserve(items.size() * 2 - 1);
+	LightBounds rootBounds;
+	buildNode(items, 0, items.size(), rootBounds);
+}
+
+uint32_t LightManager::buildNode(std::vector<BuildItem>& items, size_t start, size_t end, LightBounds& outBounds) {
+
+	uint32_t nodeIndex = static_cast<uint32_t>(lightNodes.size());
+	lightNodes.push_back({});
+
+	// one triangle per leaf so the traversal pmf is exact
+	if (end - start == 1) {
+		outBounds = items[start].bounds;
+		writeNode(lightNodes[nodeIndex], outBounds);
+		lightNodes[nodeIndex].secondChild = items[start].triangle;
+		lightNodes[nodeIndex].isLeaf = 1;
+		return nodeIndex;
+	}
+
+	LightBounds bounds = items[start].bounds;
+	PT::Vector3 centroidMin = (bounds.boundsMin + bounds.boundsMax) * 0.5f;
+	PT::Vector3 centroidMax = centroidMin;
+
+	for (size_t i = start + 1; i < end; i++) {
+		bounds = unionBounds(bounds, items[i].bounds);
+		PT::Vector3 centroid = (items[i].bounds.boundsMin + items[i].bounds.boundsMax) * 0.5f;
+		centroidMin = PT::Min(centroidMin, centroid);
+		centroidMax = PT::Max(centroidMax, centroid);
+	}
+
+	// surface area orientation heuristic, bucketed along each axis
+	float minCost = INFINITY;
+	int minDim = -1;
+	int minBucket = -1;
+
+	for (int dim = 0; dim < 3; dim++) {
+
+		float cMin = (&centroidMin.x)[dim];
+		float cMax = (&centroidMax.x)[dim];
+		if (cMax == cMin) continue;
+
+		LightBounds buckets[NUM_BUCKETS];
+		bool bucketUsed[NUM_BUCKETS] = {};
+
+		for (size_t i = start; i < end; i++) {
+			float centroid = ((&items[i].bounds.boundsMin.x)[dim] + (&items[i].bounds.boundsMax.x)[dim]) * 0.5f;
+			int b = std::min(static_cast<int>(NUM_BUCKETS * (centroid - cMin) / (cMax - cMin)), NUM_BUCKETS - 1);
+			buckets[b] = bucketUsed[b] ? unionBounds(buckets[b], items[i].bounds) : items[i].bounds;
+			bucketUsed[b] = true;
+		}
+
+		for (int split = 0; split < NUM_BUCKETS - 1; split++) {
+
+			LightBounds below, above;
+			bool hasBelow = false, hasAbove = false;
+
+			for (int b = 0; b <= split; b++) {
+				if (!bucketUsed[b]) continue;
+				below = hasBelow ? unionBounds(below, buckets[b]) : buckets[b];
+				hasBelow = true;
+			}
+			for (int b = split + 1; b < NUM_BUCKETS; b++) {
+				if (!bucketUsed[b]) continue;
+				above = hasAbove ? unionBounds(above, buckets[b]) : buckets[b];
+				hasAbove = true;
+			}
+			if (!hasBelow || !hasAbove) continue;
+
+			float cost = evaluateCost(below, bounds.boundsMin, bounds.boundsMax, dim) + evaluateCost(above, bounds.boundsMin, bounds.boundsMax, dim);
+			if (cost < minCost) {
+				minCost = cost;
+				minDim = dim;
+				minBucket = split;
+			}
+		}
+	}
+
+	size_t mid = (start + end) / 2;
+
+	if (minDim != -1) {
+		float cMin = (&centroidMin.x)[minDim];
+		float cMax = (&centroidMax.x)[minDim];
+		auto it = std::partition(items.begin() + start, items.begin() + end, [&](const BuildItem& item) {
+			float centroid = ((&item.bounds.boundsMin.x)[minDim] + (&item.bounds.boundsMax.x)[minDim]) * 0.5f;
+			int b = std::min(static_cast<int>(NUM_BUCKETS * (centroid - cMin) / (cMax - cMin)), NUM_BUCKETS - 1);
+			return b <= minBucket;
+			});
+		mid = it - items.begin();
+		if (mid == start || mid == end) mid = (start + end) / 2;
+	}
+
+	LightBounds left, right;
+	buildNode(items, start, mid, left);
+	uint32_t rightIndex = buildNode(items, mid, end, right);
+
+	outBounds = unionBounds(left, right);
+	writeNode(lightNodes[nodeIndex], outBounds);
+	lightNodes[nodeIndex].secondChild = rightIndex;
+	lightNodes[nodeIndex].isLeaf = 0;
+
+	return nodeIndex;
+}
+
+void LightManager::refit() {
+
+	for (size_t i = 0; i < emissiveTriangles.size(); i++) {
+		transformTriangle(i);
+	}
+
+	// children are always stored after their parent, walk backwards
+	for (size_t i = lightNodes.size(); i-- > 0;) {
+
+		LightNode& node = lightNodes[i];
+
+		if (node.isLeaf) {
+			writeNode(node, triangleBounds(node.secondChild));
+		}
+		else {
+			writeNode(node, unionBounds(nodeBounds(lightNodes[i + 1]), nodeBounds(lightNodes[node.secondChild])));
+		}
+	}
+}
+
+bool LightManager::update() {
+
+	bool moved = false;
+
+	for (EmitterState& emitter : emitters) {
+
+		const PT::Vector3& position = entityManager->positions[emitter.entityIndex];
+		const PT::Vector3& rotation = entityManager->rotations[emitter.entityIndex];
+
+		if (position.x != emitter.position.x || position.y != emitter.position.y || position.z != emitter.position.z ||
+			rotation.x != emitter.rotation.x || rotation.y != emitter.rotation.y || rotation.z != emitter.rotation.z) {
+			emitter.position = position;
+			emitter.rotation = rotation;
+			moved = true;
+		}
+	}
+
+	if (moved) refit();
+
+	return moved;
+}
+
+void LightManager::transformTriangle(size_t triangle) {
+
+	using namespace DirectX;
+
+	EmissiveTriangle& emissive = emissiveTriangles[triangle];
+	const PT::Vector3& position = entityManager->positions[emissive.entityIndex];
+	const PT::Vector3& rotation = entityManager->rotations[emissive.entityIndex];
+
+	// same transform as EntityManager::updateTransforms
+	XMMATRIX transform = XMMatrixRotationRollPitchYaw(rotation.x, rotation.y, rotation.z);
+	transform *= XMMatrixTranslation(position.x, position.y, position.z);
+
+	PT::Vector3 world[3];
+	for (int i = 0; i < 3; i++) {
+		XMFLOAT3 local = { emissive.local[i].x, emissive.local[i].y, emissive.local[i].z };
+		XMFLOAT3 out;
+		XMStoreFloat3(&out, XMVector3TransformCoord(XMLoadFloat3(&local), transform));
+		world[i] = { out.x, out.y, out.z };
+	}
+
+	MaterialManager::Material* material = entityManager->materials[emissive.entityIndex];
+
+	LightTriangle& lightTriangle = lightTriangles[triangle];
+	lightTriangle.p0 = world[0];
+	lightTriangle.p1 = world[1];
+	lightTriangle.p2 = world[2];
+	lightTriangle.emission = material->color * material->emission;
+}
+
+LightManager::LightBounds LightManager::triangleBounds(size_t triangle) {
+
+	const LightTriangle& lightTriangle = lightTriangles[triangle];
+
+	PT::Vector3 cross = PT::Cross(lightTriangle.p1 - lightTriangle.p0, lightTriangle.p2 - lightTriangle.p0);
+	float length = PT::Length(cross);
+	float area = 0.5f * length;
+
+	const PT::Vector3& e = lightTriangle.emission;
+	float luminance = 0.2126f * e.x + 0.7152f * e.y + 0.0722f * e.z;
+
+	LightBounds bounds;
+	bounds.boundsMin = PT::Min(lightTriangle.p0, PT::Min(lightTriangle.p1, lightTriangle.p2));
+	bounds.boundsMax = PT::Max(lightTriangle.p0, PT::Max(lightTriangle.p1, lightTriangle.p2));
+	bounds.axis = length > 0.0f ? cross / length : PT::Vector3{ 0, 1, 0 };
+	bounds.power = length > 0.0f ? PI * area * luminance : 0.0f; // one sided lambertian emitter
+	bounds.cosTheta_o = 1.0f;
+	bounds.cosTheta_e = 0.0f; // cos(pi / 2)
+	return bounds;
+}
+
+LightManager::LightBounds LightManager::nodeBounds(const LightNode& node) {
+
+	LightBounds bounds;
+	bounds.boundsMin = node.boundsMin;
+	bounds.boundsMax = node.boundsMax;
+	bounds.axis = node.axis;
+	bounds.power = node.power;
+	bounds.cosTheta_o = node.cosTheta_o;
+	bounds.cosTheta_e = node.cosTheta_e;
+	return bounds;
+}
+
+void LightManager::writeNode(LightNode& node, const LightBounds& bounds) {
+
+	node.boundsMin = bounds.boundsMin;
+	node.boundsMax = bounds.boundsMax;
+	node.axis = bounds.axis;
+	node.power = bounds.power;
+	node.cosTheta_o = bounds.cosTheta_o;
+	node.cosTheta_e = bounds.cosTheta_e;
+}
+
+LightManager::LightBounds LightManager::unionBounds(const LightBounds& a, const LightBounds& b) {
+
+	if (a.power == 0.0f) return b;
+	if (b.power == 0.0f) return a;
+
+	LightBounds result;
+	result.boundsMin = PT::Min(a.boundsMin, b.boundsMin);
+	result.boundsMax = PT::Max(a.boundsMax, b.boundsMax);
+	result.power = a.power + b.power;
+	result.cosTheta_e = std::min(a.cosTheta_e, b.cosTheta_e);
+
+	// union of the two normal cones
+	float theta_a = std::acos(std::clamp(a.cosTheta_o, -1.0f, 1.0f));
+	float theta_b = std::acos(std::clamp(b.cosTheta_o, -1.0f, 1.0f));
+	float theta_d = std::acos(std::clamp(PT::Dot(a.axis, b.axis), -1.0f, 1.0f));
+
+	if (std::min(theta_d + theta_b, PI) <= theta_a) {
+		result.axis = a.axis;
+		result.cosTheta_o = a.cosTheta_o;
+		return result;
+	}
+	if (std::min(theta_d + theta_a, PI) <= theta_b) {
+		result.axis = b.axis;
+		result.cosTheta_o = b.cosTheta_o;
+		return result;
+	}
+
+	float theta_o = (theta_a + theta_d + theta_b) * 0.5f;
+	PT::Vector3 rotationAxis = PT::Cross(a.axis, b.axis);
+
+	if (theta_o >= PI || PT::Dot(rotationAxis, rotationAxis) == 0.0f) {
+		result.axis = a.axis;
+		result.cosTheta_o = -1.0f; // whole sphere
+		return result;
+	}
+
+	// rotate a's axis towards b's by theta_r (Rodrigues, rotation axis is perpendicular to a.axis)
+	float theta_r = theta_o - theta_a;
+	PT::Vector3 k = PT::Normalize(rotationAxis);
+	result.axis = PT::Normalize(a.axis * std::cos(theta_r) + PT::Cross(k, a.axis) * std::sin(theta_r));
+	result.cosTheta_o = std::cos(theta_o);
+	return result;
+}
+
+float LightManager::evaluateCost(const LightBounds& bounds, const PT::Vector3& parentMin, const PT::Vector3& parentMax, int dim) {
+
+	float theta_o = std::acos(std::clamp(bounds.cosTheta_o, -1.0f, 1.0f));
+	float theta_e = std::acos(std::clamp(bounds.cosTheta_e, -1.0f, 1.0f));
+	float theta_w = std::min(theta_o + theta_e, PI);
+	float sinTheta_o = std::sqrt(std::max(0.0f, 1.0f - bounds.cosTheta_o * bounds.cosTheta_o));
+
+	// solid angle measure of the orientation bounds
+	float M_omega = 2.0f * PI * (1.0f - bounds.cosTheta_o) +
+		PI / 2.0f * (2.0f * theta_w * sinTheta_o - std::cos(theta_o - 2.0f * theta_w) - 2.0f * theta_o * sinTheta_o + bounds.cosTheta_o);
+
+	// penalise thin slabs along the split axis
+	PT::Vector3 parentDiagonal = parentMax - parentMin;
+	float maxExtent = std::max(parentDiagonal.x, std::max(parentDiagonal.y, parentDiagonal.z));
+	float dimExtent = (&parentDiagonal.x)[dim];
+	float Kr = dimExtent > 0.0f ? maxExtent / dimExtent : 1.0f;
+
+	PT::Vector3 d = bounds.boundsMax - bounds.boundsMin;
+	float surfaceArea = 2.0f * (d.x * d.y + d.x * d.z + d.y * d.z);
+
+	return bounds.power * M_omega * Kr * surfaceArea;
+}
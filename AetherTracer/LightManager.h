@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Vector.h"
+#include "EntityManager.h"
+#include "MeshManager.h"
+
+// Light BVH over every emissive triangle in the scene.
+// Nodes store a bounding box, a bounding cone of emission directions and the total power below them,
+// the shader walks the tree and picks children in proportion to their estimated contribution at the shading point.
+
+class LightManager {
+public:
+
+	// matches LightTriangle in raytracingshader.hlsl
+	struct LightTriangle {
+		PT::Vector3 p0;
+		PT::Vector3 p1;
+		PT::Vector3 p2; // winding faces the emitting side
+		PT::Vector3 emission;
+	};
+
+	// matches LightNode in raytracingshader.hlsl
+	struct LightNode {
+		PT::Vector3 boundsMin;
+		float power;
+		PT::Vector3 boundsMax;
+		float cosTheta_o; // spread of the normals
+		PT::Vector3 axis;
+		float cosTheta_e; // emission falloff around the normals
+		uint32_t secondChild; // interior: right child, the left child is the next node. leaf: triangle index
+		uint32_t isLeaf;
+	};
+
+	LightManager(EntityManager* entityManager, MeshManager* meshManager) : entityManager(entityManager), meshManager(meshManager) {};
+	~LightManager() {};
+
+	void build();
+	void refit();
+	bool update(); // refit if an emitter moved, returns true if the light buffers need uploading
+
+	std::vector<LightTriangle> lightTriangles;
+	std::vector<LightNode> lightNodes;
+
+	EntityManager* entityManager;
+	MeshManager* meshManager;
+
+private:
+
+	struct LightBounds {
+		PT::Vector3 boundsMin;
+		PT::Vector3 boundsMax;
+		PT::Vector3 axis;
+		float power = 0.0f;
+		float cosTheta_o = 1.0f;
+		float cosTheta_e = 0.0f;
+	};
+
+	struct BuildItem {
+		uint32_t triangle;
+		LightBounds bounds;
+	};
+
+	// emissive triangle in object space, transformed again on every refit
+	struct EmissiveTriangle {
+		size_t entityIndex;
+		PT::Vector3 local[3];
+	};
+
+	struct EmitterState {
+		size_t entityIndex;
+		PT::Vector3 position;
+		PT::Vector3 rotation;
+	};
+
+	uint32_t buildNode(std::vector<BuildItem>& items, size_t start, size_t end, LightBounds& outBounds);
+
+	void transformTriangle(size_t triangle);
+	LightBounds triangleBounds(size_t triangle);
+	LightBounds nodeBounds(const LightNode& node);
+	void writeNode(LightNode& node, const LightBounds& bounds);
+
+	static LightBounds unionBounds(const LightBounds& a, const LightBounds& b);
+	static float evaluateCost(const LightBounds& bounds, const PT::Vector3& parentMin, const PT::Vector3& parentMax, int dim);
+
+	std::vector<EmissiveTriangle> emissiveTriangles;
+	std::vector<EmitterState> emitters;
+};
@@ -1,8 +1,60 @@
 ﻿#pragma once
 
 #include "AetherTracer.h"
+#include "Config.h"
+#include "EntityManager.h"
+#include "MaterialManager.h"
+#include "RenderCoordinator.h"
+#include "BatchRenderer.h"
+#include "SequenceRenderer.h"
+#include "TiledRenderer.h"
+#include "TextureBaker.h"
+#include "PreviewViewer.h"
 
-int main() {
+int main(int argc, char* argv[]) {
+
+	parseArguments(config, argc, argv);
+
+	// the viewer has no scene or device, only the stream
+	if (!config.viewerAddress.empty()) {
+		PreviewViewer viewer;
+		return viewer.run(config.viewerAddress);
+	}
+
+	// the coordinator only needs the scene description, workers do the rendering
+	if (!config.coordinatorAddress.empty()) {
+		auto materialManager = new MaterialManager{};
+		materialManager->initDefaultMaterials();
+		auto entityManager = new EntityManager{ materialManager };
+		entityManager->initScene();
+
+		RenderCoordinator coordinator{ entityManager };
+		return coordinator.run();
+	}
+
+	if (config.bakeTextures) {
+		MaterialManager materialManager;
+		materialManager.initTextures();
+
+		TextureBaker baker;
+		baker.bakeMaterialTextures(&materialManager);
+		return 0;
+	}
+
+	if (!config.batchPath.empty()) {
+		BatchRenderer batch{ config.batchPath };
+		return batch.run();
+	}
+
+	if (!config.animationPath.empty()) {
+		SequenceRenderer sequence{ config.animationPath };
+		return sequence.run();
+	}
+
+	if (config.tiledWidth > 0 && config.tiledHeight > 0) {
+		TiledRenderer tiled{ config.tiledWidth, config.tiledHeight };
+		return tiled.run();
+	}
 
 	auto aetherTracer = new AetherTracer{};
 
@@ -70,11 +70,27 @@ public:
 		normal["Portal Gun"] = "portal_gun_normal.png";
 	}
 
+	// materials that exist get the maps named for them, once the texture files are loaded
+	void assignTextureMaps() {
+
+		auto assign = [this](const std::unordered_map<std::string, std::string>& maps, std::string Material::* field) {
+			for (auto const& [name, file] : maps) {
+				auto material = materials.find(name);
+				if (material != materials.end()) material->second->*field = file;
+			}
+		};
+		assign(albedos, &Material::textureMap);
+		assign(roughness, &Material::roughnessMap);
+		assign(metallic, &Material::metallicMap);
+		assign(emissive, &Material::emissionMap);
+		assign(normal, &Material::normalMap);
+	}
+
 	void cleanUp() {
 		for (auto const& [name, material] : materials) {
-			materials.erase(name);
 			delete material;
 		}
+		materials.clear();
 	
 	}
 
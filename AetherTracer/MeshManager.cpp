@@ -128,8 +128,8 @@ void MeshManager::loadFromObject(const std::string& fileName, bool forceOpaque,
 void MeshManager::cleanUp() {
     
     for (auto const& [name, model] : loadedModels) {
-        loadedModels.erase(name);
         delete model;
     }
+    loadedModels.clear();
 
 }
\ No newline at end of file
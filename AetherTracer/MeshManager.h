@@ -43,7 +43,9 @@ class MeshManager {
 public:
 
 	MeshManager() {}
-	~MeshManager() {}
+	~MeshManager() {
+		cleanUp();
+	}
 
 	struct Vertex {
 		PT::Vector3 position;
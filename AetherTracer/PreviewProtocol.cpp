@@ -0,0 +1,154 @@
+#include "PreviewProtocol.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace PreviewProtocol {
+
+	namespace {
+
+		// levels spread over the whole 0-255 range so white stays white at any quantization
+		uint32_t quantize(uint32_t value, uint32_t maxLevel) { return (value * maxLevel + 127) / 255; }
+		uint8_t dequantize(uint32_t level, uint32_t maxLevel) { return static_cast<uint8_t>((level * 255 + maxLevel / 2) / maxLevel); }
+
+		struct BitWriter {
+
+			std::vector<uint8_t>& out;
+			uint64_t bits = 0;
+			uint32_t count = 0;
+
+			void put(uint32_t value, uint32_t n) { // n <= 32
+				bits |= static_cast<uint64_t>(value) << count;
+				count += n;
+				while (count >= 8) {
+					out.push_back(static_cast<uint8_t>(bits));
+					bits >>= 8;
+					count -= 8;
+				}
+			}
+
+			void flush() {
+				if (count > 0) out.push_back(static_cast<uint8_t>(bits));
+				bits = 0;
+				count = 0;
+			}
+		};
+
+		struct BitReader {
+
+			const uint8_t* data;
+			size_t size;
+			size_t position = 0;
+			uint64_t bits = 0;
+			uint32_t count = 0;
+
+			bool get(uint32_t n, uint32_t& value) { // n <= 32
+				while (count < n && position < size) {
+					bits |= static_cast<uint64_t>(data[position++]) << count;
+					count += 8;
+				}
+				if (count < n) return false;
+				value = static_cast<uint32_t>(bits & ((uint64_t(1) << n) - 1));
+				bits >>= n;
+				count -= n;
+				return true;
+			}
+		};
+	}
+
+	TileRect tileRect(uint32_t tileX, uint32_t tileY, uint32_t width, uint32_t height) {
+
+		uint32_t x = tileX * TILE_SIZE;
+		uint32_t y = tileY * TILE_SIZE;
+		return { x, y, std::min(TILE_SIZE, width - x), std::min(TILE_SIZE, height - y) };
+	}
+
+	bool tileChanged(const uint8_t* image, const uint8_t* reference, uint32_t width, const TileRect& rect, int threshold) {
+
+		for (uint32_t y = rect.y; y < rect.y + rect.height; y++) {
+			size_t row = (static_cast<size_t>(y) * width + rect.x) * 3;
+			for (uint32_t i = 0; i < rect.width * 3; i++) {
+				if (std::abs(static_cast<int>(image[row + i]) - static_cast<int>(reference[row + i])) > threshold) return true;
+			}
+		}
+		return false;
+	}
+
+	void encodeTile(const uint8_t* image, uint8_t* reference, uint32_t width, const TileRect& rect, uint32_t quantization, TileHeader& header, std::vector<uint8_t>& out) {
+
+		uint32_t maxLevel = 255u >> quantization;
+		uint32_t levels = maxLevel + 1; // a power of two, residuals wrap around it
+		uint32_t half = levels / 2;
+
+		// zigzag residuals, small either side of zero become small codes
+		uint32_t codes[TILE_SIZE * TILE_SIZE * 3];
+		uint32_t count = 0;
+		for (uint32_t y = rect.y; y < rect.y + rect.height; y++) {
+			size_t row = (static_cast<size_t>(y) * width + rect.x) * 3;
+			for (uint32_t i = 0; i < rect.width * 3; i++) {
+				uint32_t level = quantize(image[row + i], maxLevel);
+				uint32_t residual = (level - quantize(reference[row + i], maxLevel)) & maxLevel;
+				codes[count++] = residual < half ? residual * 2 : (levels - residual) * 2 - 1;
+				reference[row + i] = dequantize(level, maxLevel);
+			}
+		}
+
+		// Rice parameter with the fewest bits for this tile, quotient in unary then k low bits
+		uint32_t bestK = 0;
+		uint64_t bestBits = ~uint64_t(0);
+		for (uint32_t k = 0; k < 8; k++) {
+			uint64_t bits = 0;
+			for (uint32_t i = 0; i < count; i++) bits += (codes[i] >> k) + 1 + k;
+			if (bits < bestBits) {
+				bestBits = bits;
+				bestK = k;
+			}
+		}
+
+		size_t start = out.size();
+		BitWriter writer{ out };
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t quotient = codes[i] >> bestK;
+			for (; quotient >= 31; quotient -= 31) writer.put(0x7fffffffu, 31);
+			writer.put((1u << quotient) - 1, quotient + 1); // ones then the terminating zero
+			if (bestK > 0) writer.put(codes[i] & ((1u << bestK) - 1), bestK);
+		}
+		writer.flush();
+
+		header.x = static_cast<uint16_t>(rect.x / TILE_SIZE);
+		header.y = static_cast<uint16_t>(rect.y / TILE_SIZE);
+		header.riceParameter = bestK;
+		header.size = static_cast<uint32_t>(out.size() - start);
+	}
+
+	bool decodeTile(const uint8_t* data, const TileHeader& header, uint8_t* reference, uint32_t width, const TileRect& rect, uint32_t quantization) {
+
+		uint32_t maxLevel = 255u >> quantization;
+		uint32_t levels = maxLevel + 1;
+		uint32_t k = header.riceParameter;
+		if (k >= 8) return false;
+
+		BitReader reader{ data, header.size };
+		for (uint32_t y = rect.y; y < rect.y + rect.height; y++) {
+			size_t row = (static_cast<size_t>(y) * width + rect.x) * 3;
+			for (uint32_t i = 0; i < rect.width * 3; i++) {
+
+				uint32_t quotient = 0;
+				uint32_t bit = 1;
+				while (true) {
+					if (!reader.get(1, bit)) return false;
+					if (bit == 0) break;
+					if (++quotient >= levels) return false;
+				}
+				uint32_t low = 0;
+				if (k > 0 && !reader.get(k, low)) return false;
+
+				uint32_t code = (quotient << k) | low;
+				uint32_t residual = code & 1 ? levels - (code + 1) / 2 : code / 2;
+				uint32_t level = (quantize(reference[row + i], maxLevel) + residual) & maxLevel;
+				reference[row + i] = dequantize(level, maxLevel);
+			}
+		}
+		return true;
+	}
+}
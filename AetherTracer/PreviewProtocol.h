@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Messages between a renderer streaming its preview and a thin viewer.
+// The server sends the frame format once and again whenever it changes, then frames made of the tiles that moved
+// further than the threshold from what the viewer already shows. Tiles are rgb8 quantized to 8 - quantization bits,
+// coded as the residual against the viewer's copy: zigzag, then Rice with a parameter picked per tile. Both ends
+// keep that copy in step by decoding the residuals the same way. The viewer sends its camera input back on the
+// same socket.
+
+namespace PreviewProtocol {
+
+	enum MessageType : uint32_t {
+		MSG_FORMAT = 1,
+		MSG_FRAME = 2,
+		MSG_INPUT = 3
+	};
+
+	static constexpr uint32_t TILE_SIZE = 32;
+
+	struct FormatMessage {
+		uint32_t width;
+		uint32_t height;
+		uint32_t quantization; // low bits dropped from every channel
+	}; // the viewer's copy starts out black
+
+	struct FrameHeader {
+		uint32_t frame;
+		uint32_t iterations; // samples per pixel
+		uint32_t tileCount;
+	}; // followed by tileCount TileHeaders, each followed by its data
+
+	struct TileHeader {
+		uint16_t x; // in tiles
+		uint16_t y;
+		uint32_t riceParameter;
+		uint32_t size;
+	};
+
+	enum InputKey : uint32_t {
+		KEY_FORWARD = 1 << 0,
+		KEY_BACK = 1 << 1,
+		KEY_LEFT = 1 << 2,
+		KEY_RIGHT = 1 << 3,
+		KEY_UP = 1 << 4,
+		KEY_DOWN = 1 << 5
+	};
+
+	struct InputMessage {
+		uint32_t keys; // InputKey bits held for deltaTime
+		float deltaTime; // seconds
+		float mouseX; // relative motion while the viewer looks around
+		float mouseY;
+	};
+
+	struct TileRect {
+		uint32_t x; // in pixels
+		uint32_t y;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	// both work on rgb8 images width pixels wide and leave reference as the viewer will have it
+	bool tileChanged(const uint8_t* image, const uint8_t* reference, uint32_t width, const TileRect& rect, int threshold);
+	void encodeTile(const uint8_t* image, uint8_t* reference, uint32_t width, const TileRect& rect, uint32_t quantization, TileHeader& header, std::vector<uint8_t>& out);
+	bool decodeTile(const uint8_t* data, const TileHeader& header, uint8_t* reference, uint32_t width, const TileRect& rect, uint32_t quantization);
+
+	TileRect tileRect(uint32_t tileX, uint32_t tileY, uint32_t width, uint32_t height); // clipped at the image edge
+}
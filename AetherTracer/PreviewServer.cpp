@@ -0,0 +1,209 @@
+#include "PreviewServer.h"
+
+#include "Config.h"
+
+#include <algorithm>
+#include <future>
+#include <iostream>
+#include <cstring>
+
+using namespace PreviewProtocol;
+
+bool PreviewServer::start(const std::string& address) {
+
+	if (!Socket::startup()) return false;
+
+	if (!listener.listen(address)) {
+		std::cerr << "Preview: can't listen on " << address << std::endl;
+		return false;
+	}
+
+	std::cout << "Preview: streaming on " << address << std::endl;
+	server = std::thread(&PreviewServer::serve, this);
+	return true;
+}
+
+void PreviewServer::stop() {
+
+	stopping = true;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		client.shutdown();
+	}
+	frameReady.notify_all();
+
+	if (server.joinable()) server.join();
+	listener.close();
+}
+
+void PreviewServer::submitFrame(std::vector<float>& accumulation, uint32_t width, uint32_t height, uint32_t iterations, float exposure) {
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.swap(accumulation);
+		pendingWidth = width;
+		pendingHeight = height;
+		pendingIterations = iterations;
+		pendingExposure = exposure;
+		hasFrame = true;
+	}
+	frameReady.notify_one();
+}
+
+bool PreviewServer::takeInput(Input& input) {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!hasInput) return false;
+
+	input = this->input;
+	this->input = {};
+	hasInput = false;
+	return true;
+}
+
+void PreviewServer::serve() {
+
+	while (!stopping) {
+
+		// short timeout so stop is noticed
+		Socket socket = listener.accept(250);
+		if (!socket.valid()) continue;
+
+		std::cout << "Preview: viewer connected" << std::endl;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			client = socket;
+			hasFrame = false;
+		}
+
+		// the format goes out with the first frame, the viewer starts from black
+		width = 0;
+		height = 0;
+		clientClosed = false;
+		clientConnected = true;
+		std::thread receiver(&PreviewServer::receiveInput, this, socket);
+
+		uint32_t iterations = 0;
+		while (!stopping && !clientClosed) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				frameReady.wait_for(lock, std::chrono::milliseconds(250), [this]() { return hasFrame || stopping || clientClosed; });
+				if (!hasFrame) continue;
+
+				accumulation.swap(pending);
+				frameWidth = pendingWidth;
+				frameHeight = pendingHeight;
+				iterations = pendingIterations;
+				frameExposure = pendingExposure;
+				hasFrame = false;
+			}
+			if (!sendFrame(socket, iterations)) break;
+		}
+
+		clientConnected = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			socket.shutdown();
+			client = Socket{};
+		}
+		receiver.join();
+		socket.close();
+
+		std::cout << "Preview: viewer disconnected" << std::endl;
+	}
+}
+
+void PreviewServer::receiveInput(Socket socket) {
+
+	uint32_t type = 0;
+	std::vector<uint8_t> data;
+	while (socket.recvMessage(type, data)) {
+
+		if (type != MSG_INPUT || data.size() != sizeof(InputMessage)) continue;
+
+		InputMessage message;
+		memcpy(&message, data.data(), sizeof(message));
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (uint32_t i = 0; i < 6; i++) {
+			if (message.keys & (1u << i)) input.move[i] += message.deltaTime;
+		}
+		input.mouseX += message.mouseX;
+		input.mouseY += message.mouseY;
+		hasInput = true;
+	}
+
+	clientClosed = true;
+	frameReady.notify_all();
+}
+
+bool PreviewServer::sendFrame(Socket& socket, uint32_t iterations) {
+
+	if (accumulation.size() != static_cast<size_t>(frameWidth) * frameHeight * 4) return true;
+
+	uint32_t quantization = static_cast<uint32_t>(std::clamp(config.streamQuantization, 0, 7));
+
+	// below the quantization error a tile would be resent every frame without ever changing on screen
+	uint32_t maxLevel = 255u >> quantization;
+	int threshold = std::max(config.streamThreshold, static_cast<int>((255 + maxLevel - 1) / maxLevel / 2));
+
+	if (frameWidth != width || frameHeight != height) {
+		width = frameWidth;
+		height = frameHeight;
+		reference.assign(static_cast<size_t>(width) * height * 3, 0);
+
+		FormatMessage format = { width, height, quantization };
+		if (!socket.sendMessage(MSG_FORMAT, &format, sizeof(format))) return false;
+	}
+
+	toneMapper.apply(accumulation, width, height, frameExposure, rgba);
+
+	image.resize(static_cast<size_t>(width) * height * 3);
+	for (size_t i = 0; i < static_cast<size_t>(width) * height; i++) {
+		image[i * 3 + 0] = rgba[i * 4 + 0];
+		image[i * 3 + 1] = rgba[i * 4 + 1];
+		image[i * 3 + 2] = rgba[i * 4 + 2];
+	}
+
+	// bands of tile rows, each touches only its own rows of the reference
+	uint32_t tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	uint32_t tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	uint32_t bands = std::max(1u, std::min(std::thread::hardware_concurrency(), tilesY));
+	uint32_t bandRows = (tilesY + bands - 1) / bands;
+
+	std::vector<std::vector<uint8_t>> bandData(bands);
+	std::vector<uint32_t> bandTiles(bands, 0);
+	std::vector<std::future<void>> tasks;
+
+	for (uint32_t band = 0; band < bands; band++) {
+		tasks.push_back(std::async(std::launch::async, [&, band]() {
+			std::vector<uint8_t>& out = bandData[band];
+			for (uint32_t tileY = band * bandRows; tileY < std::min((band + 1) * bandRows, tilesY); tileY++) {
+				for (uint32_t tileX = 0; tileX < tilesX; tileX++) {
+
+					TileRect rect = tileRect(tileX, tileY, width, height);
+					if (!tileChanged(image.data(), reference.data(), width, rect, threshold)) continue;
+
+					size_t at = out.size();
+					out.resize(at + sizeof(TileHeader));
+					TileHeader header;
+					encodeTile(image.data(), reference.data(), width, rect, quantization, header, out);
+					memcpy(out.data() + at, &header, sizeof(header));
+					bandTiles[band]++;
+				}
+			}
+		}));
+	}
+	for (std::future<void>& task : tasks) task.get();
+
+	FrameHeader frame = { frameIndex, iterations, 0 };
+	for (uint32_t tiles : bandTiles) frame.tileCount += tiles;
+	if (frame.tileCount == 0) return true;
+	frameIndex++;
+
+	message.resize(sizeof(FrameHeader));
+	memcpy(message.data(), &frame, sizeof(frame));
+	for (const std::vector<uint8_t>& data : bandData) message.insert(message.end(), data.begin(), data.end());
+
+	return socket.sendMessage(MSG_FRAME, message.data(), message.size());
+}
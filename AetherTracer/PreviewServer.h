@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "Socket.h"
+#include "PreviewProtocol.h"
+#include "ToneMapper.h"
+
+// Streams the converging image to one PreviewViewer at a time. The render thread hands over accumulation readbacks
+// and takes the viewer's camera input, everything else runs on the server's threads: tone mapping, the tile diff
+// against the viewer's copy, compression and the send, so a slow link drops frames instead of slowing the render.
+
+class PreviewServer {
+public:
+
+	struct Input {
+		float move[6]; // seconds each PreviewProtocol::InputKey was held, in bit order
+		float mouseX;
+		float mouseY;
+	};
+
+	PreviewServer() {};
+	~PreviewServer() { stop(); };
+
+	bool start(const std::string& address); // "port" or "unix:path"
+	void stop();
+
+	bool connected() const { return clientConnected; }
+	// replaces a frame not sent yet, the caller gets that one's buffer back so neither side allocates per frame
+	void submitFrame(std::vector<float>& accumulation, uint32_t width, uint32_t height, uint32_t iterations, float exposure);
+	bool takeInput(Input& input); // false if nothing arrived since the last call
+
+private:
+
+	void serve();
+	void receiveInput(Socket socket);
+	bool sendFrame(Socket& socket, uint32_t iterations);
+
+	Socket listener;
+	Socket client;
+	std::thread server;
+	std::atomic<bool> stopping = false;
+	std::atomic<bool> clientConnected = false;
+	std::atomic<bool> clientClosed = false;
+
+	std::mutex mutex;
+	std::condition_variable frameReady;
+	std::vector<float> pending;
+	uint32_t pendingWidth = 0;
+	uint32_t pendingHeight = 0;
+	uint32_t pendingIterations = 0;
+	float pendingExposure = 1.0f;
+	bool hasFrame = false;
+	Input input = {};
+	bool hasInput = false;
+
+	// server thread only
+	ToneMapper toneMapper;
+	std::vector<float> accumulation;
+	uint32_t frameWidth = 0;
+	uint32_t frameHeight = 0;
+	float frameExposure = 1.0f;
+	std::vector<uint8_t> rgba;
+	std::vector<uint8_t> image; // rgb8
+	std::vector<uint8_t> reference; // what the viewer shows
+	std::vector<uint8_t> message;
+	uint32_t width = 0; // of the viewer's copy
+	uint32_t height = 0;
+	uint32_t frameIndex = 0;
+};
@@ -0,0 +1,185 @@
+#include "PreviewViewer.h"
+
+#include "PreviewProtocol.h"
+
+#include <SDL3/SDL.h>
+
+#include <iostream>
+#include <cstring>
+
+using namespace PreviewProtocol;
+
+int PreviewViewer::run(const std::string& address) {
+
+	if (!Socket::startup()) return 1;
+
+	if (!socket.connect(address)) {
+		std::cerr << "Viewer: can't connect to " << address << std::endl;
+		return 1;
+	}
+	std::cout << "Viewer: connected to " << address << std::endl;
+
+	if (!SDL_Init(SDL_INIT_VIDEO)) {
+		std::cerr << "SDL_Init failed: " << SDL_GetError() << std::endl;
+		return 1;
+	}
+
+	SDL_Window* window = SDL_CreateWindow("Aether Viewer", 1280, 720, SDL_WINDOW_RESIZABLE);
+	SDL_Renderer* renderer = window ? SDL_CreateRenderer(window, nullptr) : nullptr;
+	if (!renderer) {
+		std::cerr << "Viewer: can't create a window: " << SDL_GetError() << std::endl;
+		SDL_Quit();
+		return 1;
+	}
+	SDL_SetRenderVSync(renderer, 1);
+
+	connected = true;
+	std::thread receiver(&PreviewViewer::receive, this);
+
+	SDL_Texture* texture = nullptr;
+	uint32_t textureWidth = 0;
+	uint32_t textureHeight = 0;
+	bool looking = false;
+	uint64_t lastTicks = SDL_GetTicksNS();
+	uint64_t rateTicks = lastTicks;
+	uint64_t rateBytes = 0;
+	float kilobytesPerSecond = 0.0f;
+
+	bool quit = false;
+	while (connected && !quit) {
+
+		SDL_Event event;
+		while (SDL_PollEvent(&event)) {
+			if (event.type == SDL_EVENT_QUIT) quit = true;
+
+			// mouse look only while the right button is held, same feel as the renderer's own window
+			if (event.type == SDL_EVENT_MOUSE_BUTTON_DOWN && event.button.button == SDL_BUTTON_RIGHT) {
+				looking = true;
+				SDL_SetWindowRelativeMouseMode(window, true);
+			}
+			if (event.type == SDL_EVENT_MOUSE_BUTTON_UP && event.button.button == SDL_BUTTON_RIGHT) {
+				looking = false;
+				SDL_SetWindowRelativeMouseMode(window, false);
+			}
+		}
+
+		uint64_t ticks = SDL_GetTicksNS();
+		InputMessage input = { 0, static_cast<float>(ticks - lastTicks) * 1e-9f, 0.0f, 0.0f };
+		lastTicks = ticks;
+
+		const bool* keys = SDL_GetKeyboardState(nullptr);
+		if (keys[SDL_SCANCODE_W]) input.keys |= KEY_FORWARD;
+		if (keys[SDL_SCANCODE_S]) input.keys |= KEY_BACK;
+		if (keys[SDL_SCANCODE_A]) input.keys |= KEY_LEFT;
+		if (keys[SDL_SCANCODE_D]) input.keys |= KEY_RIGHT;
+		if (keys[SDL_SCANCODE_SPACE]) input.keys |= KEY_UP;
+		if (keys[SDL_SCANCODE_LCTRL]) input.keys |= KEY_DOWN;
+
+		float mouseX = 0.0f;
+		float mouseY = 0.0f;
+		SDL_GetRelativeMouseState(&mouseX, &mouseY);
+		if (looking) {
+			input.mouseX = mouseX;
+			input.mouseY = mouseY;
+		}
+
+		if (input.keys != 0 || input.mouseX != 0.0f || input.mouseY != 0.0f) {
+			if (!socket.sendMessage(MSG_INPUT, &input, sizeof(input))) break;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (imageChanged && width > 0 && height > 0) {
+
+				if (!texture || textureWidth != width || textureHeight != height) {
+					if (texture) SDL_DestroyTexture(texture);
+					texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_STREAMING, width, height);
+					textureWidth = width;
+					textureHeight = height;
+					SDL_SetWindowSize(window, width, height);
+				}
+				if (texture) SDL_UpdateTexture(texture, nullptr, image.data(), width * 3);
+				imageChanged = false;
+			}
+
+			if (ticks - rateTicks >= 1000000000ull) {
+				kilobytesPerSecond = static_cast<float>(bytesReceived - rateBytes) / 1024.0f / (static_cast<float>(ticks - rateTicks) * 1e-9f);
+				rateBytes = bytesReceived;
+				rateTicks = ticks;
+
+				std::string title = "Aether Viewer - " + std::to_string(iterations) + " spp - " + std::to_string(static_cast<int>(kilobytesPerSecond)) + " KB/s";
+				SDL_SetWindowTitle(window, title.c_str());
+			}
+		}
+
+		SDL_RenderClear(renderer);
+		if (texture) SDL_RenderTexture(renderer, texture, nullptr, nullptr);
+		SDL_RenderPresent(renderer);
+	}
+
+	socket.shutdown();
+	receiver.join();
+	socket.close();
+
+	if (texture) SDL_DestroyTexture(texture);
+	SDL_DestroyRenderer(renderer);
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+
+	std::cout << "Viewer: disconnected" << std::endl;
+	return 0;
+}
+
+void PreviewViewer::receive() {
+
+	uint32_t type = 0;
+	std::vector<uint8_t> message;
+
+	while (socket.recvMessage(type, message)) {
+
+		std::lock_guard<std::mutex> lock(mutex);
+		bytesReceived += message.size() + 2 * sizeof(uint32_t);
+
+		if (type == MSG_FORMAT && message.size() == sizeof(FormatMessage)) {
+			FormatMessage format;
+			memcpy(&format, message.data(), sizeof(format));
+			width = format.width;
+			height = format.height;
+			quantization = format.quantization;
+			image.assign(static_cast<size_t>(width) * height * 3, 0);
+			imageChanged = true;
+			continue;
+		}
+
+		if (type != MSG_FRAME || message.size() < sizeof(FrameHeader)) continue;
+
+		FrameHeader frame;
+		memcpy(&frame, message.data(), sizeof(frame));
+
+		// a tile that doesn't decode leaves the copies out of step, nothing after it can be trusted
+		bool valid = quantization < 8;
+		size_t at = sizeof(FrameHeader);
+		for (uint32_t i = 0; i < frame.tileCount && valid; i++) {
+
+			TileHeader tile;
+			valid = at + sizeof(TileHeader) <= message.size();
+			if (!valid) break;
+			memcpy(&tile, message.data() + at, sizeof(tile));
+			at += sizeof(TileHeader);
+
+			valid = tile.size <= message.size() - at && tile.x * TILE_SIZE < width && tile.y * TILE_SIZE < height
+				&& decodeTile(message.data() + at, tile, image.data(), width, tileRect(tile.x, tile.y, width, height), quantization);
+			at += tile.size;
+		}
+
+		if (!valid) {
+			std::cerr << "Viewer: corrupt frame " << frame.frame << std::endl;
+			break;
+		}
+
+		iterations = frame.iterations;
+		imageChanged = true;
+	}
+
+	connected = false;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include "Socket.h"
+
+// Thin client for a renderer started with --stream. Shows the streamed preview in an SDL window, no device, scene or
+// renderer of its own, and sends WASD / Space / Ctrl and right mouse look back as camera input.
+
+class PreviewViewer {
+public:
+
+	PreviewViewer() {};
+	~PreviewViewer() { socket.close(); };
+
+	int run(const std::string& address); // until the window is closed or the renderer goes away
+
+private:
+
+	void receive();
+
+	Socket socket;
+	std::atomic<bool> connected = false;
+
+	std::mutex mutex;
+	std::vector<uint8_t> image; // rgb8, kept in step with the server's copy
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t quantization = 0;
+	uint32_t iterations = 0;
+	uint64_t bytesReceived = 0;
+	bool imageChanged = false;
+};
@@ -8,6 +8,7 @@ bool debugstage = true;
 RayTracingStage::RayTracingStage(ResourceManager* resourceManager, MeshManager* meshManager, MaterialManager* materialManager, EntityManager* entityManager)
 	: rm(resourceManager), meshManager(meshManager), materialManager(materialManager), entityManager(entityManager) { 
 
+	lightManager = new LightManager(entityManager, meshManager);
 };
 
 void RayTracingStage::initStage() {
@@ -34,7 +35,7 @@ void RayTracingStage::initAccumulationTexture() {
 	accumDesc.Height = rm->height;
 	accumDesc.DepthOrArraySize = 1;
 	accumDesc.MipLevels = 1;
-	accumDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	accumDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT; // alpha holds the per pixel sample count
 	accumDesc.SampleDesc = rm->NO_AA;
 	accumDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
 
@@ -42,9 +43,212 @@ void RayTracingStage::initAccumulationTexture() {
 	checkHR(hr, nullptr, "Create accumulation texture");
 	rm->accumulationTexture->SetName(L"Accumulation Texture");
 
+	// luminance mean and M2, only valid where the accumulation has samples so it never needs clearing
+	accumDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
+	hr = rm->d3dDevice->CreateCommittedResource(&DEFAULT_HEAP, D3D12_HEAP_FLAG_NONE, &accumDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&rm->varianceTexture));
+	checkHR(hr, nullptr, "Create variance texture");
+	rm->varianceTexture->SetName(L"Variance Texture");
 
 }
 
+void RayTracingStage::initAOVTextures() {
+
+	// first hit albedo, normal and depth are running means over the samples so they are never cleared
+	D3D12_RESOURCE_DESC guideDesc = {};
+	guideDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	guideDesc.Width = rm->width;
+	guideDesc.Height = rm->height;
+	guideDesc.DepthOrArraySize = 1;
+	guideDesc.MipLevels = 1;
+	guideDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	guideDesc.SampleDesc = rm->NO_AA;
+	guideDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+
+	HRESULT hr = rm->d3dDevice->CreateCommittedResource(&DEFAULT_HEAP, D3D12_HEAP_FLAG_NONE, &guideDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&rm->albedoTexture));
+	checkHR(hr, nullptr, "Create albedo texture");
+	rm->albedoTexture->SetName(L"Albedo Texture");
+
+	hr = rm->d3dDevice->CreateCommittedResource(&DEFAULT_HEAP, D3D12_HEAP_FLAG_NONE, &guideDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&rm->normalTexture));
+	checkHR(hr, nullptr, "Create normal texture");
+	rm->normalTexture->SetName(L"Normal Texture");
+
+	guideDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	hr = rm->d3dDevice->CreateCommittedResource(&DEFAULT_HEAP, D3D12_HEAP_FLAG_NONE, &guideDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&rm->depthTexture));
+	checkHR(hr, nullptr, "Create depth texture");
+	rm->depthTexture->SetName(L"Depth Texture");
+
+	// instance index << 16 | material index, overwritten by every sample
+	guideDesc.Format = DXGI_FORMAT_R32_UINT;
+	hr = rm->d3dDevice->CreateCommittedResource(&DEFAULT_HEAP, D3D12_HEAP_FLAG_NONE, &guideDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&rm->idTexture));
+	checkHR(hr, nullptr, "Create id texture");
+	rm->idTexture->SetName(L"ID Texture");
+
+	// screen space offset to where the hit was last frame, in uv
+	guideDesc.Format = DXGI_FORMAT_R16G16_FLOAT;
+	hr = rm->d3dDevice->CreateCommittedResource(&DEFAULT_HEAP, D3D12_HEAP_FLAG_NONE, &guideDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&rm->motionTexture));
+	checkHR(hr, nullptr, "Create motion texture");
+	rm->motionTexture->SetName(L"Motion Texture");
+}
+
+void RayTracingStage::initHistoryTextures() {
+
+	// copies of the accumulation, variance, depth and normal from the frame before a camera move
+	ID3D12Resource* sources[4] = { rm->accumulationTexture, rm->varianceTexture, rm->depthTexture, rm->normalTexture };
+	const wchar_t* names[4] = { L"History Accumulation", L"History Variance", L"History Depth", L"History Normal" };
+
+	for (int i = 0; i < 4; i++) {
+		D3D12_RESOURCE_DESC historyDesc = sources[i]->GetDesc();
+		historyDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+		HRESULT hr = rm->d3dDevice->CreateCommittedResource(&DEFAULT_HEAP, D3D12_HEAP_FLAG_NONE, &historyDesc, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, nullptr, IID_PPV_ARGS(&rm->historyTextures[i]));
+		checkHR(hr, nullptr, "Create history texture");
+		rm->historyTextures[i]->SetName(names[i]);
+	}
+}
+
+void RayTracingStage::copyHistory() {
+
+	ID3D12Resource* sources[4] = { rm->accumulationTexture, rm->varianceTexture, rm->depthTexture, rm->normalTexture };
+
+	D3D12_RESOURCE_BARRIER barriers[8] = {};
+	for (int i = 0; i < 4; i++) {
+		barriers[i].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		barriers[i].Transition.pResource = sources[i];
+		barriers[i].Transition.StateBefore = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		barriers[i].Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
+
+		barriers[i + 4].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		barriers[i + 4].Transition.pResource = rm->historyTextures[i];
+		barriers[i + 4].Transition.StateBefore = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+		barriers[i + 4].Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;
+	}
+	rm->cmdList->ResourceBarrier(8, barriers);
+
+	for (int i = 0; i < 4; i++) {
+		rm->cmdList->CopyResource(rm->historyTextures[i], sources[i]);
+	}
+
+	for (int i = 0; i < 8; i++) {
+		std::swap(barriers[i].Transition.StateBefore, barriers[i].Transition.StateAfter);
+	}
+	rm->cmdList->ResourceBarrier(8, barriers);
+}
+
+void RayTracingStage::initAdaptiveBuffers() {
+
+	UINT tilesX = (rm->width + ResourceManager::ADAPTIVE_TILE_SIZE - 1) / ResourceManager::ADAPTIVE_TILE_SIZE;
+	UINT tilesY = (rm->height + ResourceManager::ADAPTIVE_TILE_SIZE - 1) / ResourceManager::ADAPTIVE_TILE_SIZE;
+	rm->numTiles = tilesX * tilesY;
+	rm->activeTiles = rm->numTiles;
+
+	// every tile starts active
+	std::vector<UINT> tileMask(rm->numTiles, 1u);
+	rm->tileMaskBuffer = createBuffers(tileMask.data(), tileMask.size() * sizeof(UINT), D3D12_RESOURCE_STATE_COMMON, true);
+	rm->tileMaskBuffer->defaultBuffers->SetName(L"Tile Mask Buffer");
+	pushBuffer(rm->tileMaskBuffer, tileMask.size() * sizeof(UINT), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+	// the upload side stays zero and is copied in to reset the counter every frame
+	UINT zero = 0;
+	rm->adaptiveCounterBuffer = createBuffers(&zero, sizeof(UINT), D3D12_RESOURCE_STATE_COMMON, true);
+	rm->adaptiveCounterBuffer->defaultBuffers->SetName(L"Adaptive Counter Buffer");
+	pushBuffer(rm->adaptiveCounterBuffer, sizeof(UINT), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+	D3D12_HEAP_PROPERTIES READBACK_HEAP = { .Type = D3D12_HEAP_TYPE_READBACK };
+	D3D12_RESOURCE_DESC desc = {
+		.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+		.Width = sizeof(UINT),
+		.Height = 1,
+		.DepthOrArraySize = 1,
+		.MipLevels = 1,
+		.SampleDesc = rm->NO_AA,
+		.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+	};
+
+	HRESULT hr = rm->d3dDevice->CreateCommittedResource(&READBACK_HEAP, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&rm->adaptiveReadback));
+	checkHR(hr, nullptr, "Create adaptive readback buffer");
+	rm->adaptiveReadback->SetName(L"Adaptive Readback Buffer");
+}
+
+
+void RayTracingStage::initTimestampQueries() {
+
+	// start and end of the dispatch loop, for the cost of one sample pass, then the denoiser's passes
+	D3D12_QUERY_HEAP_DESC queryDesc = {
+		.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP,
+		.Count = ResourceManager::TIMESTAMP_QUERIES,
+	};
+
+	HRESULT hr = rm->d3dDevice->CreateQueryHeap(&queryDesc, IID_PPV_ARGS(&rm->timestampHeap));
+	checkHR(hr, nullptr, "Create timestamp query heap");
+
+	D3D12_HEAP_PROPERTIES READBACK_HEAP = { .Type = D3D12_HEAP_TYPE_READBACK };
+	D3D12_RESOURCE_DESC desc = {
+		.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+		.Width = ResourceManager::TIMESTAMP_QUERIES * sizeof(UINT64),
+		.Height = 1,
+		.DepthOrArraySize = 1,
+		.MipLevels = 1,
+		.SampleDesc = rm->NO_AA,
+		.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+	};
+
+	hr = rm->d3dDevice->CreateCommittedResource(&READBACK_HEAP, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&rm->timestampReadback));
+	checkHR(hr, nullptr, "Create timestamp readback buffer");
+	rm->timestampReadback->SetName(L"Timestamp Readback Buffer");
+
+	rm->cmdQueue->GetTimestampFrequency(&rm->timestampFrequency);
+}
+
+void RayTracingStage::initSamplerBuffers() {
+
+	std::vector<float> mask = BlueNoise::generate(ResourceManager::BLUE_NOISE_SIZE);
+	size_t maskSize = mask.size() * sizeof(float);
+
+	rm->blueNoiseBuffer = createBuffers(mask.data(), maskSize, D3D12_RESOURCE_STATE_COMMON, false);
+	rm->blueNoiseBuffer->uploadBuffers->SetName(L"Blue Noise Upload Buffer");
+	rm->blueNoiseBuffer->defaultBuffers->SetName(L"Blue Noise Default Buffer");
+	pushBuffer(rm->blueNoiseBuffer, maskSize, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+}
+
+bool RayTracingStage::adaptiveSamplingEnabled() {
+	// tile decisions are made between frames, so they would depend on how many passes each frame ran
+	return config.adaptiveSampling && !config.deterministic;
+}
+
+bool RayTracingStage::reprojectionEnabled() {
+	// the reprojected history depends on how far the camera moved between frames
+	return config.temporalReprojection && config.accumulate && !config.deterministic;
+}
+
+UINT RayTracingStage::aovMask() {
+
+	UINT mask = 0;
+	if (config.aovAlbedo) mask |= AOV_ALBEDO;
+	if (config.aovNormal) mask |= AOV_NORMAL;
+	if (config.aovDepth) mask |= AOV_DEPTH;
+	if (config.aovIDs) mask |= AOV_IDS;
+	if (config.aovMotion) mask |= AOV_MOTION;
+
+	// the denoiser, reprojection and the debug view read their AOVs whether or not they were asked for
+	if (config.denoise) mask |= AOV_ALBEDO | AOV_NORMAL | AOV_DEPTH;
+	if (reprojectionEnabled()) mask |= AOV_NORMAL | AOV_DEPTH;
+	if (config.dynamicResolution) mask |= AOV_DEPTH;
+
+	switch (config.aovView) {
+	case AOV_VIEW_ALBEDO: mask |= AOV_ALBEDO; break;
+	case AOV_VIEW_NORMAL: mask |= AOV_NORMAL; break;
+	case AOV_VIEW_DEPTH: mask |= AOV_DEPTH; break;
+	case AOV_VIEW_INSTANCE_ID:
+	case AOV_VIEW_MATERIAL_ID: mask |= AOV_IDS; break;
+	case AOV_VIEW_MOTION: mask |= AOV_MOTION; break;
+	}
+
+	return mask;
+}
+
+bool RayTracingStage::accumulationReset() {
+	return !config.accumulate || entityManager->camera->camMoved || UI::accumulationUpdate || UI::accelUpdate || rm->resolutionChanged;
+}
 
 void RayTracingStage::initModelBuffers() {
 
@@ -202,7 +406,7 @@ void RayTracingStage::initModelBLAS() {
 
 	for (auto& [name, model] : rm->dx12Models) {
 
-		delete model->BLAS;
+		if (model->BLAS) model->BLAS->Release();
 
 		std::cout << "object name: " << name << std::endl;
 
@@ -250,12 +454,36 @@ void RayTracingStage::updateCamera() {
 	EntityManager::Camera* entityCamera = entityManager->camera;
 
 	rm->dx12Camera->position = { entityCamera->position.x, entityCamera->position.y, entityCamera->position.z };
-	rm->dx12Camera->seed = rm->seed;
+	rm->dx12Camera->seed = config.deterministic ? 0u : rm->seed;
 	rm->dx12Camera->sky = config.sky == true ? 1u : 0u;
 	rm->dx12Camera->skyBrighness = config.skyBrightness;
 	rm->dx12Camera->minBounces = config.minBounces;
 	rm->dx12Camera->maxBounces = config.maxBounces;
 	rm->dx12Camera->jitter = config.jitter == true ? 1u : 0u;
+	rm->dx12Camera->numLights = rm->numLightTriangles;
+	rm->dx12Camera->lightSampling = config.lightSampling == true ? 1u : 0u;
+	rm->dx12Camera->adaptiveSampling = adaptiveSamplingEnabled() ? 1u : 0u;
+	rm->dx12Camera->adaptiveMinSamples = static_cast<UINT>(config.adaptiveMinSamples);
+
+	// new scramble for every accumulation, kept while it runs so the sequences stay progressive
+	if (accumulationReset()) rm->sequenceSeed = config.deterministic ? 0u : rm->seed;
+	rm->dx12Camera->samplerType = static_cast<UINT>(config.sampler);
+	rm->dx12Camera->sequenceSeed = rm->sequenceSeed;
+	rm->dx12Camera->sampleOffset = rm->sampleOffset;
+
+	// a tile is a window onto the full image, otherwise the dispatch is the whole image
+	bool tiled = rm->imageWidth > 0 && rm->imageHeight > 0;
+	rm->dx12Camera->tileOriginX = tiled ? rm->tileOriginX : 0u;
+	rm->dx12Camera->tileOriginY = tiled ? rm->tileOriginY : 0u;
+	rm->dx12Camera->imageWidth = tiled ? rm->imageWidth : rm->internalWidth;
+	rm->dx12Camera->imageHeight = tiled ? rm->imageHeight : rm->internalHeight;
+	rm->dx12Camera->aovMask = aovMask();
+
+	// a camera move keeps the samples that can be reprojected, anything else still starts over
+	rm->reprojectHistory = reprojectionEnabled() && entityCamera->camMoved && !UI::accumulationUpdate && !UI::accelUpdate && !rm->resolutionChanged;
+	rm->dx12Camera->reprojectHistory = rm->reprojectHistory ? 1u : 0u;
+	rm->dx12Camera->maxHistory = static_cast<UINT>(config.maxHistory);
+	rm->dx12Camera->depthTolerance = config.historyDepthTolerance;
 
 	PT::Vector3 position = entityCamera->position;
 	PT::Vector3 right = entityCamera->right;
@@ -263,7 +491,7 @@ void RayTracingStage::updateCamera() {
 	PT::Vector3 forward = entityCamera->forward;
 	float fovYDegrees = entityCamera->fovYDegrees;
 	float fovYRad = XMConvertToRadians(fovYDegrees);
-	float aspect = entityCamera->aspect;
+	float aspect = tiled ? static_cast<float>(rm->imageWidth) / rm->imageHeight : entityCamera->aspect;
 
 
 	XMFLOAT3 pos = { position.x, position.y, position.z };
@@ -286,12 +514,18 @@ void RayTracingStage::updateCamera() {
 
 	XMStoreFloat4x4(&rm->dx12Camera->invViewProj, invViewProj);
 
+	// motion vectors project the first hit with last frame's camera
+	if (!rm->hasPrevViewProj) XMStoreFloat4x4(&rm->prevViewProj, viewProj);
+	rm->dx12Camera->prevViewProj = rm->prevViewProj;
+	XMStoreFloat4x4(&rm->prevViewProj, viewProj);
+	rm->hasPrevViewProj = true;
+
 
 	if (!rm->cameraConstantBuffer) {
+		// mapped and written every frame, no upload copy
 		rm->cameraConstantBuffer = new ResourceManager::Buffer{};
-		rm->cameraConstantBuffer = createBuffers(rm->dx12Camera, sizeof(ResourceManager::DX12Camera), D3D12_RESOURCE_STATE_COMMON, false);
-		rm->cameraConstantBuffer->defaultBuffers->SetName(L"Camera Default Buffer");
 		createCBV(rm->cameraConstantBuffer, sizeof(ResourceManager::DX12Camera));
+		rm->cameraConstantBuffer->defaultBuffers->SetName(L"Camera Default Buffer");
 	}
 
 	void* mapped = nullptr;
@@ -310,26 +544,26 @@ void RayTracingStage::initScene() {
 
 	rm->materials.clear();
 
-	for (size_t i = 0; i < entityManager->entitys.size(); i++) {
+	for (EntityManager::Handle entity = 0; entity < entityManager->count(); entity++) {
 
-		EntityManager::Entity* entity = entityManager->entitys[i];
+		MaterialManager::Material* material = entityManager->materials[entity];
 		ResourceManager::DX12Entity* dx12Entity = new ResourceManager::DX12Entity{};
 		dx12Entity->entity = entity;
-		dx12Entity->model = rm->dx12Models[entity->name];
+		dx12Entity->model = rm->dx12Models[entityManager->modelName(entity)];
 
-		std::cout << "Material name: " << entity->material->name << std::endl;
+		std::cout << "Material name: " << material->name << std::endl;
 
 		// create material if it doesn't already exist
-		if (rm->materials.find(entity->material->name) == rm->materials.end()) {
+		if (rm->materials.find(material->name) == rm->materials.end()) {
 			std::cout << "Material doesnt exist " << std::endl;
 
-			ResourceManager::DX12Material* dx12Material = new ResourceManager::DX12Material{ entity->material };
-			rm->materials[entity->material->name] = dx12Material;
+			ResourceManager::DX12Material* dx12Material = new ResourceManager::DX12Material{ material };
+			rm->materials[material->name] = dx12Material;
 			dx12Entity->material = dx12Material;
 		}
 		else {
 			std::cout << "Material exists " << std::endl;
-			dx12Entity->material = rm->materials[entity->material->name];
+			dx12Entity->material = rm->materials[material->name];
 		}
 
 		rm->dx12Entitys.push_back(dx12Entity);
@@ -367,12 +601,13 @@ void RayTracingStage::initScene() {
 		ID3D12Resource* objectBlas = dx12Entity->model->BLAS;
 		objectBlas->GetGPUVirtualAddress();
 
-		if (rm->uniqueInstancesID.find(dx12Entity->entity->name) == rm->uniqueInstancesID.end()) {
+		const std::string& modelName = entityManager->modelName(dx12Entity->entity);
+		if (rm->uniqueInstancesID.find(modelName) == rm->uniqueInstancesID.end()) {
 			instanceID++;
-			rm->uniqueInstancesID[dx12Entity->entity->name] = instanceID;
+			rm->uniqueInstancesID[modelName] = instanceID;
 		}
 		else {
-			instanceID = rm->uniqueInstancesID[dx12Entity->entity->name];
+			instanceID = rm->uniqueInstancesID[modelName];
 		}
 
 		std::cout << "InstanceIndex: " << instanceIndex << std::endl;
@@ -389,34 +624,22 @@ void RayTracingStage::initScene() {
 		instanceIndex++;
 	}
 
-	updateTransforms();
+	// a new instance buffer needs every matrix, not just the ones that changed
+	entityManager->updateTransforms();
+	for (EntityManager::Handle entity = 0; entity < entityManager->count(); entity++) {
+		memcpy(rm->instanceData[entity].Transform, &entityManager->worldMatrices[entity], sizeof(EntityManager::Transform));
+	}
+	entityManager->transformsDirty = false;
 
 }
 
 void RayTracingStage::updateTransforms() {
 
-	//if (debugstage) std::cout << "Update Transforms" << std::endl;
-
-	auto time = static_cast<float>(GetTickCount64()) / 1000.0f;
-
-	size_t currentInstance = 0;
-
-	// apply meshes stored transform
-
-	for (ResourceManager::DX12Entity* dx12Entity : rm->dx12Entitys) {
-
-		auto vecRotation = dx12Entity->entity->rotation;
-		auto vecPosition = dx12Entity->entity->position;
-
-		auto transform = DirectX::XMMatrixRotationRollPitchYaw(vecRotation.x, vecRotation.y, vecRotation.z);
-		//transform = DirectX::XMMatrixRotationRollPitchYaw(time / 2, time / 3, time / 5); // alternative, scale by time
-		transform *= DirectX::XMMatrixTranslation(vecPosition.x, vecPosition.y, vecPosition.z);
-
-		auto* ptr = reinterpret_cast<DirectX::XMFLOAT3X4*>(&rm->instanceData[currentInstance].Transform);
-		XMStoreFloat3x4(ptr, transform);
-
-		currentInstance++;
+	// only the entities that were marked dirty since the last call are rebuilt and copied
+	entityManager->updateTransforms();
 
+	for (EntityManager::Handle entity : entityManager->changedEntities) {
+		memcpy(rm->instanceData[entity].Transform, &entityManager->worldMatrices[entity], sizeof(EntityManager::Transform));
 	}
 
 }
@@ -438,20 +661,21 @@ void RayTracingStage::initMaterialBuffer() {
 
 	for (ResourceManager::DX12Entity* dx12Entity : rm->dx12Entitys) {
 
-		std::cout << "Entity Name: " << dx12Entity->entity->name << std::endl;
+		std::cout << "Entity Name: " << entityManager->modelName(dx12Entity->entity) << std::endl;
 
 		ResourceManager::DX12Material* dx12Mateiral = dx12Entity->material;
-		std::cout << "Material name: " << dx12Entity->entity->material->name << std::endl;
+		const std::string& materialName = entityManager->materials[dx12Entity->entity]->name;
+		std::cout << "Material name: " << materialName << std::endl;
 
-		if (rm->uniqueInstancesID.find(dx12Entity->entity->material->name) == rm->uniqueInstancesID.end()) {
+		if (rm->uniqueInstancesID.find(materialName) == rm->uniqueInstancesID.end()) {
 			instanceIndex = rm->dx12Materials.size();
-			rm->uniqueInstancesID[dx12Entity->entity->material->name] = instanceIndex;
+			rm->uniqueInstancesID[materialName] = instanceIndex;
 			rm->dx12Materials.push_back(*dx12Entity->material);
 			std::cout << "Not in map " << std::endl;
 			std::cout << "instanceIndex: " << instanceIndex << std::endl;
 		}
 		else {
-			instanceIndex = rm->uniqueInstancesID[dx12Entity->entity->material->name];
+			instanceIndex = rm->uniqueInstancesID[materialName];
 			std::cout << "In map " << std::endl;
 			std::cout << "instanceIndex: " << instanceIndex << std::endl;
 		}
@@ -503,7 +727,7 @@ void RayTracingStage::initTopLevelAS() {
 
 	D3D12_RESOURCE_DESC desc = {};
 	desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-	desc.Width = prebuildInfo.ScratchDataSizeInBytes;
+	desc.Width = std::max(prebuildInfo.ScratchDataSizeInBytes, prebuildInfo.UpdateScratchDataSizeInBytes); // kept for refits
 	desc.Height = 1;
 	desc.DepthOrArraySize = 1;
 	desc.MipLevels = 1;
@@ -537,8 +761,29 @@ void RayTracingStage::initTopLevelAS() {
 	flush();
 	rm->cmdAlloc->Reset();
 	rm->cmdList->Reset(rm->cmdAlloc, nullptr);
+}
+
+void RayTracingStage::refitTopLevelAS() {
+
+	// the instance descs live in an upload heap, safe to overwrite since present waits for the previous frame
+	updateTransforms();
 
-	rm->tlasscratch->Release();
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {
+	.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL,
+	.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE,
+	.NumDescs = rm->NUM_INSTANCES,
+	.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY,
+	.InstanceDescs = rm->instances->GetGPUVirtualAddress() };
+
+	// updated in place, the BLASes only move so the bottom level is left alone
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {
+	.DestAccelerationStructureData = rm->tlas->GetGPUVirtualAddress(),
+	.Inputs = inputs,
+	.SourceAccelerationStructureData = rm->tlas->GetGPUVirtualAddress(),
+	.ScratchAccelerationStructureData = rm->tlasscratch->GetGPUVirtualAddress() };
+
+	rm->cmdList->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr);
+	uavBarrier(rm->tlas);
 }
 
 
@@ -551,9 +796,10 @@ void RayTracingStage::initVertexIndexBuffers() {
 	for (ResourceManager::DX12Entity* dx12SceneObject : rm->dx12Entitys) {
 
 
-		if (rm->uniqueInstances.count(dx12SceneObject->entity->name) == 0) {
+		const std::string& modelName = entityManager->modelName(dx12SceneObject->entity);
+		if (rm->uniqueInstances.count(modelName) == 0) {
 
-			rm->uniqueInstances.insert(dx12SceneObject->entity->name);
+			rm->uniqueInstances.insert(modelName);
 			std::vector<ResourceManager::Buffer*> indexBuffers = dx12SceneObject->model->indexBuffers;
 			std::vector<ResourceManager::Buffer*> vertexBuffers = dx12SceneObject->model->vertexBuffers;
 
@@ -569,6 +815,61 @@ void RayTracingStage::initVertexIndexBuffers() {
 
 }
 
+void RayTracingStage::initLightBuffers() {
+
+	if (debugstage) std::cout << "initLightBuffers()" << std::endl;
+
+	lightManager->build();
+
+	rm->numLightNodes = static_cast<UINT>(lightManager->lightNodes.size());
+	rm->numLightTriangles = static_cast<UINT>(lightManager->lightTriangles.size());
+
+	// zero sized buffers are invalid, keep one dummy element when the scene has no emitters
+	if (lightManager->lightNodes.empty()) {
+		lightManager->lightNodes.push_back({});
+		lightManager->lightTriangles.push_back({});
+		rm->numLightTriangles = 0;
+	}
+
+	size_t nodesSize = lightManager->lightNodes.size() * sizeof(LightManager::LightNode);
+	size_t trianglesSize = lightManager->lightTriangles.size() * sizeof(LightManager::LightTriangle);
+
+	rm->lightNodesBuffer = createBuffers(lightManager->lightNodes.data(), nodesSize, D3D12_RESOURCE_STATE_COMMON, false);
+	rm->lightTrianglesBuffer = createBuffers(lightManager->lightTriangles.data(), trianglesSize, D3D12_RESOURCE_STATE_COMMON, false);
+
+	rm->lightNodesBuffer->uploadBuffers->SetName(L"Light Nodes Upload Buffer");
+	rm->lightTrianglesBuffer->uploadBuffers->SetName(L"Light Triangles Upload Buffer");
+	rm->lightNodesBuffer->defaultBuffers->SetName(L"Light Nodes Default Buffer");
+	rm->lightTrianglesBuffer->defaultBuffers->SetName(L"Light Triangles Default Buffer");
+
+	pushBuffer(rm->lightNodesBuffer, nodesSize, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	pushBuffer(rm->lightTrianglesBuffer, trianglesSize, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+}
+
+void RayTracingStage::updateLights() {
+
+	// refit only when an emitter moved, topology and buffer sizes stay the same
+	if (rm->numLightTriangles == 0 || !lightManager->update()) return;
+
+	size_t nodesSize = lightManager->lightNodes.size() * sizeof(LightManager::LightNode);
+	size_t trianglesSize = lightManager->lightTriangles.size() * sizeof(LightManager::LightTriangle);
+
+	void* mapped = nullptr;
+	rm->lightNodesBuffer->uploadBuffers->Map(0, nullptr, &mapped);
+	memcpy(mapped, lightManager->lightNodes.data(), nodesSize);
+	rm->lightNodesBuffer->uploadBuffers->Unmap(0, nullptr);
+
+	rm->lightTrianglesBuffer->uploadBuffers->Map(0, nullptr, &mapped);
+	memcpy(mapped, lightManager->lightTriangles.data(), trianglesSize);
+	rm->lightTrianglesBuffer->uploadBuffers->Unmap(0, nullptr);
+
+	pushBuffer(rm->lightNodesBuffer, nodesSize, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	pushBuffer(rm->lightTrianglesBuffer, trianglesSize, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+	// old samples saw the lights in their previous place
+	UI::accumulationUpdate = true;
+}
+
 void RayTracingStage::initCPUDescriptor() {
 
 	// for the ClearUnorderedAccessViewFloat method
@@ -583,7 +884,7 @@ void RayTracingStage::initCPUDescriptor() {
 
 	// for the non shader visible descriptor heap
 	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {
-			.Format = DXGI_FORMAT_R16G16B16A16_FLOAT,
+			.Format = DXGI_FORMAT_R32G32B32A32_FLOAT,
 			.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D
 	};
 
@@ -593,13 +894,13 @@ void RayTracingStage::initCPUDescriptor() {
 
 void RayTracingStage::initRTDescriptors() {
 
-	// Heap size: 1 UAV (accumulation texture) + 1 UAV Rand Buffer + 1 SRV (scene), + NUM_INSTANCES * (vertex srvs, index srvs) + 1 Material SRV + MaterialIndex SRV + Camera CBV
+	// Heap size: 1 UAV (accumulation texture) + 1 SRV (scene), + NUM_INSTANCES * (vertex srvs, index srvs) + 1 Material SRV + MaterialIndex SRV + 2 Light SRVs + 2 Adaptive UAVs + Blue Noise SRV + 5 AOV UAVs + 4 History SRVs + Camera CBV
 
 	if (debugstage) std::cout << "creating SRVs" << std::endl;
 
 	UINT num_modelBuffers = rm->allVertexBuffers.size();
 
-	UINT numDescriptors = 3 + num_modelBuffers * 2 + 3;
+	UINT numDescriptors = 2 + num_modelBuffers * 2 + 17;
 
 	descriptorIncrementSize = rm->d3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
@@ -617,24 +918,14 @@ void RayTracingStage::initRTDescriptors() {
 
 	// slot 0 UAV for accumulation texture
 	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {
-		.Format = DXGI_FORMAT_R16G16B16A16_FLOAT,
+		.Format = DXGI_FORMAT_R32G32B32A32_FLOAT,
 		.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D
 	};
 	rm->d3dDevice->CreateUnorderedAccessView(rm->accumulationTexture, nullptr, &uavDesc, cpuHandle);
 	cpuHandle.ptr += descriptorIncrementSize;
 
-	
-	// slot 1 UAV for RNG Buffer
-	uavDesc = {};
-	uavDesc.Format = DXGI_FORMAT_UNKNOWN,
-		uavDesc.Buffer.StructureByteStride = sizeof(uint64_t),
-		uavDesc.Buffer.NumElements = rm->randPattern.size();
-	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER,
 
-		rm->d3dDevice->CreateUnorderedAccessView(rm->randBuffer->defaultBuffers, nullptr, &uavDesc, cpuHandle);
-	cpuHandle.ptr += descriptorIncrementSize;
-
-	// slot 2 SRV for TLAS
+	// slot 1 SRV for TLAS
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
@@ -644,7 +935,7 @@ void RayTracingStage::initRTDescriptors() {
 	rm->d3dDevice->CreateShaderResourceView(nullptr, &srvDesc, cpuHandle);
 	cpuHandle.ptr += descriptorIncrementSize;
 
-	// slot 3
+	// slot 2
 	for (ResourceManager::Buffer* vertexBuffer : rm->allVertexBuffers) {
 		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
@@ -657,7 +948,7 @@ void RayTracingStage::initRTDescriptors() {
 		cpuHandle.ptr += descriptorIncrementSize;
 		std::cout << "srvNumElementsVertex: " << srvDesc.Buffer.NumElements << std::endl;
 	}
-	// slot 4
+	// slot 3
 	for (ResourceManager::Buffer* indexBuffer : rm->allIndexBuffers) {
 		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 		srvDesc.Format = DXGI_FORMAT_R32_UINT;
@@ -671,7 +962,7 @@ void RayTracingStage::initRTDescriptors() {
 		std::cout << "srvNumElementsIndex: " << srvDesc.Buffer.NumElements << std::endl;
 	}
 
-	// slot 5 Material Buffer
+	// slot 4 Material Buffer
 	srvDesc = {};
 	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
@@ -682,7 +973,7 @@ void RayTracingStage::initRTDescriptors() {
 	rm->d3dDevice->CreateShaderResourceView(rm->materialsBuffer->defaultBuffers, &srvDesc, cpuHandle);
 	cpuHandle.ptr += descriptorIncrementSize;
 
-	// slot 6 Material Index Buffer
+	// slot 5 Material Index Buffer
 	srvDesc = {};
 	srvDesc.Format = DXGI_FORMAT_R32_UINT;
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
@@ -693,6 +984,81 @@ void RayTracingStage::initRTDescriptors() {
 	rm->d3dDevice->CreateShaderResourceView(rm->materialIndexBuffer->defaultBuffers, &srvDesc, cpuHandle);
 	cpuHandle.ptr += descriptorIncrementSize;
 
+	// slot 6 Light BVH nodes
+	srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = static_cast<UINT>(lightManager->lightNodes.size());
+	srvDesc.Buffer.StructureByteStride = sizeof(LightManager::LightNode);
+	rm->d3dDevice->CreateShaderResourceView(rm->lightNodesBuffer->defaultBuffers, &srvDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	// slot 7 Light triangles
+	srvDesc.Buffer.NumElements = static_cast<UINT>(lightManager->lightTriangles.size());
+	srvDesc.Buffer.StructureByteStride = sizeof(LightManager::LightTriangle);
+	rm->d3dDevice->CreateShaderResourceView(rm->lightTrianglesBuffer->defaultBuffers, &srvDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	// slot 8 UAV variance texture
+	uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->varianceTexture, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	// slot 9 UAV tile mask
+	uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_UINT;
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.NumElements = rm->numTiles;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->tileMaskBuffer->defaultBuffers, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	// slot 10 SRV blue noise mask
+	srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.NumElements = ResourceManager::BLUE_NOISE_SIZE * ResourceManager::BLUE_NOISE_SIZE;
+	rm->d3dDevice->CreateShaderResourceView(rm->blueNoiseBuffer->defaultBuffers, &srvDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	// slot 11 - 15 UAV first hit AOVs
+	uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->albedoTexture, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	rm->d3dDevice->CreateUnorderedAccessView(rm->normalTexture, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->depthTexture, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	uavDesc.Format = DXGI_FORMAT_R32_UINT;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->idTexture, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	uavDesc.Format = DXGI_FORMAT_R16G16_FLOAT;
+	rm->d3dDevice->CreateUnorderedAccessView(rm->motionTexture, nullptr, &uavDesc, cpuHandle);
+	cpuHandle.ptr += descriptorIncrementSize;
+
+	// slot 16 - 19 SRV history for reprojection
+	DXGI_FORMAT historyFormats[4] = { DXGI_FORMAT_R32G32B32A32_FLOAT, DXGI_FORMAT_R32G32_FLOAT, DXGI_FORMAT_R32_FLOAT, DXGI_FORMAT_R16G16B16A16_FLOAT };
+	for (int i = 0; i < 4; i++) {
+		srvDesc = {};
+		srvDesc.Format = historyFormats[i];
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MipLevels = 1;
+		rm->d3dDevice->CreateShaderResourceView(rm->historyTextures[i], &srvDesc, cpuHandle);
+		cpuHandle.ptr += descriptorIncrementSize;
+	}
+
 	// Camera CBV
 	D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
 	cbvDesc.BufferLocation = rm->cameraConstantBuffer->defaultBuffers->GetGPUVirtualAddress();
@@ -717,14 +1083,6 @@ void RayTracingStage::initRTRootSignature() {
 	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
 	};
 
-	D3D12_DESCRIPTOR_RANGE randRange = {
-	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
-	.NumDescriptors = 1,
-	.BaseShaderRegister = 1,
-	.RegisterSpace = 0,
-	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
-	};
-
 	D3D12_DESCRIPTOR_RANGE sceneRange = {
 	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
 	.NumDescriptors = 1,
@@ -765,6 +1123,95 @@ void RayTracingStage::initRTRootSignature() {
 	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
 	};
 
+	D3D12_DESCRIPTOR_RANGE lightNodeRange = {
+	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+	.NumDescriptors = 1,
+	.BaseShaderRegister = 4,
+	.RegisterSpace = 5,
+	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	D3D12_DESCRIPTOR_RANGE lightTriangleRange = {
+	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+	.NumDescriptors = 1,
+	.BaseShaderRegister = 5,
+	.RegisterSpace = 5,
+	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	D3D12_DESCRIPTOR_RANGE varianceRange = {
+	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+	.NumDescriptors = 1,
+	.BaseShaderRegister = 2,
+	.RegisterSpace = 0,
+	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	D3D12_DESCRIPTOR_RANGE tileMaskRange = {
+	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+	.NumDescriptors = 1,
+	.BaseShaderRegister = 3,
+	.RegisterSpace = 0,
+	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	D3D12_DESCRIPTOR_RANGE blueNoiseRange = {
+	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+	.NumDescriptors = 1,
+	.BaseShaderRegister = 6,
+	.RegisterSpace = 5,
+	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	D3D12_DESCRIPTOR_RANGE albedoRange = {
+	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+	.NumDescriptors = 1,
+	.BaseShaderRegister = 4,
+	.RegisterSpace = 0,
+	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	D3D12_DESCRIPTOR_RANGE normalRange = {
+	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+	.NumDescriptors = 1,
+	.BaseShaderRegister = 5,
+	.RegisterSpace = 0,
+	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	D3D12_DESCRIPTOR_RANGE depthRange = {
+	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+	.NumDescriptors = 1,
+	.BaseShaderRegister = 6,
+	.RegisterSpace = 0,
+	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	D3D12_DESCRIPTOR_RANGE idRange = {
+	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+	.NumDescriptors = 1,
+	.BaseShaderRegister = 7,
+	.RegisterSpace = 0,
+	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	D3D12_DESCRIPTOR_RANGE motionRange = {
+	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+	.NumDescriptors = 1,
+	.BaseShaderRegister = 8,
+	.RegisterSpace = 0,
+	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
+	// accumulation, variance, depth, normal
+	D3D12_DESCRIPTOR_RANGE historyRange = {
+	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+	.NumDescriptors = 4,
+	.BaseShaderRegister = 7,
+	.RegisterSpace = 5,
+	.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND
+	};
+
 	D3D12_DESCRIPTOR_RANGE cameraRange = {
 	.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_CBV,
 	.NumDescriptors = 1,
@@ -780,20 +1227,30 @@ void RayTracingStage::initRTRootSignature() {
 	cameraParam.Descriptor.RegisterSpace = 0;
 	cameraParam.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
 
-	D3D12_ROOT_PARAMETER params[8] = {												// num desriptor ranges, descriptor range
+	D3D12_ROOT_PARAMETER params[18] = {												// num desriptor ranges, descriptor range
 		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &accumRange}},
-		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &randRange}},
 		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &sceneRange}},
 		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &vertexRange}},
 		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &indexRange}},
 		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &materialRange}},
 		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &materialIndexRange}},
+		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &lightNodeRange}},
+		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &lightTriangleRange}},
+		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &varianceRange}},
+		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &tileMaskRange}},
+		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &blueNoiseRange}},
+		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &albedoRange}},
+		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &normalRange}},
+		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &depthRange}},
+		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &idRange}},
+		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &motionRange}},
+		{.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, .DescriptorTable = {1, &historyRange}},
 	};
 
-	params[7] = cameraParam;
+	params[17] = cameraParam;
 
 	D3D12_ROOT_SIGNATURE_DESC desc = {
-		.NumParameters = 8,
+		.NumParameters = 18,
 		.pParameters = params,
 		.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE
 	};
@@ -829,7 +1286,7 @@ void RayTracingStage::initRTPipeline() {
 	};
 
 	D3D12_RAYTRACING_SHADER_CONFIG shaderCfg = {
-	.MaxPayloadSizeInBytes = 76,
+	.MaxPayloadSizeInBytes = sizeof(ResourceManager::DX12Payload),
 	.MaxAttributeSizeInBytes = 8, // triangle attribs
 	};
 
@@ -900,7 +1357,15 @@ void RayTracingStage::traceRays() {
 	ID3D12DescriptorHeap* heaps[] = { raytracingDescHeap };
 	rm->cmdList->SetDescriptorHeaps(1, heaps);
 
-	if (!config.accumulate || entityManager->camera->camMoved || UI::accumulationUpdate || UI::accelUpdate) {
+	bool reset = accumulationReset();
+	rm->accumulationRestarted = reset;
+
+	if (reset) {
+		// last frame becomes the history the first sample of this one is warped from
+		if (rm->reprojectHistory) {
+			copyHistory();
+		}
+
 		// slot 0 UAV for accumulation texture
 		D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle = cpuDescHeap->GetCPUDescriptorHandleForHeapStart();
 		D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle = raytracingDescHeap->GetGPUDescriptorHandleForHeapStart();
@@ -910,31 +1375,65 @@ void RayTracingStage::traceRays() {
 		UI::numRays = config.raysPerPixel;
 		UI::accelUpdate = false;
 		UI::accumulationUpdate = false;
+		rm->resolutionChanged = false;
 	}
 
 	D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle = raytracingDescHeap->GetGPUDescriptorHandleForHeapStart();
 	rm->cmdList->SetComputeRootDescriptorTable(0, gpuHandle); // u0 accum UAV
 	gpuHandle.ptr += descriptorIncrementSize;
-	rm->cmdList->SetComputeRootDescriptorTable(1, gpuHandle); // u1 rand UAV
+	rm->cmdList->SetComputeRootDescriptorTable(1, gpuHandle); // t0 TLAS
 	gpuHandle.ptr += descriptorIncrementSize;
-	rm->cmdList->SetComputeRootDescriptorTable(2, gpuHandle); // t0 TLAS
-	gpuHandle.ptr += descriptorIncrementSize;
-	rm->cmdList->SetComputeRootDescriptorTable(3, gpuHandle); // t1 vertex buffer
+	rm->cmdList->SetComputeRootDescriptorTable(2, gpuHandle); // t1 vertex buffer
 	gpuHandle.ptr += descriptorIncrementSize * rm->allVertexBuffers.size();
-	rm->cmdList->SetComputeRootDescriptorTable(4, gpuHandle); // t2 index buffer
+	rm->cmdList->SetComputeRootDescriptorTable(3, gpuHandle); // t2 index buffer
 	gpuHandle.ptr += descriptorIncrementSize * rm->allIndexBuffers.size();
-	rm->cmdList->SetComputeRootDescriptorTable(5, gpuHandle); // t3 material buffer
+	rm->cmdList->SetComputeRootDescriptorTable(4, gpuHandle); // t3 material buffer
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(5, gpuHandle); // t3 material index buffer
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(6, gpuHandle); // t4 light nodes
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(7, gpuHandle); // t5 light triangles
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(8, gpuHandle); // u2 variance texture
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(9, gpuHandle); // u3 tile mask
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(10, gpuHandle); // t6 blue noise
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(11, gpuHandle); // u4 albedo
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(12, gpuHandle); // u5 normal
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(13, gpuHandle); // u6 depth
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(14, gpuHandle); // u7 ids
+	gpuHandle.ptr += descriptorIncrementSize;
+	rm->cmdList->SetComputeRootDescriptorTable(15, gpuHandle); // u8 motion
 	gpuHandle.ptr += descriptorIncrementSize;
-	rm->cmdList->SetComputeRootDescriptorTable(6, gpuHandle); // t3 material index buffer
+	rm->cmdList->SetComputeRootDescriptorTable(16, gpuHandle); // t7 - t10 history
 
-	rm->cmdList->SetComputeRootConstantBufferView(7, rm->cameraConstantBuffer->defaultBuffers->GetGPUVirtualAddress()); // b0 camera cbv
+	rm->cmdList->SetComputeRootConstantBufferView(17, rm->cameraConstantBuffer->defaultBuffers->GetGPUVirtualAddress()); // b0 camera cbv
+
+	// sample budget, the rays saved on converged tiles go to the ones still active
+	UINT basePasses = config.timeBudget ? rm->budgetPasses : static_cast<UINT>(config.raysPerPixel);
+	rm->samplePasses = basePasses;
+
+	if (adaptiveSamplingEnabled() && !reset && rm->activeTiles < rm->numTiles) {
+		if (rm->activeTiles == 0) {
+			rm->samplePasses = 0; // everything converged
+		}
+		else if (!config.timeBudget) {
+			// a time budget already gets cheaper passes back through the measured pass cost
+			UINT boosted = basePasses * rm->numTiles / rm->activeTiles;
+			rm->samplePasses = std::min<UINT>(boosted, basePasses * config.adaptiveMaxBoost);
+		}
+	}
 
 	// clear accumulation texture
 
 	// Dispatch rays
 
-	auto rtDesc = rm->renderTarget->GetDesc();
-
 	D3D12_DISPATCH_RAYS_DESC dispatchDesc = {
 		.RayGenerationShaderRecord = {
 			.StartAddress = shaderIDs->GetGPUVirtualAddress(),
@@ -945,14 +1444,27 @@ void RayTracingStage::traceRays() {
 		.HitGroupTable = {
 			.StartAddress = shaderIDs->GetGPUVirtualAddress() + 2 * D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT,
 			.SizeInBytes = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES},
-		.Width = static_cast<UINT>(rtDesc.Width),
-		.Height = rtDesc.Height,
+		.Width = rm->internalWidth,
+		.Height = rm->internalHeight,
 		.Depth = 1 };
 
-	for (size_t i = 0; i < config.raysPerPixel; i++) {
+	// stop exactly on the sample target, whatever the passes per frame
+	if (config.sampleTarget > 0) {
+		UINT accumulated = reset ? 0 : rm->iterations;
+		UINT target = static_cast<UINT>(config.sampleTarget);
+		rm->samplePasses = accumulated >= target ? 0 : std::min(rm->samplePasses, target - accumulated);
+	}
+
+	rm->cmdList->EndQuery(rm->timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, 0);
+
+	for (size_t i = 0; i < rm->samplePasses; i++) {
 		rm->cmdList->DispatchRays(&dispatchDesc);
+		uavBarrier(nullptr); // accumulation and variance are read back by the next pass
 	}
 
+	rm->cmdList->EndQuery(rm->timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, 1);
+	rm->cmdList->ResolveQueryData(rm->timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, 0, 2, rm->timestampReadback, 0);
+
 	// transition accumulation texture from SRV TO UAV for next frame
 	D3D12_RESOURCE_BARRIER barrier = {};
 	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
@@ -964,6 +1476,14 @@ void RayTracingStage::traceRays() {
 }
 
 
+void RayTracingStage::uavBarrier(ID3D12Resource* resource) {
+
+	D3D12_RESOURCE_BARRIER barrier = {};
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+	barrier.UAV.pResource = resource;
+	rm->cmdList->ResourceBarrier(1, &barrier);
+}
+
 ResourceManager::Buffer* RayTracingStage::createBuffers(const void* data, size_t byteSize, D3D12_RESOURCE_STATES finalState, bool UAV) {
 	std::cout << "byteSize: " << byteSize << std::endl;
 
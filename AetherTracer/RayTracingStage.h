@@ -7,16 +7,33 @@
 #include "EntityManager.h"
 #include "MaterialManager.h"
 #include "MeshManager.h"
+#include "LightManager.h"
+#include "BlueNoise.h"
 
 class RayTracingStage {
 
 public:
 
 	RayTracingStage(ResourceManager* resourceManager, MeshManager* meshManager, MaterialManager* materialManager, EntityManager* entityManager);
-	~RayTracingStage() {};
+	~RayTracingStage() {
+		// resources it created for the scene are in the ResourceManager, released with it
+		if (shaderIDs) shaderIDs->Release();
+		if (raytracingPSO) raytracingPSO->Release();
+		if (raytracingRootSignature) raytracingRootSignature->Release();
+		if (raytracingDescHeap) raytracingDescHeap->Release();
+		if (cpuDescHeap) cpuDescHeap->Release();
+		if (rsBlob) rsBlob->Release();
+		delete lightManager;
+	};
 
 	void loadShaders();
 	void initAccumulationTexture();
+	void initAdaptiveBuffers();
+	void initAOVTextures();
+	void initHistoryTextures();
+	void copyHistory();
+	void initSamplerBuffers();
+	void initTimestampQueries();
 	void initModelBuffers();
 	void initModelBLAS();
 	void updateTransforms();
@@ -24,7 +41,10 @@ public:
 	void initScene();
 	void initMaterialBuffer();
 	void initTopLevelAS();
+	void refitTopLevelAS(); // instances moved, same count and BLASes
 	void initVertexIndexBuffers();
+	void initLightBuffers();
+	void updateLights();
 
 
 	void initStage();
@@ -37,7 +57,12 @@ public:
 
 	void initClearDescriptorHeap();
 
+	bool accumulationReset();
+	bool adaptiveSamplingEnabled();
+	bool reprojectionEnabled();
+	UINT aovMask(); // AOVFlags written by the first hit this frame
 	void traceRays();
+	void uavBarrier(ID3D12Resource* resource);
 
 	void checkHR(HRESULT hr, ID3DBlob* errorblob, std::string context);
 	void flush();
@@ -50,26 +75,27 @@ public:
 	ID3D12Resource* makeAccelerationStructure(const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs, UINT64* updateScratchSize = nullptr);
 
 	// RT root signature and ray tracing pso
-	ID3D12RootSignature* raytracingRootSignature;
-	ID3D12StateObject* raytracingPSO;
-	ID3D12DescriptorHeap* raytracingDescHeap;
+	ID3D12RootSignature* raytracingRootSignature = nullptr;
+	ID3D12StateObject* raytracingPSO = nullptr;
+	ID3D12DescriptorHeap* raytracingDescHeap = nullptr;
 
-	ID3D12DescriptorHeap* cpuDescHeap; // to clear UAVs
+	ID3D12DescriptorHeap* cpuDescHeap = nullptr; // to clear UAVs
 
 
 	UINT descriptorIncrementSize;
 
 	// shader tables
 	UINT64 NUM_SHADER_IDS = 3;
-	ID3D12Resource* shaderIDs;
+	ID3D12Resource* shaderIDs = nullptr;
 
 	// shader loading
-	ID3DBlob* rsBlob;
+	ID3DBlob* rsBlob = nullptr;
 
 	ResourceManager* rm;
 	MeshManager* meshManager;
 	MaterialManager* materialManager;
 	EntityManager* entityManager;
+	LightManager* lightManager = nullptr;
 
 	// heap management
 	D3D12_HEAP_PROPERTIES UPLOAD_HEAP = { .Type = D3D12_HEAP_TYPE_UPLOAD };
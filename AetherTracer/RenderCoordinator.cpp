@@ -0,0 +1,185 @@
+#include "RenderCoordinator.h"
+
+#include "EntityManager.h"
+#include "Config.h"
+#include "ToneMapper.h"
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <iostream>
+#include <filesystem>
+#include <chrono>
+
+using namespace RenderProtocol;
+
+int RenderCoordinator::run() {
+
+	if (!Socket::startup()) return 1;
+
+	Socket listener;
+	if (!listener.listen(config.coordinatorAddress)) {
+		std::cerr << "Coordinator: can't listen on " << config.coordinatorAddress << std::endl;
+		return 1;
+	}
+
+	EntityManager::Camera* camera = entityManager->camera;
+
+	scene.sceneHash = entityManager->sceneHash();
+	scene.width = config.resX;
+	scene.height = config.resY;
+	scene.position[0] = camera->position.x;
+	scene.position[1] = camera->position.y;
+	scene.position[2] = camera->position.z;
+	scene.rotation[0] = camera->rotation.x;
+	scene.rotation[1] = camera->rotation.y;
+	scene.sampler = config.sampler;
+	scene.minBounces = config.minBounces;
+	scene.maxBounces = config.maxBounces;
+	scene.sky = config.sky ? 1u : 0u;
+	scene.skyBrightness = config.skyBrightness;
+	scene.lightSampling = config.lightSampling ? 1u : 0u;
+
+	uint32_t totalSamples = config.sampleTarget > 0 ? static_cast<uint32_t>(config.sampleTarget) : 1024;
+	uint32_t chunk = static_cast<uint32_t>(std::max(config.distributedChunk, 1));
+
+	for (uint32_t start = 0, id = 0; start < totalSamples; start += chunk, id++) {
+		jobs.push_back({ id, start, std::min(chunk, totalSamples - start) });
+	}
+	jobDone.assign(jobs.size(), false);
+	jobsRemaining = jobs.size();
+
+	accumulation.assign(static_cast<size_t>(scene.width) * scene.height * 4, 0.0f);
+
+	std::cout << "Coordinator: " << totalSamples << " spp at " << scene.width << "x" << scene.height << " in " << jobs.size() << " jobs, waiting for workers on " << config.coordinatorAddress << std::endl;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	int workerIndex = 0;
+
+	while (true) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (jobsRemaining == 0) break;
+		}
+
+		// short timeout so the loop notices when the last job completes
+		Socket socket = listener.accept(250);
+		if (!socket.valid()) continue;
+
+		std::cout << "Coordinator: worker " << workerIndex << " connected" << std::endl;
+		workers.emplace_back(&RenderCoordinator::serveWorker, this, socket, workerIndex++);
+	}
+
+	listener.close();
+	jobsChanged.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+
+	float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - startTime).count();
+	std::cout << "Coordinator: finished in " << seconds << " s" << std::endl;
+
+	std::filesystem::path path = config.outputPath;
+	if (!ImageWriter::isHDR(path.string())) path.replace_extension(".pfm");
+	bool written = writeResult(path.string());
+	path.replace_extension(".png");
+	written = writePreview(path.string()) && written;
+	return written ? 0 : 1;
+}
+
+void RenderCoordinator::serveWorker(Socket socket, int workerIndex) {
+
+	socket.setTimeout(static_cast<int>(config.workerTimeout * 1000.0f));
+
+	if (!socket.sendMessage(MSG_SCENE, &scene, sizeof(scene))) {
+		socket.close();
+		return;
+	}
+
+	size_t expectedSize = sizeof(ResultHeader) + static_cast<size_t>(scene.width) * scene.height * 4 * sizeof(float);
+	std::vector<uint8_t> message;
+
+	JobMessage job;
+	while (takeJob(job)) {
+
+		uint32_t type = 0;
+		bool ok = socket.sendMessage(MSG_JOB, &job, sizeof(job)) && socket.recvMessage(type, message);
+
+		if (ok && type == MSG_ERROR) {
+			std::cerr << "Coordinator: worker " << workerIndex << " failed: " << std::string(message.begin(), message.end()) << std::endl;
+			ok = false;
+		}
+
+		const ResultHeader* header = reinterpret_cast<const ResultHeader*>(message.data());
+		ok = ok && type == MSG_RESULT && message.size() == expectedSize && header->jobId == job.jobId;
+
+		if (!ok) {
+			// died, hung or sent garbage, someone else renders its samples
+			std::cerr << "Coordinator: lost worker " << workerIndex << ", job " << job.jobId << " requeued" << std::endl;
+			returnJob(job);
+			socket.close();
+			return;
+		}
+
+		addResult(job, reinterpret_cast<const float*>(message.data() + sizeof(ResultHeader)));
+	}
+
+	socket.sendMessage(MSG_DONE, nullptr, 0);
+	socket.close();
+}
+
+bool RenderCoordinator::takeJob(JobMessage& job) {
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// jobs come back to the queue when a worker is lost, so wait while others are still in flight
+	jobsChanged.wait(lock, [this] { return !jobs.empty() || jobsRemaining == 0; });
+	if (jobsRemaining == 0) return false;
+
+	job = jobs.front();
+	jobs.pop_front();
+	return true;
+}
+
+void RenderCoordinator::returnJob(const JobMessage& job) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_front(job);
+	}
+	jobsChanged.notify_one();
+}
+
+void RenderCoordinator::addResult(const JobMessage& job, const float* pixels) {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (jobDone[job.jobId]) return;
+
+	for (size_t i = 0; i < accumulation.size(); i++) {
+		accumulation[i] += pixels[i];
+	}
+
+	jobDone[job.jobId] = true;
+	jobsRemaining--;
+	std::cout << "Coordinator: job " << job.jobId << " done, " << jobsRemaining << " left" << std::endl;
+
+	if (jobsRemaining == 0) jobsChanged.notify_all();
+}
+
+bool RenderCoordinator::writeResult(const std::string& path) const {
+	return ImageWriter::writeAccumulation(path, scene.width, scene.height, accumulation, config.exposure);
+}
+
+bool RenderCoordinator::writePreview(const std::string& path) const {
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	ToneMapper toneMapper;
+	std::vector<uint8_t> pixels;
+	toneMapper.apply(accumulation, scene.width, scene.height, config.exposure, pixels);
+
+	float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "Coordinator: tone mapped in " << ms << " ms" << (ToneMapper::hasAVX2() ? " (AVX2)" : "") << std::endl;
+
+	if (!ImageWriter::writePNG(path, scene.width, scene.height, pixels)) return false;
+	std::cout << "Coordinator: wrote " << path << std::endl;
+	return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "Socket.h"
+#include "RenderProtocol.h"
+
+class EntityManager;
+
+// Splits the sample target into sample ranges and hands them to whichever workers connect.
+// A worker that disconnects or goes quiet for longer than workerTimeout has its job queued again, results are only
+// added once their job completes so nothing is counted twice. Runs headless, the summed mean is written as a PFM (EXR if
+// outputPath asks for one) and tone mapped on the CPU into a PNG next to it.
+
+class RenderCoordinator {
+public:
+
+	RenderCoordinator(EntityManager* entityManager) : entityManager(entityManager) {};
+	~RenderCoordinator() {};
+
+	int run();
+
+private:
+
+	void serveWorker(Socket socket, int workerIndex);
+	bool takeJob(RenderProtocol::JobMessage& job); // false once every job is complete
+	void returnJob(const RenderProtocol::JobMessage& job);
+	void addResult(const RenderProtocol::JobMessage& job, const float* pixels);
+	bool writeResult(const std::string& path) const;
+	bool writePreview(const std::string& path) const;
+
+	EntityManager* entityManager;
+	RenderProtocol::SceneMessage scene = {};
+
+	std::mutex mutex;
+	std::condition_variable jobsChanged;
+	std::deque<RenderProtocol::JobMessage> jobs;
+	std::vector<bool> jobDone;
+	size_t jobsRemaining = 0;
+
+	std::vector<float> accumulation; // rgb sum and sample count per pixel
+	std::vector<std::thread> workers;
+};
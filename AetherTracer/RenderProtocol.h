@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+// Messages between the render coordinator and its workers.
+// Worker connects, coordinator sends the scene once, then jobs until the frame is done. Every job is answered by a
+// result holding the rgb sum and sample count of every pixel for that job's sample range.
+
+namespace RenderProtocol {
+
+	enum MessageType : uint32_t {
+		MSG_SCENE = 1,
+		MSG_JOB = 2,
+		MSG_RESULT = 3,
+		MSG_DONE = 4,
+		MSG_ERROR = 5 // worker can't render the scene it was sent, payload is the reason
+	};
+
+	struct SceneMessage {
+		uint64_t sceneHash; // workers load the scene themselves, this catches mismatched builds or assets
+		uint32_t width;
+		uint32_t height;
+		float position[3];
+		float rotation[2];
+		int32_t sampler;
+		int32_t minBounces;
+		int32_t maxBounces;
+		uint32_t sky;
+		float skyBrightness;
+		uint32_t lightSampling;
+	};
+
+	struct JobMessage {
+		uint32_t jobId;
+		uint32_t sampleStart; // first sample index, keeps every job on its own part of the sequences
+		uint32_t sampleCount;
+	};
+
+	struct ResultHeader {
+		uint32_t jobId;
+		uint32_t width;
+		uint32_t height;
+		// followed by width * height * 4 floats
+	};
+}
@@ -0,0 +1,53 @@
+#include "RenderWorker.h"
+
+#include <iostream>
+#include <cstring>
+
+using namespace RenderProtocol;
+
+bool RenderWorker::connect(const std::string& address) {
+
+	if (!Socket::startup()) return false;
+
+	if (!socket.connect(address)) {
+		std::cerr << "Worker: can't connect to " << address << std::endl;
+		return false;
+	}
+
+	std::cout << "Worker: connected to " << address << std::endl;
+	return true;
+}
+
+bool RenderWorker::receiveScene(SceneMessage& scene) {
+
+	uint32_t type = 0;
+	if (!socket.recvMessage(type, message) || type != MSG_SCENE || message.size() != sizeof(SceneMessage)) return false;
+
+	memcpy(&scene, message.data(), sizeof(SceneMessage));
+	return true;
+}
+
+bool RenderWorker::nextJob(JobMessage& job) {
+
+	// blocks while the coordinator waits on jobs other workers might hand back
+	uint32_t type = 0;
+	if (!socket.recvMessage(type, message) || type != MSG_JOB || message.size() != sizeof(JobMessage)) return false;
+
+	memcpy(&job, message.data(), sizeof(JobMessage));
+	return true;
+}
+
+bool RenderWorker::sendResult(const JobMessage& job, uint32_t width, uint32_t height, const std::vector<float>& pixels) {
+
+	ResultHeader header = { job.jobId, width, height };
+
+	message.resize(sizeof(ResultHeader) + pixels.size() * sizeof(float));
+	memcpy(message.data(), &header, sizeof(header));
+	memcpy(message.data() + sizeof(header), pixels.data(), pixels.size() * sizeof(float));
+
+	return socket.sendMessage(MSG_RESULT, message.data(), message.size());
+}
+
+void RenderWorker::sendError(const std::string& reason) {
+	socket.sendMessage(MSG_ERROR, reason.data(), reason.size());
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "Socket.h"
+#include "RenderProtocol.h"
+
+// Connection to a render coordinator, the app drives the renderer between calls.
+
+class RenderWorker {
+public:
+
+	RenderWorker() {};
+	~RenderWorker() { socket.close(); };
+
+	bool connect(const std::string& address);
+	bool receiveScene(RenderProtocol::SceneMessage& scene);
+	bool nextJob(RenderProtocol::JobMessage& job); // false when the coordinator is done or gone
+	bool sendResult(const RenderProtocol::JobMessage& job, uint32_t width, uint32_t height, const std::vector<float>& pixels);
+	void sendError(const std::string& reason);
+
+private:
+
+	Socket socket;
+	std::vector<uint8_t> message;
+};
@@ -1,2 +1,89 @@
 #include "ResourceManager.h"
 
+namespace {
+
+	template <typename T>
+	void safeRelease(T*& object) {
+		if (object) object->Release();
+		object = nullptr;
+	}
+
+	void safeRelease(ResourceManager::Buffer*& buffer) {
+		if (!buffer) return;
+		safeRelease(buffer->uploadBuffers);
+		safeRelease(buffer->defaultBuffers);
+		delete buffer;
+		buffer = nullptr;
+	}
+}
+
+void ResourceManager::release() {
+
+	// models own their vertex and index buffers, allVertexBuffers and allIndexBuffers only list them
+	for (auto& [name, model] : dx12Models) {
+		safeRelease(model->BLAS);
+		for (Buffer*& buffer : model->vertexBuffers) safeRelease(buffer);
+		for (Buffer*& buffer : model->indexBuffers) safeRelease(buffer);
+		delete model;
+	}
+	dx12Models.clear();
+	allVertexBuffers.clear();
+	allIndexBuffers.clear();
+
+	for (auto& [name, material] : materials) delete material;
+	materials.clear();
+	for (DX12Entity* entity : dx12Entitys) delete entity;
+	dx12Entitys.clear();
+
+	delete dx12Camera;
+	dx12Camera = nullptr;
+	delete toneMappingParams;
+	toneMappingParams = nullptr;
+
+	safeRelease(materialsBuffer);
+	safeRelease(materialIndexBuffer);
+	safeRelease(cameraConstantBuffer);
+	safeRelease(lightNodesBuffer);
+	safeRelease(lightTrianglesBuffer);
+	safeRelease(toneMappingConstantBuffer);
+	safeRelease(histogramBuffer);
+	safeRelease(tileMaskBuffer);
+	safeRelease(adaptiveCounterBuffer);
+	safeRelease(blueNoiseBuffer);
+
+	safeRelease(tlas);
+	safeRelease(tlasscratch);
+	instanceData = nullptr; // mapped for the life of the buffer
+	safeRelease(instances);
+
+	safeRelease(accumulationTexture);
+	safeRelease(renderTarget);
+	safeRelease(varianceTexture);
+	safeRelease(albedoTexture);
+	safeRelease(normalTexture);
+	safeRelease(depthTexture);
+	safeRelease(idTexture);
+	safeRelease(motionTexture);
+	for (ID3D12Resource*& texture : historyTextures) safeRelease(texture);
+	for (ID3D12Resource*& texture : denoiseTextures) safeRelease(texture);
+
+	safeRelease(adaptiveReadback);
+	safeRelease(exposureReadback);
+	safeRelease(accumulationReadback);
+	safeRelease(varianceReadback);
+	safeRelease(renderTargetReadback);
+	safeRelease(timestampHeap);
+	safeRelease(timestampReadback);
+
+	safeRelease(rtvHeap);
+	safeRelease(cpuDescHeap);
+	safeRelease(swapChain);
+	safeRelease(cmdList);
+	safeRelease(cmdAlloc);
+	safeRelease(fence);
+	safeRelease(cmdQueue);
+	safeRelease(factory);
+
+	// last, nothing above may outlive it
+	safeRelease(d3dDevice);
+}
@@ -24,7 +24,9 @@ public:
 
 
 	ResourceManager() {};
-	~ResourceManager() {};
+	~ResourceManager() { release(); };
+
+	void release(); // every gpu object then the device, the queue has to be idle
 
 	void initClearDescriptors();
 
@@ -60,6 +62,21 @@ public:
 		}
 	};
 
+	// matches Payload in raytracingshader.hlsl, sizes MaxPayloadSizeInBytes. hlsl bools are 4 bytes
+	struct DX12Payload {
+		DirectX::XMFLOAT3 throughput;
+		DirectX::XMFLOAT3 emission;
+		DirectX::XMFLOAT3 radiance;
+		UINT diffuseBounce;
+		DirectX::XMFLOAT3 pos;
+		DirectX::XMFLOAT3 dir;
+		UINT bounceNum;
+		UINT missed;
+		UINT internal;
+		DirectX::XMUINT2 pixelIndex;
+		UINT sampleIndex;
+	};
+
 	struct DX12Model {
 		DX12Model() : loadedModel(nullptr), BLAS(nullptr) {};
 
@@ -71,9 +88,9 @@ public:
 	};
 
 	struct DX12Entity {
-		DX12Entity() : entity(nullptr), model(nullptr) {};
+		DX12Entity() : entity(0), model(nullptr), material(nullptr) {};
 
-		EntityManager::Entity* entity; // name, position, rotation
+		EntityManager::Handle entity; // same as the instance index
 		DX12Model* model;
 		DX12Material* material;
 	};
@@ -93,56 +110,182 @@ public:
 		UINT minBounces;
 		UINT maxBounces;
 		UINT jitter;
+		UINT numLights;
+		UINT lightSampling;
+		UINT adaptiveSampling;
+		UINT adaptiveMinSamples;
+		UINT samplerType;
+		UINT sequenceSeed;
+		UINT aovMask;
+		UINT reprojectHistory;
+		UINT maxHistory;
+		float depthTolerance;
+
+		DirectX::XMFLOAT4X4 prevViewProj;
+		UINT sampleOffset;
+		UINT tileOriginX;
+		UINT tileOriginY;
+		UINT imageWidth;
+		UINT imageHeight;
 	};
 
 	// MODEL
 	std::vector<Buffer*> allVertexBuffers;
 	std::vector<Buffer*> allIndexBuffers;
 
-	Buffer* materialsBuffer;
+	Buffer* materialsBuffer = nullptr;
 	std::vector<DX12Material> dx12Materials;
-	Buffer* materialIndexBuffer;
+	Buffer* materialIndexBuffer = nullptr;
 	std::vector<uint32_t> materialIndices;
 
-	Buffer* cameraConstantBuffer;
+	Buffer* cameraConstantBuffer = nullptr;
+
+	// LIGHTS
+	Buffer* lightNodesBuffer = nullptr;
+	Buffer* lightTrianglesBuffer = nullptr;
+	UINT numLightNodes = 0;
+	UINT numLightTriangles = 0;
 
 	// ENTITY / BLAS
 	std::unordered_map<std::string, DX12Material*> materials;
 	std::unordered_map<std::string, DX12Model*> dx12Models;
 
 	std::vector<DX12Entity*> dx12Entitys;
-	DX12Camera* dx12Camera;
+	DX12Camera* dx12Camera = nullptr;
 
 	// TLAS
-	ID3D12Resource* tlas;
-	ID3D12Resource* tlasscratch;
+	ID3D12Resource* tlas = nullptr;
+	ID3D12Resource* tlasscratch = nullptr;
 
 	UINT NUM_INSTANCES = 0;
-	ID3D12Resource* instances;
-	D3D12_RAYTRACING_INSTANCE_DESC* instanceData;
+	ID3D12Resource* instances = nullptr;
+	D3D12_RAYTRACING_INSTANCE_DESC* instanceData = nullptr;
 	std::unordered_map<std::string, uint32_t> uniqueInstancesID;
 	std::unordered_set<std::string> uniqueInstances;
 
 	// COMPUTE STAGE
 
-	ID3D12Resource* renderTarget;
+	ID3D12Resource* renderTarget = nullptr;
 
 	struct alignas(256)ToneMappingParams {
-		ToneMappingParams() : stage(0), numIts(1), exposure(1.0f) {};
-		UINT stage;
+		ToneMappingParams() : exposure(1.0f), numIts(1), adaptiveSampling(0), adaptiveThreshold(0.0f), adaptiveMinSamples(0), heatmap(0), aovView(0),
+			denoise(0), denoiseIterations(0), sigmaNormal(0.0f), sigmaDepth(0.0f), sigmaLuminance(0.0f),
+			internalWidth(1), internalHeight(1), autoExposure(0), exposureLowPercentile(0.5f), exposureHighPercentile(0.95f), exposureAdaptation(1.0f) {};
 		float exposure;
 		UINT numIts;
+		UINT adaptiveSampling;
+		float adaptiveThreshold;
+		UINT adaptiveMinSamples;
+		UINT heatmap;
+		UINT aovView;
+		UINT denoise;
+		UINT denoiseIterations;
+		float sigmaNormal;
+		float sigmaDepth;
+		float sigmaLuminance;
+		UINT internalWidth;
+		UINT internalHeight;
+		UINT autoExposure;
+		float exposureLowPercentile;
+		float exposureHighPercentile;
+		float exposureAdaptation;
 	};
-	ToneMappingParams* toneMappingParams;
-	Buffer* toneMappingConstantBuffer;
-	Buffer* maxLumBuffer;
+	ToneMappingParams* toneMappingParams = nullptr;
+	Buffer* toneMappingConstantBuffer = nullptr;
 
-	// SHARED
+	// AUTO EXPOSURE
+
+	static constexpr UINT HISTOGRAM_BINS = 256;
+	Buffer* histogramBuffer = nullptr; // HISTOGRAM_BINS log luminance counts, then the adapted exposure in EV as float bits
+	bool exposureAdapted = false; // the first frame with auto exposure jumps straight to the target
+	ID3D12Resource* exposureReadback = nullptr; // the adapted exposure, copied out after the adapt pass
+	float exposureEV = 0.0f; // as last read back, for tone mapping on the CPU
+
+	// ADAPTIVE SAMPLING
+
+	ID3D12Resource* varianceTexture = nullptr; // per pixel running luminance mean and M2 (Welford)
+	Buffer* tileMaskBuffer = nullptr; // 1 per 16x16 tile that still needs samples
+	Buffer* adaptiveCounterBuffer = nullptr; // number of active tiles, written by the compute stage
+	ID3D12Resource* adaptiveReadback = nullptr;
+
+	static constexpr UINT ADAPTIVE_TILE_SIZE = 16;
+	UINT numTiles = 0;
+	UINT activeTiles = 0;
+	UINT samplePasses = 1; // dispatches this frame
+	bool accumulationRestarted = false; // accumulation was cleared this frame
+
+	// AOV
+
+	ID3D12Resource* albedoTexture = nullptr; // first hit data, written by the ray tracing stage
+	ID3D12Resource* normalTexture = nullptr;
+	ID3D12Resource* depthTexture = nullptr;
+	ID3D12Resource* idTexture = nullptr;
+	ID3D12Resource* motionTexture = nullptr;
+	DirectX::XMFLOAT4X4 prevViewProj;
+	bool hasPrevViewProj = false;
+
+	// REPROJECTION
+
+	ID3D12Resource* historyTextures[4] = {}; // accumulation, variance, depth, normal of the frame before a camera move
+	bool reprojectHistory = false; // camera moved this frame and the history is warped instead of dropped
+
+	// DYNAMIC RESOLUTION
 
-	ID3D12Resource* accumulationTexture;
+	UINT internalWidth = 1; // traced in the top left of the full size textures, upscaled by the tone map
+	UINT internalHeight = 1;
+	float movingScale = 1.0f; // resolution scale kept between camera moves
+	UINT stillFrames = 0;
+	bool resolutionChanged = false; // accumulation can't carry over to a different internal resolution
+
+	// TILED RENDERING
+
+	UINT imageWidth = 0; // full output the textures are one tile of, 0 = not tiled
+	UINT imageHeight = 0;
+	UINT tileOriginX = 0;
+	UINT tileOriginY = 0;
+
+	// DENOISER
+
+	ID3D12Resource* denoiseTextures[2] = {}; // a-trous ping pong, demodulated colour and variance
+
+	// SAMPLING
+
+	static constexpr UINT BLUE_NOISE_SIZE = 64;
+	Buffer* blueNoiseBuffer = nullptr;
+	UINT sequenceSeed = 1; // seed of the current accumulation
+	UINT sampleOffset = 0; // index of the first sample, set by distributed workers
+
+	// FRAME BUDGET
+
+	ID3D12QueryHeap* timestampHeap = nullptr;
+	ID3D12Resource* timestampReadback = nullptr;
+	UINT64 timestampFrequency = 1;
+	float traceTimeMs = 0.0f; // gpu time of the last frame's sample passes
+	float passCostMs = 0.0f; // smoothed cost of one sample pass
+	float frameOverheadMs = 0.0f; // smoothed frame time outside the sample passes
+	UINT budgetPasses = 1; // sample passes that fit in the target frame time
+
+	// after the two sample pass queries, the end of the denoise prepare pass then the end of each a-trous pass
+	static constexpr UINT MAX_DENOISE_ITERATIONS = 8;
+	static constexpr UINT DENOISE_QUERY = 2;
+	static constexpr UINT TIMESTAMP_QUERIES = DENOISE_QUERY + 1 + MAX_DENOISE_ITERATIONS;
+	UINT denoisePasses = 0; // a-trous passes recorded in the last frame
+	float denoisePassMs[MAX_DENOISE_ITERATIONS] = {}; // smoothed gpu cost of each a-trous pass
+
+	// READBACK
+
+	ID3D12Resource* accumulationReadback = nullptr;
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT accumulationFootprint = {};
+	bool accumulationReadbackRequested = false; // copy the accumulation texture out at the end of this frame
+	ID3D12Resource* varianceReadback = nullptr;
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT varianceFootprint = {};
+	bool varianceReadbackRequested = false;
+	ID3D12Resource* renderTargetReadback = nullptr;
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT renderTargetFootprint = {};
+
+	// SHARED
 
-	Buffer* randBuffer;
-	std::vector<uint64_t> randPattern;
+	ID3D12Resource* accumulationTexture = nullptr;
 
 
 	UINT iterations = 1;
@@ -159,19 +302,19 @@ public:
 
 	// device init
 	HWND hwnd;
-	IDXGIFactory4* factory;
-	ID3D12Device5* d3dDevice;
-	ID3D12CommandQueue* cmdQueue;
-	ID3D12Fence* fence;
+	IDXGIFactory4* factory = nullptr;
+	ID3D12Device5* d3dDevice = nullptr;
+	ID3D12CommandQueue* cmdQueue = nullptr;
+	ID3D12Fence* fence = nullptr;
 	UINT64 fenceState = 1;
 
 	// swap chain and uav
-	IDXGISwapChain3* swapChain;
+	IDXGISwapChain3* swapChain = nullptr;
 
 	// Command list and allocator
 
-	ID3D12CommandAllocator* cmdAlloc; // block of memory
-	ID3D12GraphicsCommandList4* cmdList;
+	ID3D12CommandAllocator* cmdAlloc = nullptr; // block of memory
+	ID3D12GraphicsCommandList4* cmdList = nullptr;
 
 	// imgui
 	ID3D12DescriptorHeap* rtvHeap = nullptr;
@@ -182,7 +325,7 @@ public:
 
 
 	// cpu non shader visible descriptor heap
-	ID3D12DescriptorHeap* cpuDescHeap;
+	ID3D12DescriptorHeap* cpuDescHeap = nullptr;
 
 
 };
\ No newline at end of file
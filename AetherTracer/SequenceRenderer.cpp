@@ -0,0 +1,89 @@
+#include "SequenceRenderer.h"
+
+#include "AetherTracer.h"
+#include "BatchRenderer.h"
+#include "DX12Renderer.h"
+#include "ImageWriter.h"
+#include "Config.h"
+
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include <cstdio>
+
+int SequenceRenderer::run() {
+
+	if (!animation.load(animationPath)) return 1;
+
+	if (config.sampleTarget <= 0 && config.renderDeadline <= 0.0f) {
+		std::cerr << "Sequence: needs --samples or --deadline per frame" << std::endl;
+		return 1;
+	}
+
+	int samples = config.sampleTarget;
+	float seconds = config.renderDeadline;
+
+	// every frame starts over, nothing may depend on the one before
+	config.accumulate = true;
+	config.temporalReprojection = false;
+	config.dynamicResolution = false;
+	config.quitWhenFinished = false;
+
+	AetherTracer* tracer = new AetherTracer{};
+	tracer->init();
+	animation.bind(tracer->entityManager);
+
+	ResourceManager* rm = tracer->dx12Renderer->rm;
+
+	// the frame being rendered has the gpu, the rest of the cores encode the ones before it
+	// hardware_concurrency can be 0, clamp before subtracting or it wraps
+	size_t maxWrites = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	int frameCount = animation.endFrame - animation.startFrame + 1;
+
+	std::cout << "Sequence: " << frameCount << " frames at " << animation.fps << " fps, " << maxWrites << " writers" << std::endl;
+
+	for (int frame = animation.startFrame; frame <= animation.endFrame; frame++) {
+
+		animation.apply(animation.frameTime(frame), tracer->entityManager);
+
+		if (!BatchRenderer::renderShot(tracer, samples, seconds)) {
+			std::cout << "Sequence: window closed, stopping" << std::endl;
+			break;
+		}
+
+		std::vector<uint8_t> pixels;
+		tracer->dx12Renderer->readRenderTarget(pixels);
+
+		while (writes.size() >= maxWrites) waitForWrite();
+
+		writes.push_back(std::async(std::launch::async, [path = framePath(frame), width = rm->width, height = rm->height, pixels = std::move(pixels)]() {
+			return ImageWriter::writePNG(path, width, height, pixels);
+		}));
+	}
+
+	while (!writes.empty()) waitForWrite();
+
+	tracer->shutdown();
+	delete tracer;
+
+	std::cout << "Sequence: done, " << failed << " failed" << std::endl;
+	return failed == 0 ? 0 : 1;
+}
+
+bool SequenceRenderer::waitForWrite() {
+	bool written = writes.front().get();
+	writes.pop_front();
+	if (!written) failed++;
+	return written;
+}
+
+std::string SequenceRenderer::framePath(int frame) const {
+
+	std::filesystem::path output(config.outputPath);
+
+	char number[16];
+	snprintf(number, sizeof(number), "_%04d", frame);
+
+	std::filesystem::path path = output.parent_path() / (output.stem().string() + number + ".png");
+	return path.string();
+}
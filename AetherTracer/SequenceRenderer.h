@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <future>
+
+#include "Animation.h"
+
+class AetherTracer;
+
+// Renders every frame of an Animation headless into numbered images next to config.outputPath
+// (renders/final.png gives renders/final_0000.png, ...). Entity moves refit the TLAS instead of rebuilding it.
+// The GPU is busy with one frame at a time, the frames before it are encoded and written on other cores meanwhile.
+
+class SequenceRenderer {
+public:
+
+	SequenceRenderer(const std::string& animationPath) : animationPath(animationPath) {};
+	~SequenceRenderer() {};
+
+	int run();
+
+private:
+
+	std::string framePath(int frame) const;
+	bool waitForWrite(); // oldest write in flight
+
+	std::string animationPath;
+	Animation animation;
+	std::deque<std::future<bool>> writes;
+	int failed = 0;
+};
@@ -0,0 +1,131 @@
+#include "SharedFrameRing.h"
+
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <iostream>
+#include <new>
+
+namespace {
+	constexpr uint64_t align(uint64_t size) { return (size + 63) & ~uint64_t(63); }
+}
+
+bool SharedFrameRing::create(const std::string& name, uint32_t maxWidth, uint32_t maxHeight) {
+
+	uint64_t pixels = static_cast<uint64_t>(maxWidth) * maxHeight;
+	uint64_t ldrOffset = sizeof(Slot) + align(pixels * 4 * sizeof(float));
+	uint64_t slotStride = align(ldrOffset + pixels * 4);
+	uint64_t slotsOffset = align(sizeof(Header));
+	uint64_t size = slotsOffset + slotStride * SLOT_COUNT;
+
+	std::wstring objectName = L"Local\\" + std::wstring(name.begin(), name.end());
+
+	mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), objectName.c_str());
+	if (mapping && GetLastError() == ERROR_ALREADY_EXISTS) {
+		// another renderer is publishing under this name, and the size is whatever it asked for
+		std::cerr << "Shared frames: " << name << " is already in use" << std::endl;
+		close();
+		return false;
+	}
+
+	if (mapping) view = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+	if (view) {
+		frameEvents[0] = CreateEventW(nullptr, TRUE, FALSE, (objectName + L"Even").c_str());
+		frameEvents[1] = CreateEventW(nullptr, TRUE, FALSE, (objectName + L"Odd").c_str());
+	}
+
+	if (!view || !frameEvents[0] || !frameEvents[1]) {
+		std::cerr << "Shared frames: can't create " << name << ", error " << GetLastError() << std::endl;
+		close();
+		return false;
+	}
+
+	// pages of a new mapping are zero, only the header needs filling in
+	header = new (view) Header{
+		.magic = { 'A', 'E', 'T', 'F' },
+		.version = VERSION,
+		.slotCount = SLOT_COUNT,
+		.maxWidth = maxWidth,
+		.maxHeight = maxHeight,
+		.reserved = 0,
+		.slotsOffset = slotsOffset,
+		.slotStride = slotStride,
+		.ldrOffset = ldrOffset,
+		.latest = 0,
+	};
+	for (uint32_t i = 0; i < SLOT_COUNT; i++) {
+		new (view + slotsOffset + slotStride * i) Slot{};
+	}
+
+	std::cout << "Shared frames: publishing " << maxWidth << "x" << maxHeight << " to " << name << std::endl;
+	return true;
+}
+
+void SharedFrameRing::close() {
+
+	if (view) UnmapViewOfFile(view);
+	if (mapping) CloseHandle(mapping);
+	for (void*& event : frameEvents) {
+		if (event) CloseHandle(event);
+		event = nullptr;
+	}
+	view = nullptr;
+	mapping = nullptr;
+	header = nullptr;
+	frame = 0;
+	pending = {};
+	fitting = true;
+}
+
+SharedFrameRing::Frame SharedFrameRing::begin(uint32_t width, uint32_t height, uint32_t iterations) {
+
+	pending = {};
+	if (!header) return pending;
+
+	// the mapping can't grow under open viewers, frames larger than it are dropped until the window fits again
+	bool fits = width <= header->maxWidth && height <= header->maxHeight;
+	if (fits != fitting) {
+		fitting = fits;
+		if (!fits) std::cerr << "Shared frames: " << width << "x" << height << " doesn't fit the " << header->maxWidth << "x" << header->maxHeight << " mapping, not publishing until it does (see --shared-frames-max)" << std::endl;
+	}
+	if (!fits) return pending;
+
+	frame = header->latest.load(std::memory_order_relaxed) + 1;
+	Slot* target = slot(frame);
+
+	// odd before any of the pixels change, a viewer still reading the frame that was here sees it moved
+	target->sequence.store(frame * 2 - 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	target->width = width;
+	target->height = height;
+	target->iterations = iterations;
+
+	uint8_t* base = reinterpret_cast<uint8_t*>(target);
+	pending.hdr = reinterpret_cast<float*>(base + sizeof(Slot));
+	pending.ldr = base + header->ldrOffset;
+	return pending;
+}
+
+void SharedFrameRing::publish(float exposure) {
+
+	if (!pending.hdr) return;
+
+	Slot* target = slot(frame);
+	ToneMapper::Luminance luminance = toneMapper.reduce(pending.hdr, target->width, target->height);
+	toneMapper.map(pending.hdr, target->width, target->height, luminance.max, exposure, pending.ldr);
+
+	target->sequence.store(frame * 2, std::memory_order_release);
+
+	// viewers of this frame wait on the other parity, it has to be down before they can see latest move
+	ResetEvent(frameEvents[(frame + 1) & 1]);
+	header->latest.store(frame, std::memory_order_release);
+	SetEvent(frameEvents[frame & 1]);
+
+	pending = {};
+}
+
+SharedFrameRing::Slot* SharedFrameRing::slot(uint64_t index) const {
+	return reinterpret_cast<Slot*>(view + header->slotsOffset + header->slotStride * (index % header->slotCount));
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <atomic>
+
+#include "ToneMapper.h"
+
+// Converging frames published to named shared memory so review tools can watch a render without a window of their
+// own. The mapping is a Header followed by SLOT_COUNT slots, each a Slot then the HDR plane (rgb sum and sample count,
+// float4, rows tightly packed) and at ldrOffset the tone mapped rgba8 plane. Frame n goes to slot n % slotCount.
+//
+// The renderer never waits on a viewer. A slot's sequence is odd while it is written and 2n once frame n is complete,
+// a viewer copies what it needs and checks the sequence didn't move, otherwise it lost the slot to a newer frame and
+// reads latest again. Two named manual reset events, <name>Even and <name>Odd, are set when a frame of that parity
+// is published and reset a frame before the next one of that parity, so a viewer that has frame n waits on the event
+// of n + 1 and wakes once for it.
+
+class SharedFrameRing {
+public:
+
+	static constexpr uint32_t VERSION = 1;
+	static constexpr uint32_t SLOT_COUNT = 3;
+
+	struct Header {
+		char magic[4]; // "AETF"
+		uint32_t version;
+		uint32_t slotCount;
+		uint32_t maxWidth;
+		uint32_t maxHeight;
+		uint32_t reserved;
+		uint64_t slotsOffset; // first slot from the start of the mapping
+		uint64_t slotStride;
+		uint64_t ldrOffset; // from the start of a slot
+		std::atomic<uint64_t> latest; // newest complete frame, 0 = none yet
+	};
+
+	struct Slot {
+		std::atomic<uint64_t> sequence;
+		uint32_t width;
+		uint32_t height;
+		uint32_t iterations; // samples per pixel
+		uint32_t reserved;
+		uint64_t padding[5]; // planes start on a cache line
+	};
+
+	struct Frame {
+		float* hdr = nullptr; // null if the frame doesn't fit the mapping
+		uint8_t* ldr = nullptr;
+	};
+
+	SharedFrameRing() {};
+	~SharedFrameRing() { close(); };
+
+	SharedFrameRing(const SharedFrameRing&) = delete;
+	SharedFrameRing& operator=(const SharedFrameRing&) = delete;
+
+	bool create(const std::string& name, uint32_t maxWidth, uint32_t maxHeight); // Local\<name>, fails if it already exists
+	void close();
+
+	Frame begin(uint32_t width, uint32_t height, uint32_t iterations); // claims the next slot, fill hdr then publish
+	void publish(float exposure); // tone maps hdr into ldr and hands the slot to viewers
+
+private:
+
+	Slot* slot(uint64_t index) const;
+
+	void* mapping = nullptr;
+	void* frameEvents[2] = {};
+	uint8_t* view = nullptr;
+	Header* header = nullptr;
+
+	uint64_t frame = 0; // being written, 0 = none
+	bool fitting = true; // last frame fit the mapping, the drop is logged once when it stops
+	Frame pending;
+	ToneMapper toneMapper;
+};
@@ -0,0 +1,194 @@
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32")
+
+#include "Socket.h"
+
+#include <algorithm>
+#include <iostream>
+
+static bool isUnixAddress(const std::string& address) {
+	return address.rfind("unix:", 0) == 0;
+}
+
+static sockaddr_un unixAddress(const std::string& address) {
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	strncpy_s(addr.sun_path, address.c_str() + 5, sizeof(addr.sun_path) - 1);
+	return addr;
+}
+
+bool Socket::startup() {
+
+	static bool started = false;
+	if (started) return true;
+
+	WSADATA data;
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+		std::cerr << "WSAStartup failed" << std::endl;
+		return false;
+	}
+	started = true;
+	return true;
+}
+
+bool Socket::connect(const std::string& address) {
+
+	if (isUnixAddress(address)) {
+		SOCKET s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (s == INVALID_SOCKET) return false;
+
+		sockaddr_un addr = unixAddress(address);
+		if (::connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+			closesocket(s);
+			return false;
+		}
+		handle = s;
+		return true;
+	}
+
+	size_t colon = address.rfind(':');
+	if (colon == std::string::npos) {
+		std::cerr << "Expected host:port, got " << address << std::endl;
+		return false;
+	}
+	std::string host = address.substr(0, colon);
+	std::string port = address.substr(colon + 1);
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	addrinfo* result = nullptr;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) return false;
+
+	for (addrinfo* info = result; info; info = info->ai_next) {
+		SOCKET s = ::socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+		if (s == INVALID_SOCKET) continue;
+
+		if (::connect(s, info->ai_addr, static_cast<int>(info->ai_addrlen)) == 0) {
+			// results are large and latency matters more than packet count
+			BOOL noDelay = TRUE;
+			setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+			handle = s;
+			break;
+		}
+		closesocket(s);
+	}
+
+	freeaddrinfo(result);
+	return valid();
+}
+
+bool Socket::listen(const std::string& address) {
+
+	SOCKET s;
+
+	if (isUnixAddress(address)) {
+		s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (s == INVALID_SOCKET) return false;
+
+		sockaddr_un addr = unixAddress(address);
+		DeleteFileA(addr.sun_path); // left behind by a previous run
+		if (::bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+			closesocket(s);
+			return false;
+		}
+	}
+	else {
+		s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (s == INVALID_SOCKET) return false;
+
+		BOOL reuse = TRUE;
+		setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = htons(static_cast<u_short>(std::stoi(address)));
+		if (::bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+			closesocket(s);
+			return false;
+		}
+	}
+
+	if (::listen(s, SOMAXCONN) != 0) {
+		closesocket(s);
+		return false;
+	}
+
+	handle = s;
+	return true;
+}
+
+Socket Socket::accept(int timeoutMs) {
+
+	fd_set readSet;
+	FD_ZERO(&readSet);
+	FD_SET(static_cast<SOCKET>(handle), &readSet);
+
+	timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+	if (select(0, &readSet, nullptr, nullptr, &timeout) <= 0) return Socket{};
+
+	SOCKET s = ::accept(static_cast<SOCKET>(handle), nullptr, nullptr);
+	return s == INVALID_SOCKET ? Socket{} : Socket{ s };
+}
+
+void Socket::setTimeout(int timeoutMs) {
+	DWORD timeout = static_cast<DWORD>(timeoutMs);
+	setsockopt(static_cast<SOCKET>(handle), SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+	setsockopt(static_cast<SOCKET>(handle), SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+}
+
+void Socket::close() {
+	if (!valid()) return;
+	closesocket(static_cast<SOCKET>(handle));
+	handle = INVALID;
+}
+
+void Socket::shutdown() {
+	if (!valid()) return;
+	::shutdown(static_cast<SOCKET>(handle), SD_BOTH);
+}
+
+bool Socket::sendAll(const void* data, size_t size) {
+
+	const char* bytes = static_cast<const char*>(data);
+	while (size > 0) {
+		int sent = ::send(static_cast<SOCKET>(handle), bytes, static_cast<int>(std::min<size_t>(size, 1 << 20)), 0);
+		if (sent <= 0) return false;
+		bytes += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+bool Socket::recvAll(void* data, size_t size) {
+
+	char* bytes = static_cast<char*>(data);
+	while (size > 0) {
+		int received = ::recv(static_cast<SOCKET>(handle), bytes, static_cast<int>(std::min<size_t>(size, 1 << 20)), 0);
+		if (received <= 0) return false; // closed, reset or timed out
+		bytes += received;
+		size -= received;
+	}
+	return true;
+}
+
+bool Socket::sendMessage(uint32_t type, const void* data, size_t size) {
+	uint32_t header[2] = { type, static_cast<uint32_t>(size) };
+	return sendAll(header, sizeof(header)) && (size == 0 || sendAll(data, size));
+}
+
+bool Socket::recvMessage(uint32_t& type, std::vector<uint8_t>& data) {
+
+	uint32_t header[2];
+	if (!recvAll(header, sizeof(header))) return false;
+	if (header[1] > MAX_MESSAGE_SIZE) return false;
+
+	type = header[0];
+	data.resize(header[1]);
+	return header[1] == 0 || recvAll(data.data(), data.size());
+}
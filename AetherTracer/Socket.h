@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Blocking stream socket, TCP or AF_UNIX. Addresses are "port" / "host:port" or "unix:path".
+// Messages are a type and a length followed by the payload.
+
+class Socket {
+public:
+
+	Socket() : handle(INVALID) {};
+	explicit Socket(uintptr_t handle) : handle(handle) {};
+
+	static bool startup(); // once per process
+
+	bool connect(const std::string& address);
+	bool listen(const std::string& address);
+	Socket accept(int timeoutMs); // invalid socket on timeout
+	void setTimeout(int timeoutMs); // send and receive, 0 = none
+	void close();
+	void shutdown(); // unblocks sends and receives on other threads, the handle stays open until close
+	bool valid() const { return handle != INVALID; }
+
+	bool sendAll(const void* data, size_t size);
+	bool recvAll(void* data, size_t size);
+
+	bool sendMessage(uint32_t type, const void* data, size_t size);
+	bool recvMessage(uint32_t& type, std::vector<uint8_t>& data);
+
+	static constexpr uintptr_t INVALID = ~uintptr_t(0);
+
+	uintptr_t handle;
+
+private:
+
+	static constexpr uint32_t MAX_MESSAGE_SIZE = 1u << 30;
+};
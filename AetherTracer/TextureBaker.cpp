@@ -0,0 +1,629 @@
+#include "TextureBaker.h"
+
+#include "TextureManager.h"
+#include "MaterialManager.h"
+
+#include <emmintrin.h>
+
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <thread>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+namespace {
+
+	struct FileHeader {
+		char magic[4]; // "AETB"
+		uint32_t version;
+		uint32_t format;
+		uint32_t mipCount;
+		uint64_t sourceHash;
+	};
+
+	constexpr uint32_t FILE_VERSION = 1;
+
+	constexpr int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// 4x4 block at (bx, by) of a tiled mip, edge texels repeated past the border
+	void fetchBlock(const TextureManager::Mip& mip, uint32_t bx, uint32_t by, uint8_t rgba[64]) {
+		for (uint32_t y = 0; y < 4; y++) {
+			uint32_t sy = std::min(by * 4 + y, mip.height - 1);
+			for (uint32_t x = 0; x < 4; x++) {
+				uint32_t sx = std::min(bx * 4 + x, mip.width - 1);
+				memcpy(rgba + (y * 4 + x) * 4, TextureManager::texel(mip, sx, sy), 4);
+			}
+		}
+	}
+
+	// per channel min and max of the 16 texels, SSE2
+	void blockBounds(const uint8_t rgba[64], uint8_t lo[4], uint8_t hi[4]) {
+
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 16));
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 32));
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 48));
+
+		__m128i mn = _mm_min_epu8(_mm_min_epu8(a, b), _mm_min_epu8(c, d));
+		__m128i mx = _mm_max_epu8(_mm_max_epu8(a, b), _mm_max_epu8(c, d));
+
+		// four texels left in each register, fold them onto the first
+		mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+		mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+		mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+		mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		uint32_t packedMin = static_cast<uint32_t>(_mm_cvtsi128_si32(mn));
+		uint32_t packedMax = static_cast<uint32_t>(_mm_cvtsi128_si32(mx));
+		memcpy(lo, &packedMin, 4);
+		memcpy(hi, &packedMax, 4);
+	}
+
+	// dot(texel - origin, axis) of the 16 texels, SSE2 16 bit multiply adds
+	void projectBlock(const uint8_t rgba[64], const int origin[4], const int axis[4], int dots[16]) {
+
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i o = _mm_setr_epi16(origin[0], origin[1], origin[2], origin[3], origin[0], origin[1], origin[2], origin[3]);
+		const __m128i w = _mm_setr_epi16(axis[0], axis[1], axis[2], axis[3], axis[0], axis[1], axis[2], axis[3]);
+
+		for (int i = 0; i < 4; i++) {
+			__m128i texels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 16));
+
+			__m128i lo = _mm_madd_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(texels, zero), o), w);
+			__m128i hi = _mm_madd_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(texels, zero), o), w);
+
+			// lanes 0 + 1 and 2 + 3 belong to one texel each
+			lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+			hi = _mm_add_epi32(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+
+			alignas(16) int out[8];
+			_mm_store_si128(reinterpret_cast<__m128i*>(out), lo);
+			_mm_store_si128(reinterpret_cast<__m128i*>(out + 4), hi);
+			dots[i * 4 + 0] = out[0];
+			dots[i * 4 + 1] = out[2];
+			dots[i * 4 + 2] = out[4];
+			dots[i * 4 + 3] = out[6];
+		}
+	}
+
+	// endpoints along the bounding box diagonal that follows the block's colour trend, inset by 1/16 of the range
+	void diagonal(const uint8_t rgba[64], uint32_t channels, int e0[4], int e1[4]) {
+
+		uint8_t lo[4];
+		uint8_t hi[4];
+		blockBounds(rgba, lo, hi);
+
+		uint32_t reference = 0;
+		for (uint32_t c = 1; c < channels; c++) {
+			if (hi[c] - lo[c] > hi[reference] - lo[reference]) reference = c;
+		}
+
+		for (uint32_t c = 0; c < 4; c++) {
+			int inset = (hi[c] - lo[c]) >> 4;
+			e0[c] = hi[c] - inset;
+			e1[c] = lo[c] + inset;
+		}
+
+		// a channel falling while the reference rises runs the other way along the diagonal
+		for (uint32_t c = 0; c < channels; c++) {
+			if (c == reference) continue;
+
+			int centreRef = (lo[reference] + hi[reference]) / 2;
+			int centre = (lo[c] + hi[c]) / 2;
+			int covariance = 0;
+			for (int i = 0; i < 16; i++) covariance += (rgba[i * 4 + reference] - centreRef) * (rgba[i * 4 + c] - centre);
+
+			if (covariance < 0) std::swap(e0[c], e1[c]);
+		}
+	}
+
+	uint16_t to565(const int rgb[4]) {
+		uint32_t r = (rgb[0] * 31 + 127) / 255;
+		uint32_t g = (rgb[1] * 63 + 127) / 255;
+		uint32_t b = (rgb[2] * 31 + 127) / 255;
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	void from565(uint16_t c, int rgb[4]) {
+		int r = (c >> 11) & 31;
+		int g = (c >> 5) & 63;
+		int b = c & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+		rgb[3] = 255;
+	}
+
+	// 128 bit little endian stream for BC7
+	struct BitWriter {
+		uint8_t* block;
+		uint32_t bit = 0;
+		void write(uint32_t value, uint32_t count) {
+			for (uint32_t i = 0; i < count; i++, bit++) {
+				if (value >> i & 1) block[bit >> 3] |= static_cast<uint8_t>(1 << (bit & 7));
+			}
+		}
+	};
+
+	struct BitReader {
+		const uint8_t* block;
+		uint32_t bit = 0;
+		uint32_t read(uint32_t count) {
+			uint32_t value = 0;
+			for (uint32_t i = 0; i < count; i++, bit++) value |= static_cast<uint32_t>(block[bit >> 3] >> (bit & 7) & 1) << i;
+			return value;
+		}
+	};
+
+	void decodeBC4(const uint8_t* block, uint8_t values[16]) {
+
+		int a0 = block[0];
+		int a1 = block[1];
+
+		int palette[8] = { a0, a1 };
+		if (a0 > a1) {
+			for (int i = 2; i < 8; i++) palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+		}
+		else {
+			for (int i = 2; i < 6; i++) palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		uint64_t indices = 0;
+		for (int i = 0; i < 6; i++) indices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+		for (int i = 0; i < 16; i++) values[i] = static_cast<uint8_t>(palette[indices >> (3 * i) & 7]);
+	}
+}
+
+void TextureBaker::bakeMaterialTextures(MaterialManager* materialManager) {
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// colour maps may turn into BC7 when they have alpha, see bake
+	std::unordered_map<std::string, Format> files;
+	for (auto const& [name, file] : materialManager->albedos) files[file] = BC1;
+	for (auto const& [name, file] : materialManager->emissive) files[file] = BC1;
+	for (auto const& [name, file] : materialManager->normal) files[file] = BC5;
+	for (auto const& [name, file] : materialManager->roughness) files[file] = BC4;
+	for (auto const& [name, file] : materialManager->metallic) files[file] = BC4;
+
+	std::vector<std::future<Texture*>> tasks;
+	for (auto const& [file, format] : files) {
+		if (textures.find(file) != textures.end()) continue;
+		tasks.push_back(std::async(std::launch::async, [this, file, format]() { return bake(file, format); }));
+	}
+
+	for (std::future<Texture*>& task : tasks) {
+		Texture* texture = task.get();
+		if (texture) textures[texture->name] = texture;
+	}
+
+	materialManager->assignTextureMaps();
+
+	size_t compressed = 0;
+	size_t uncompressed = 0;
+	for (auto const& [name, texture] : textures) {
+		for (const Mip& mip : texture->mips) {
+			compressed += mip.blocks.size();
+			uncompressed += static_cast<size_t>(mip.width) * mip.height * 4;
+		}
+	}
+
+	float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "Baked " << textures.size() << " textures in " << ms << " ms, " << compressed / 1024 << " KB (" << uncompressed / 1024 << " KB as rgba8)" << std::endl;
+}
+
+TextureBaker::Texture* TextureBaker::bake(const std::string& name, Format format) {
+
+	std::string source = "assets/textures/" + name;
+	std::string path = cachePath(name);
+
+	uint64_t sourceHash = hashFile(source);
+	if (sourceHash == 0) {
+		std::cerr << "Failed to read " << source << std::endl;
+		return nullptr;
+	}
+
+	Texture* cached = readCache(path, sourceHash, format);
+	if (cached) {
+		cached->name = name;
+		return cached;
+	}
+
+	TextureManager loader;
+	TextureManager::Texture* decoded = loader.load(name);
+	if (!decoded) return nullptr;
+
+	// colour with any alpha below 255 needs BC7, BC1 only has a 1 bit cut out
+	if (format == BC1) {
+		const TextureManager::Mip& top = decoded->mips[0];
+		for (uint32_t y = 0; y < top.height && format == BC1; y++) {
+			for (uint32_t x = 0; x < top.width; x++) {
+				if (TextureManager::texel(top, x, y)[3] != 255) {
+					format = BC7;
+					break;
+				}
+			}
+		}
+	}
+
+	Texture* texture = new Texture{ name, format, sourceHash, {} };
+	size_t bytes = blockBytes(format);
+
+	for (const TextureManager::Mip& level : decoded->mips) {
+
+		Mip mip;
+		mip.width = level.width;
+		mip.height = level.height;
+		mip.blocksX = (level.width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		uint32_t blocksY = (level.height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		mip.blocks.assign(static_cast<size_t>(mip.blocksX) * blocksY * bytes, 0);
+
+		auto encodeRows = [&level, &mip, format, bytes](uint32_t first, uint32_t last) {
+			uint8_t rgba[64];
+			for (uint32_t by = first; by < last; by++) {
+				for (uint32_t bx = 0; bx < mip.blocksX; bx++) {
+					fetchBlock(level, bx, by, rgba);
+					uint8_t* block = mip.blocks.data() + (static_cast<size_t>(by) * mip.blocksX + bx) * bytes;
+					switch (format) {
+					case BC1: encodeBC1(rgba, block); break;
+					case BC4: encodeBC4(rgba, 0, block); break;
+					case BC5: encodeBC5(rgba, block); break;
+					case BC7: encodeBC7(rgba, block); break;
+					}
+				}
+			}
+		};
+
+		// the large levels are split into bands of block rows, a few big textures would otherwise leave cores idle
+		uint32_t bands = std::min(std::max(std::thread::hardware_concurrency(), 1u), blocksY / 64);
+		if (bands > 1) {
+			std::vector<std::future<void>> tasks;
+			for (uint32_t band = 0; band < bands; band++) {
+				tasks.push_back(std::async(std::launch::async, encodeRows, blocksY * band / bands, blocksY * (band + 1) / bands));
+			}
+			for (std::future<void>& task : tasks) task.get();
+		}
+		else {
+			encodeRows(0, blocksY);
+		}
+
+		texture->mips.push_back(std::move(mip));
+	}
+
+	delete decoded;
+
+	if (!writeCache(path, *texture)) std::cerr << "Failed to write " << path << std::endl;
+	return texture;
+}
+
+size_t TextureBaker::blockBytes(Format format) {
+	return format == BC5 || format == BC7 ? 16 : 8;
+}
+
+void TextureBaker::encodeBC1(const uint8_t rgba[64], uint8_t* block) {
+
+	int e0[4];
+	int e1[4];
+	diagonal(rgba, 3, e0, e1);
+
+	uint16_t c0 = to565(e0);
+	uint16_t c1 = to565(e1);
+
+	// four colour mode needs c0 > c1, a flat block keeps index 0 everywhere
+	if (c0 < c1) std::swap(c0, c1);
+
+	memcpy(block, &c0, 2);
+	memcpy(block + 2, &c1, 2);
+	memset(block + 4, 0, 4);
+	if (c0 == c1) return;
+
+	// indices from the position along the decoded endpoints, 0 = c1 .. 3 = c0
+	int d0[4];
+	int d1[4];
+	from565(c0, d0);
+	from565(c1, d1);
+	int axis[4] = { d0[0] - d1[0], d0[1] - d1[1], d0[2] - d1[2], 0 };
+	int length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+	int dots[16];
+	projectBlock(rgba, d1, axis, dots);
+
+	static constexpr uint32_t order[4] = { 1, 3, 2, 0 };
+	uint32_t indices = 0;
+	for (int i = 0; i < 16; i++) {
+		int step = std::clamp((dots[i] * 3 + length / 2) / length, 0, 3);
+		indices |= order[step] << (2 * i);
+	}
+	memcpy(block + 4, &indices, 4);
+}
+
+void TextureBaker::encodeBC4(const uint8_t rgba[64], uint32_t channel, uint8_t* block) {
+
+	uint8_t lo[4];
+	uint8_t hi[4];
+	blockBounds(rgba, lo, hi);
+
+	int a0 = hi[channel];
+	int a1 = lo[channel];
+	block[0] = static_cast<uint8_t>(a0);
+	block[1] = static_cast<uint8_t>(a1);
+	memset(block + 2, 0, 6);
+	if (a0 == a1) return;
+
+	// eight value mode, palette position 0 = a1 .. 7 = a0
+	uint64_t indices = 0;
+	int range = a0 - a1;
+	for (int i = 0; i < 16; i++) {
+		int step = ((rgba[i * 4 + channel] - a1) * 7 + range / 2) / range;
+		uint64_t index = step == 0 ? 1 : step == 7 ? 0 : 8 - step;
+		indices |= index << (3 * i);
+	}
+	for (int i = 0; i < 6; i++) block[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+}
+
+void TextureBaker::encodeBC5(const uint8_t rgba[64], uint8_t* block) {
+	encodeBC4(rgba, 0, block);
+	encodeBC4(rgba, 1, block + 8);
+}
+
+void TextureBaker::encodeBC7(const uint8_t rgba[64], uint8_t* block) {
+
+	int e[2][4];
+	diagonal(rgba, 4, e[0], e[1]);
+
+	// 7 bit endpoints with a shared low bit each, the p bit with the smaller error wins
+	int quantized[2][4];
+	int pbit[2];
+	int decoded[2][4];
+	for (int end = 0; end < 2; end++) {
+		int bestError = INT32_MAX;
+		for (int p = 0; p < 2; p++) {
+			int error = 0;
+			int q[4];
+			for (int c = 0; c < 4; c++) {
+				q[c] = std::clamp((e[end][c] - p + 1) >> 1, 0, 127);
+				int value = (q[c] << 1) | p;
+				error += (value - e[end][c]) * (value - e[end][c]);
+			}
+			if (error < bestError) {
+				bestError = error;
+				pbit[end] = p;
+				for (int c = 0; c < 4; c++) quantized[end][c] = q[c];
+			}
+		}
+		for (int c = 0; c < 4; c++) decoded[end][c] = (quantized[end][c] << 1) | pbit[end];
+	}
+
+	int axis[4] = { decoded[1][0] - decoded[0][0], decoded[1][1] - decoded[0][1], decoded[1][2] - decoded[0][2], decoded[1][3] - decoded[0][3] };
+	int length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3];
+
+	int dots[16];
+	projectBlock(rgba, decoded[0], axis, dots);
+
+	uint32_t indices[16] = {};
+	if (length > 0) {
+		for (int i = 0; i < 16; i++) {
+			int weight = std::clamp((dots[i] * 64 + length / 2) / length, 0, 64);
+			uint32_t best = 0;
+			for (uint32_t w = 1; w < 16; w++) {
+				if (std::abs(BC7_WEIGHTS[w] - weight) < std::abs(BC7_WEIGHTS[best] - weight)) best = w;
+			}
+			indices[i] = best;
+		}
+	}
+
+	// the anchor index has no top bit, flipping the endpoints mirrors every weight
+	if (indices[0] & 8) {
+		std::swap(quantized[0], quantized[1]);
+		std::swap(pbit[0], pbit[1]);
+		for (uint32_t& index : indices) index = 15 - index;
+	}
+
+	memset(block, 0, 16);
+	BitWriter writer{ block };
+	writer.write(1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		writer.write(quantized[0][c], 7);
+		writer.write(quantized[1][c], 7);
+	}
+	writer.write(pbit[0], 1);
+	writer.write(pbit[1], 1);
+	writer.write(indices[0], 3);
+	for (int i = 1; i < 16; i++) writer.write(indices[i], 4);
+}
+
+void TextureBaker::decode(Format format, const uint8_t* block, uint8_t out[64]) {
+
+	switch (format) {
+	case BC1: {
+		uint16_t c0;
+		uint16_t c1;
+		memcpy(&c0, block, 2);
+		memcpy(&c1, block + 2, 2);
+
+		int palette[4][4];
+		from565(c0, palette[0]);
+		from565(c1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			if (c0 > c1) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			else {
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+		palette[2][3] = 255;
+		palette[3][3] = c0 > c1 ? 255 : 0;
+
+		uint32_t indices;
+		memcpy(&indices, block + 4, 4);
+		for (int i = 0; i < 16; i++) {
+			const int* colour = palette[indices >> (2 * i) & 3];
+			for (int c = 0; c < 4; c++) out[i * 4 + c] = static_cast<uint8_t>(colour[c]);
+		}
+		break;
+	}
+	case BC4: {
+		uint8_t values[16];
+		decodeBC4(block, values);
+		for (int i = 0; i < 16; i++) {
+			out[i * 4 + 0] = out[i * 4 + 1] = out[i * 4 + 2] = values[i];
+			out[i * 4 + 3] = 255;
+		}
+		break;
+	}
+	case BC5: {
+		// z of the unit normal is rebuilt from x and y
+		uint8_t x[16];
+		uint8_t y[16];
+		decodeBC4(block, x);
+		decodeBC4(block + 8, y);
+		for (int i = 0; i < 16; i++) {
+			float nx = x[i] / 127.5f - 1.0f;
+			float ny = y[i] / 127.5f - 1.0f;
+			float nz = std::sqrt(std::max(1.0f - nx * nx - ny * ny, 0.0f));
+			out[i * 4 + 0] = x[i];
+			out[i * 4 + 1] = y[i];
+			out[i * 4 + 2] = static_cast<uint8_t>(std::lround((nz * 0.5f + 0.5f) * 255.0f));
+			out[i * 4 + 3] = 255;
+		}
+		break;
+	}
+	case BC7: {
+		// only mode 6, the one encodeBC7 writes, anything else decodes to zero
+		BitReader reader{ block };
+		if (reader.read(7) != 1 << 6) {
+			memset(out, 0, 64);
+			break;
+		}
+
+		int endpoints[2][4];
+		for (int c = 0; c < 4; c++) {
+			endpoints[0][c] = reader.read(7) << 1;
+			endpoints[1][c] = reader.read(7) << 1;
+		}
+		uint32_t p0 = reader.read(1);
+		uint32_t p1 = reader.read(1);
+		for (int c = 0; c < 4; c++) {
+			endpoints[0][c] |= p0;
+			endpoints[1][c] |= p1;
+		}
+
+		for (int i = 0; i < 16; i++) {
+			int weight = BC7_WEIGHTS[reader.read(i == 0 ? 3 : 4)];
+			for (int c = 0; c < 4; c++) {
+				out[i * 4 + c] = static_cast<uint8_t>(((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+			}
+		}
+		break;
+	}
+	}
+}
+
+void TextureBaker::texel(const Texture& texture, uint32_t mip, uint32_t x, uint32_t y, uint8_t out[4]) {
+
+	const Mip& level = texture.mips[mip];
+	size_t bytes = blockBytes(texture.format);
+	const uint8_t* block = level.blocks.data() + (static_cast<size_t>(y / BLOCK_SIZE) * level.blocksX + x / BLOCK_SIZE) * bytes;
+
+	uint8_t rgba[64];
+	decode(texture.format, block, rgba);
+	memcpy(out, rgba + ((y % BLOCK_SIZE) * BLOCK_SIZE + x % BLOCK_SIZE) * 4, 4);
+}
+
+uint64_t TextureBaker::hashFile(const std::string& path) {
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return 0;
+
+	// FNV-1a over the bytes of the png
+	uint64_t hash = 0xcbf29ce484222325ull;
+	std::vector<char> chunk(1 << 16);
+	while (file) {
+		file.read(chunk.data(), chunk.size());
+		std::streamsize count = file.gcount();
+		for (std::streamsize i = 0; i < count; i++) {
+			hash ^= static_cast<uint8_t>(chunk[i]);
+			hash *= 0x100000001b3ull;
+		}
+	}
+	return hash;
+}
+
+std::string TextureBaker::cachePath(const std::string& name) {
+	return (std::filesystem::path("assets/textures/cache") / std::filesystem::path(name).stem()).string() + ".aetb";
+}
+
+TextureBaker::Texture* TextureBaker::readCache(const std::string& path, uint64_t sourceHash, Format format) {
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return nullptr;
+
+	FileHeader header = {};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	bool formatMatches = header.format == format || (format == BC1 && header.format == BC7);
+	if (!file || memcmp(header.magic, "AETB", 4) != 0 || header.version != FILE_VERSION || header.sourceHash != sourceHash || !formatMatches) return nullptr;
+
+	Texture* texture = new Texture{ "", static_cast<Format>(header.format), sourceHash, {} };
+	size_t bytes = blockBytes(texture->format);
+
+	for (uint32_t i = 0; i < header.mipCount; i++) {
+		uint32_t size[2] = {};
+		file.read(reinterpret_cast<char*>(size), sizeof(size));
+
+		Mip mip;
+		mip.width = size[0];
+		mip.height = size[1];
+		mip.blocksX = (mip.width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		mip.blocks.resize(static_cast<size_t>(mip.blocksX) * ((mip.height + BLOCK_SIZE - 1) / BLOCK_SIZE) * bytes);
+		texture->mips.push_back(std::move(mip));
+	}
+	for (Mip& mip : texture->mips) file.read(reinterpret_cast<char*>(mip.blocks.data()), mip.blocks.size());
+
+	if (!file) {
+		delete texture;
+		return nullptr;
+	}
+	return texture;
+}
+
+bool TextureBaker::writeCache(const std::string& path, const Texture& texture) {
+
+	std::filesystem::path filePath(path);
+	std::error_code error;
+	std::filesystem::create_directories(filePath.parent_path(), error);
+	std::filesystem::path tempPath = filePath;
+	tempPath += ".tmp";
+
+	{
+		std::ofstream file(tempPath, std::ios::binary);
+
+		FileHeader header = { { 'A', 'E', 'T', 'B' }, FILE_VERSION, texture.format, static_cast<uint32_t>(texture.mips.size()), texture.sourceHash };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		for (const Mip& mip : texture.mips) {
+			uint32_t size[2] = { mip.width, mip.height };
+			file.write(reinterpret_cast<const char*>(size), sizeof(size));
+		}
+		for (const Mip& mip : texture.mips) file.write(reinterpret_cast<const char*>(mip.blocks.data()), mip.blocks.size());
+
+		if (!file) return false;
+	}
+
+	// bakers of other files run at the same time, each renames only its own file
+	std::filesystem::rename(tempPath, filePath, error);
+	return !error;
+}
+
+void TextureBaker::cleanUp() {
+	for (auto const& [name, texture] : textures) delete texture;
+	textures.clear();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <cstdint>
+
+class MaterialManager;
+
+// Offline block compression of the material textures. Albedo and emission go to BC1 (BC7 when they carry alpha),
+// normal maps to BC5 and roughness / metallic to BC4, a single channel at half a byte per texel. Files are baked one
+// task each into assets/textures/cache/<name>.aetb, the header keeps a hash of the source png and a file is only
+// rebaked when that hash changes. decode expands a block again for the software path.
+
+class TextureBaker {
+public:
+
+	enum Format : uint32_t {
+		BC1 = 1, // rgb 565 endpoints, 2 bit indices, 8 bytes a block
+		BC4 = 4, // one channel, 8 bit endpoints, 3 bit indices, 8 bytes
+		BC5 = 5, // two BC4 blocks, red and green
+		BC7 = 7, // mode 6 only: rgba 7+1 bit endpoints, 4 bit indices, 16 bytes
+	};
+
+	static constexpr uint32_t BLOCK_SIZE = 4;
+
+	struct Mip {
+		uint32_t width;
+		uint32_t height;
+		uint32_t blocksX;
+		std::vector<uint8_t> blocks; // block rows top to bottom
+	};
+
+	struct Texture {
+		std::string name; // file name in assets/textures
+		Format format;
+		uint64_t sourceHash;
+		std::vector<Mip> mips; // full size first, down to 1x1
+	};
+
+	TextureBaker() {};
+	~TextureBaker() { cleanUp(); };
+
+	void bakeMaterialTextures(MaterialManager* materialManager); // every file the material maps name, in parallel
+	Texture* bake(const std::string& name, Format format); // cached file when its hash matches, on the calling thread
+
+	static size_t blockBytes(Format format);
+	static void decode(Format format, const uint8_t* block, uint8_t out[64]); // 4x4 rgba8, row major
+	static void texel(const Texture& texture, uint32_t mip, uint32_t x, uint32_t y, uint8_t out[4]);
+
+	void cleanUp();
+
+	std::unordered_map<std::string, Texture*> textures;
+
+private:
+
+	static uint64_t hashFile(const std::string& path);
+	static std::string cachePath(const std::string& name);
+	static Texture* readCache(const std::string& path, uint64_t sourceHash, Format format);
+	static bool writeCache(const std::string& path, const Texture& texture);
+
+	static void encodeBC1(const uint8_t rgba[64], uint8_t* block);
+	static void encodeBC4(const uint8_t rgba[64], uint32_t channel, uint8_t* block);
+	static void encodeBC5(const uint8_t rgba[64], uint8_t* block);
+	static void encodeBC7(const uint8_t rgba[64], uint8_t* block);
+};
@@ -0,0 +1,338 @@
+#include "TextureCache.h"
+
+#include "TextureManager.h"
+#include "MaterialManager.h"
+
+#include <filesystem>
+#include <iostream>
+#include <future>
+#include <thread>
+#include <unordered_set>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+	struct FileHeader {
+		char magic[4]; // "AETT"
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipCount;
+		uint32_t pageSize;
+	};
+
+	constexpr uint32_t FILE_VERSION = 1;
+}
+
+TextureCache::TextureCache(size_t budgetBytes) {
+
+	slotCount = static_cast<uint32_t>(std::max<size_t>(budgetBytes / PAGE_BYTES, 1));
+	slots = std::make_unique<Slot[]>(slotCount);
+	pool.resize(static_cast<size_t>(slotCount) * PAGE_BYTES);
+
+	std::cout << "Texture cache: " << slotCount << " pages, " << pool.size() / (1024 * 1024) << " MB" << std::endl;
+}
+
+TextureCache::~TextureCache() {}
+
+std::string TextureCache::cachePath(const std::string& name) {
+	return (std::filesystem::path("assets/textures/cache") / std::filesystem::path(name).stem()).string() + ".aett";
+}
+
+void TextureCache::addMaterialTextures(MaterialManager* materialManager) {
+
+	std::unordered_set<std::string> files;
+	for (auto* maps : { &materialManager->albedos, &materialManager->roughness, &materialManager->metallic, &materialManager->emissive, &materialManager->normal }) {
+		for (auto const& [name, file] : *maps) files.insert(file);
+	}
+
+	// only sources newer than their paged file are converted, each on its own task
+	std::vector<std::future<bool>> conversions;
+	for (const std::string& file : files) {
+
+		std::string source = "assets/textures/" + file;
+		std::string path = cachePath(file);
+
+		std::error_code error;
+		bool stale = !std::filesystem::exists(path, error) || std::filesystem::last_write_time(path, error) < std::filesystem::last_write_time(source, error);
+		if (stale) conversions.push_back(std::async(std::launch::async, &TextureCache::convert, file, path));
+	}
+	for (std::future<bool>& conversion : conversions) conversion.get();
+
+	for (const std::string& file : files) open(file);
+
+	materialManager->assignTextureMaps();
+}
+
+bool TextureCache::convert(const std::string& name, const std::string& path) {
+
+	TextureManager loader;
+	TextureManager::Texture* texture = loader.load(name);
+	if (!texture) return false;
+
+	std::filesystem::path filePath(path);
+	std::filesystem::create_directories(filePath.parent_path());
+	std::filesystem::path tempPath = filePath;
+	tempPath += ".tmp";
+
+	bool written = false;
+	{
+		std::ofstream file(tempPath, std::ios::binary);
+
+		FileHeader header = { { 'A', 'E', 'T', 'T' }, FILE_VERSION, texture->mips[0].width, texture->mips[0].height, static_cast<uint32_t>(texture->mips.size()), PAGE_SIZE };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		for (const TextureManager::Mip& mip : texture->mips) {
+			uint32_t size[2] = { mip.width, mip.height };
+			file.write(reinterpret_cast<const char*>(size), sizeof(size));
+		}
+
+		// pages row by row, texels row major inside a page, edges padded with zeros
+		std::vector<uint8_t> page(PAGE_BYTES);
+		for (const TextureManager::Mip& mip : texture->mips) {
+
+			uint32_t pagesX = (mip.width + PAGE_SIZE - 1) / PAGE_SIZE;
+			uint32_t pagesY = (mip.height + PAGE_SIZE - 1) / PAGE_SIZE;
+
+			for (uint32_t py = 0; py < pagesY; py++) {
+				for (uint32_t px = 0; px < pagesX; px++) {
+
+					std::fill(page.begin(), page.end(), 0);
+					for (uint32_t y = 0; y < PAGE_SIZE && py * PAGE_SIZE + y < mip.height; y++) {
+						for (uint32_t x = 0; x < PAGE_SIZE && px * PAGE_SIZE + x < mip.width; x++) {
+							memcpy(&page[(y * PAGE_SIZE + x) * 4], TextureManager::texel(mip, px * PAGE_SIZE + x, py * PAGE_SIZE + y), 4);
+						}
+					}
+					file.write(reinterpret_cast<const char*>(page.data()), page.size());
+				}
+			}
+		}
+
+		written = static_cast<bool>(file);
+	}
+
+	delete texture;
+
+	std::error_code error;
+	if (written) std::filesystem::rename(tempPath, filePath, error);
+	if (!written || error) {
+		std::cerr << "Texture cache: can't write " << path << std::endl;
+		return false;
+	}
+
+	std::cout << "Texture cache: converted " << name << std::endl;
+	return true;
+}
+
+int TextureCache::open(const std::string& name) {
+
+	int existing = find(name);
+	if (existing >= 0) return existing;
+
+	auto texture = std::make_unique<Texture>();
+	texture->name = name;
+	texture->file.open(cachePath(name), std::ios::binary);
+
+	FileHeader header = {};
+	texture->file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!texture->file || memcmp(header.magic, "AETT", 4) != 0 || header.version != FILE_VERSION || header.pageSize != PAGE_SIZE) {
+		std::cerr << "Texture cache: " << cachePath(name) << " is missing or out of date" << std::endl;
+		return -1;
+	}
+
+	uint64_t offset = sizeof(FileHeader) + static_cast<uint64_t>(header.mipCount) * sizeof(uint32_t) * 2;
+	for (uint32_t i = 0; i < header.mipCount; i++) {
+
+		uint32_t size[2] = {};
+		texture->file.read(reinterpret_cast<char*>(size), sizeof(size));
+
+		Mip mip;
+		mip.width = size[0];
+		mip.height = size[1];
+		mip.pagesX = (mip.width + PAGE_SIZE - 1) / PAGE_SIZE;
+		mip.pagesY = (mip.height + PAGE_SIZE - 1) / PAGE_SIZE;
+		mip.fileOffset = offset;
+
+		size_t pages = static_cast<size_t>(mip.pagesX) * mip.pagesY;
+		mip.pageTable = std::make_unique<std::atomic<uint32_t>[]>(pages);
+		for (size_t p = 0; p < pages; p++) mip.pageTable[p] = 0;
+
+		offset += pages * PAGE_BYTES;
+		texture->mips.push_back(std::move(mip));
+	}
+
+	if (!texture->file) return -1;
+
+	textures.push_back(std::move(texture));
+	return static_cast<int>(textures.size()) - 1;
+}
+
+int TextureCache::find(const std::string& name) const {
+	for (size_t i = 0; i < textures.size(); i++) {
+		if (textures[i]->name == name) return static_cast<int>(i);
+	}
+	return -1;
+}
+
+uint32_t TextureCache::mipCount(int texture) const {
+	return static_cast<uint32_t>(textures[texture]->mips.size());
+}
+
+uint32_t TextureCache::width(int texture, uint32_t mip) const {
+	return textures[texture]->mips[mip].width;
+}
+
+uint32_t TextureCache::height(int texture, uint32_t mip) const {
+	return textures[texture]->mips[mip].height;
+}
+
+bool TextureCache::tryPin(std::atomic<uint32_t>& entry, uint32_t& slot) {
+
+	uint32_t resident = entry.load();
+	if (resident == 0) return false;
+
+	// a slot being refilled is locked, one refilled since the load above no longer matches the table
+	Slot& candidate = slots[resident - 1];
+	if (candidate.pins.fetch_add(1) & LOCKED) {
+		candidate.pins.fetch_sub(1);
+		return false;
+	}
+	if (entry.load() != resident) {
+		candidate.pins.fetch_sub(1);
+		return false;
+	}
+
+	candidate.referenced.store(1, std::memory_order_relaxed);
+	slot = resident - 1;
+	return true;
+}
+
+TextureCache::Page TextureCache::page(int texture, uint32_t mip, uint32_t x, uint32_t y) {
+
+	Mip& level = textures[texture]->mips[mip];
+	uint32_t px = std::min(x, level.width - 1) / PAGE_SIZE;
+	uint32_t py = std::min(y, level.height - 1) / PAGE_SIZE;
+	uint32_t index = py * level.pagesX + px;
+
+	uint32_t slot = 0;
+	if (tryPin(level.pageTable[index], slot)) {
+		hits.fetch_add(1, std::memory_order_relaxed);
+		return Page{ this, slot, px * PAGE_SIZE, py * PAGE_SIZE };
+	}
+
+	std::unique_ptr<uint8_t[]> bypass;
+	slot = load(texture, mip, index, bypass);
+	if (slot == NO_SLOT) return Page{ std::move(bypass), px * PAGE_SIZE, py * PAGE_SIZE };
+	return Page{ this, slot, px * PAGE_SIZE, py * PAGE_SIZE };
+}
+
+void TextureCache::texel(int texture, uint32_t mip, uint32_t x, uint32_t y, uint8_t out[4]) {
+	Page resident = page(texture, mip, x, y);
+	memcpy(out, resident.texel(x, y), 4);
+}
+
+uint32_t TextureCache::load(int texture, uint32_t mip, uint32_t page, std::unique_ptr<uint8_t[]>& bypass) {
+
+	std::lock_guard<std::mutex> lock(missMutex);
+
+	Mip& level = textures[texture]->mips[mip];
+
+	// another thread may have loaded it while this one waited
+	uint32_t slot = 0;
+	if (tryPin(level.pageTable[page], slot)) {
+		hits.fetch_add(1, std::memory_order_relaxed);
+		return slot;
+	}
+
+	misses.fetch_add(1, std::memory_order_relaxed);
+
+	// every slot pinned by readers, waiting here would hold the mutex against every other miss
+	slot = evict();
+	if (slot == NO_SLOT) {
+		bypass.reset(new uint8_t[PAGE_BYTES]);
+		readPage(texture, mip, page, bypass.get());
+		return NO_SLOT;
+	}
+
+	Slot& target = slots[slot];
+	readPage(texture, mip, page, pool.data() + static_cast<size_t>(slot) * PAGE_BYTES);
+
+	target.texture = texture;
+	target.mip = mip;
+	target.page = page;
+	target.referenced.store(1, std::memory_order_relaxed);
+
+	// pinned for the caller before readers can see it
+	target.pins.fetch_add(1);
+	level.pageTable[page].store(slot + 1);
+	target.pins.fetch_and(~LOCKED);
+
+	return slot;
+}
+
+void TextureCache::readPage(int texture, uint32_t mip, uint32_t page, uint8_t* out) {
+
+	std::ifstream& file = textures[texture]->file;
+	file.clear();
+	file.seekg(static_cast<std::streamoff>(textures[texture]->mips[mip].fileOffset + static_cast<uint64_t>(page) * PAGE_BYTES));
+	file.read(reinterpret_cast<char*>(out), PAGE_BYTES);
+	if (!file) memset(out, 0, PAGE_BYTES);
+}
+
+uint32_t TextureCache::evict() {
+
+	// free slots go first
+	if (used < slotCount) {
+		slots[used].pins.store(LOCKED);
+		return used++;
+	}
+
+	// clock: referenced slots get a second chance, pinned ones are skipped. two full sweeps clear every bit,
+	// after that everything left is pinned
+	for (uint32_t step = 0; step < slotCount * 2; step++) {
+
+		uint32_t slot = hand;
+		hand = (hand + 1) % slotCount;
+
+		Slot& candidate = slots[slot];
+		if (candidate.referenced.exchange(0, std::memory_order_relaxed)) continue;
+
+		uint32_t expected = 0;
+		if (!candidate.pins.compare_exchange_strong(expected, LOCKED)) continue;
+
+		textures[candidate.texture]->mips[candidate.mip].pageTable[candidate.page].store(0);
+		evictions.fetch_add(1, std::memory_order_relaxed);
+		return slot;
+	}
+	return NO_SLOT;
+}
+
+TextureCache::Stats TextureCache::stats() const {
+	return { hits.load(), misses.load(), evictions.load(), used, slotCount };
+}
+
+TextureCache::Page& TextureCache::Page::operator=(Page&& other) noexcept {
+	if (this != &other) {
+		release();
+		cache = other.cache;
+		slot = other.slot;
+		texels = std::move(other.texels);
+		originX = other.originX;
+		originY = other.originY;
+		other.cache = nullptr;
+	}
+	return *this;
+}
+
+const uint8_t* TextureCache::Page::texel(uint32_t x, uint32_t y) const {
+	uint32_t inside = ((y - originY) % PAGE_SIZE) * PAGE_SIZE + (x - originX) % PAGE_SIZE;
+	const uint8_t* page = texels ? texels.get() : cache->pool.data() + static_cast<size_t>(slot) * PAGE_BYTES;
+	return page + static_cast<size_t>(inside) * 4;
+}
+
+void TextureCache::Page::release() {
+	if (cache) cache->slots[slot].pins.fetch_sub(1);
+	cache = nullptr;
+	texels.reset();
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <fstream>
+
+class MaterialManager;
+
+// Out of core textures. Each source image is converted once into assets/textures/cache/<name>.aett, every mip
+// cut into 64x64 texel pages, and pages are read on demand into a fixed pool sized by config.textureCacheMB.
+//
+// Lookups are lock free: every mip has a page table of atomics holding the resident slot, a reader pins the slot
+// and checks the table still points at it. Only misses take the mutex, they load the page from disk and evict with
+// the clock algorithm (an LRU approximation, a hit sets the slot's reference bit and the hand clears it). Pinned
+// slots are never evicted, when every slot is pinned the miss reads its page into a private copy instead.
+
+class TextureCache {
+public:
+
+	static constexpr uint32_t PAGE_SIZE = 64; // texels per side
+	static constexpr size_t PAGE_BYTES = PAGE_SIZE * PAGE_SIZE * 4; // rgba8, row major inside the page
+
+	struct Stats {
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+		uint32_t residentPages;
+		uint32_t capacityPages;
+	};
+
+	class Page; // pinned while alive, the texels can't be evicted from under it
+
+	TextureCache(size_t budgetBytes);
+	~TextureCache();
+
+	void addMaterialTextures(MaterialManager* materialManager); // converts stale files in parallel, then opens them
+	int open(const std::string& name); // texture index, -1 if it can't be converted
+	int find(const std::string& name) const;
+
+	uint32_t mipCount(int texture) const;
+	uint32_t width(int texture, uint32_t mip) const;
+	uint32_t height(int texture, uint32_t mip) const;
+
+	Page page(int texture, uint32_t mip, uint32_t x, uint32_t y); // page holding texel (x, y)
+	void texel(int texture, uint32_t mip, uint32_t x, uint32_t y, uint8_t out[4]); // single texel, pins only for the copy
+
+	Stats stats() const;
+
+	static bool convert(const std::string& name, const std::string& path); // png in assets/textures to the paged file
+
+private:
+
+	struct Mip {
+		uint32_t width;
+		uint32_t height;
+		uint32_t pagesX;
+		uint32_t pagesY;
+		uint64_t fileOffset; // of the first page
+		std::unique_ptr<std::atomic<uint32_t>[]> pageTable; // resident slot + 1, 0 = on disk
+	};
+
+	struct Texture {
+		std::string name;
+		std::ifstream file;
+		std::vector<Mip> mips;
+	};
+
+	struct Slot {
+		std::atomic<uint32_t> pins = 0; // readers, LOCKED while the slot is being refilled
+		std::atomic<uint32_t> referenced = 0;
+		int texture = -1; // page held, only written under the mutex with the slot locked
+		uint32_t mip = 0;
+		uint32_t page = 0;
+	};
+
+	static constexpr uint32_t LOCKED = 0x80000000u;
+	static constexpr uint32_t NO_SLOT = 0xffffffffu;
+
+	bool tryPin(std::atomic<uint32_t>& entry, uint32_t& slot);
+	uint32_t load(int texture, uint32_t mip, uint32_t page, std::unique_ptr<uint8_t[]>& bypass); // NO_SLOT with the page in bypass if all are pinned
+	void readPage(int texture, uint32_t mip, uint32_t page, uint8_t* out); // under missMutex
+	uint32_t evict(); // locked free slot, NO_SLOT if every slot is pinned
+
+	static std::string cachePath(const std::string& name);
+
+	std::vector<std::unique_ptr<Texture>> textures; // only grows, open is not called while rendering
+	std::unique_ptr<Slot[]> slots;
+	uint32_t slotCount = 0;
+	std::vector<uint8_t> pool; // slotCount pages
+	uint32_t hand = 0;
+	uint32_t used = 0;
+	std::mutex missMutex;
+
+	std::atomic<uint64_t> hits = 0;
+	std::atomic<uint64_t> misses = 0;
+	std::atomic<uint64_t> evictions = 0;
+
+	friend class Page;
+
+public:
+
+	class Page {
+	public:
+		Page() {};
+		Page(TextureCache* cache, uint32_t slot, uint32_t originX, uint32_t originY) : cache(cache), slot(slot), originX(originX), originY(originY) {};
+		Page(std::unique_ptr<uint8_t[]> texels, uint32_t originX, uint32_t originY) : texels(std::move(texels)), originX(originX), originY(originY) {};
+		~Page() { release(); };
+
+		Page(const Page&) = delete;
+		Page& operator=(const Page&) = delete;
+		Page(Page&& other) noexcept { *this = std::move(other); };
+		Page& operator=(Page&& other) noexcept;
+
+		bool valid() const { return cache != nullptr || texels != nullptr; }
+		const uint8_t* texel(uint32_t x, uint32_t y) const; // mip coordinates inside this page
+
+	private:
+		void release();
+
+		TextureCache* cache = nullptr;
+		uint32_t slot = 0;
+		std::unique_ptr<uint8_t[]> texels; // private copy read past the cache, cache is null
+		uint32_t originX = 0;
+		uint32_t originY = 0;
+	};
+};
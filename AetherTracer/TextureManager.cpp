@@ -0,0 +1,191 @@
+#include "TextureManager.h"
+
+#include "MaterialManager.h"
+
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <wincodec.h>
+#pragma comment(lib, "windowscodecs")
+#pragma comment(lib, "ole32")
+
+#include <emmintrin.h>
+
+#include <future>
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <unordered_set>
+#include <algorithm>
+
+void TextureManager::loadMaterialTextures(MaterialManager* materialManager) {
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::unordered_set<std::string> files;
+	for (auto* maps : { &materialManager->albedos, &materialManager->roughness, &materialManager->metallic, &materialManager->emissive, &materialManager->normal }) {
+		for (auto const& [name, file] : *maps) {
+			if (textures.find(file) == textures.end()) files.insert(file);
+		}
+	}
+
+	// decode and mip generation are independent per file, the slowest file sets the load time
+	std::vector<std::future<Texture*>> tasks;
+	for (const std::string& file : files) {
+		tasks.push_back(std::async(std::launch::async, [this, file]() { return load(file); }));
+	}
+
+	for (std::future<Texture*>& task : tasks) {
+		Texture* texture = task.get();
+		if (texture) textures[texture->name] = texture;
+	}
+
+	materialManager->assignTextureMaps();
+
+	float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "Loaded " << textures.size() << " textures in " << ms << " ms" << std::endl;
+}
+
+TextureManager::Texture* TextureManager::load(const std::string& name) {
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint8_t> level;
+	if (!decode("assets/textures/" + name, width, height, level)) return nullptr;
+
+	Texture* texture = new Texture{ name, {} };
+
+	// each level is tiled once it has been used as the source of the next
+	std::vector<uint8_t> next;
+	while (true) {
+		texture->mips.push_back(tile(width, height, level));
+		if (width == 1 && height == 1) break;
+
+		downsample(width, height, level, next);
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+		level.swap(next);
+	}
+
+	return texture;
+}
+
+bool TextureManager::decode(const std::string& path, uint32_t& width, uint32_t& height, std::vector<uint8_t>& rgba) {
+
+	// every loader thread needs its own COM apartment
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	bool uninitialize = SUCCEEDED(hr);
+
+	IWICImagingFactory* factory = nullptr;
+	IWICBitmapDecoder* decoder = nullptr;
+	IWICBitmapFrameDecode* frame = nullptr;
+	IWICFormatConverter* converter = nullptr;
+
+	hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+	if (SUCCEEDED(hr)) hr = factory->CreateDecoderFromFilename(std::filesystem::path(path).wstring().c_str(), nullptr, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder);
+	if (SUCCEEDED(hr)) hr = decoder->GetFrame(0, &frame);
+	if (SUCCEEDED(hr)) hr = factory->CreateFormatConverter(&converter);
+	if (SUCCEEDED(hr)) hr = converter->Initialize(frame, GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom);
+	if (SUCCEEDED(hr)) hr = converter->GetSize(&width, &height);
+
+	if (SUCCEEDED(hr)) {
+		rgba.resize(static_cast<size_t>(width) * height * 4);
+		hr = converter->CopyPixels(nullptr, width * 4, static_cast<UINT>(rgba.size()), rgba.data());
+	}
+
+	if (converter) converter->Release();
+	if (frame) frame->Release();
+	if (decoder) decoder->Release();
+	if (factory) factory->Release();
+	if (uninitialize) CoUninitialize();
+
+	if (FAILED(hr)) {
+		std::cerr << "Failed to decode " << path << " HRESULT 0x" << std::hex << hr << std::dec << std::endl;
+		return false;
+	}
+	return true;
+}
+
+TextureManager::Mip TextureManager::tile(uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba) {
+
+	Mip mip;
+	mip.width = width;
+	mip.height = height;
+	mip.tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	uint32_t tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+	// edge tiles are padded with zeros
+	mip.texels.assign(static_cast<size_t>(mip.tilesX) * tilesY * TILE_SIZE * TILE_SIZE * 4, 0);
+
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t* row = rgba.data() + static_cast<size_t>(y) * width * 4;
+		for (uint32_t x = 0; x < width; x += TILE_SIZE) {
+			uint32_t count = std::min(TILE_SIZE, width - x);
+			uint8_t* dst = const_cast<uint8_t*>(texel(mip, x, y));
+			memcpy(dst, row + static_cast<size_t>(x) * 4, count * 4);
+		}
+	}
+
+	return mip;
+}
+
+const uint8_t* TextureManager::texel(const Mip& mip, uint32_t x, uint32_t y) {
+	size_t tile = static_cast<size_t>(y / TILE_SIZE) * mip.tilesX + x / TILE_SIZE;
+	size_t inside = (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE;
+	return mip.texels.data() + (tile * TILE_SIZE * TILE_SIZE + inside) * 4;
+}
+
+void TextureManager::downsample(uint32_t width, uint32_t height, const std::vector<uint8_t>& src, std::vector<uint8_t>& dst) {
+
+	uint32_t outWidth = std::max(width / 2, 1u);
+	uint32_t outHeight = std::max(height / 2, 1u);
+	dst.resize(static_cast<size_t>(outWidth) * outHeight * 4);
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(2);
+
+	for (uint32_t y = 0; y < outHeight; y++) {
+
+		// odd sizes drop the last row and column, a 1 texel side repeats itself
+		const uint8_t* row0 = src.data() + static_cast<size_t>(std::min(y * 2, height - 1)) * width * 4;
+		const uint8_t* row1 = src.data() + static_cast<size_t>(std::min(y * 2 + 1, height - 1)) * width * 4;
+		uint8_t* out = dst.data() + static_cast<size_t>(y) * outWidth * 4;
+
+		uint32_t x = 0;
+
+		// two output texels from 2x4 input texels, summed as 16 bit lanes
+		if (width >= 4) {
+			for (; x + 2 <= outWidth && x * 2 + 4 <= width; x += 2) {
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)); // texels 0, 1
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)); // texels 2, 3
+
+				lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+				hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+				__m128i sum = _mm_unpacklo_epi64(lo, hi);
+				sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(sum, zero));
+			}
+		}
+
+		for (; x < outWidth; x++) {
+			uint32_t x0 = std::min(x * 2, width - 1);
+			uint32_t x1 = std::min(x * 2 + 1, width - 1);
+			for (int c = 0; c < 4; c++) {
+				uint32_t sum = row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c];
+				out[x * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+void TextureManager::cleanUp() {
+	for (auto& [name, texture] : textures) {
+		delete texture;
+	}
+	textures.clear();
+}
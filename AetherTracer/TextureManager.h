@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <cstdint>
+
+class MaterialManager;
+
+// Decodes the material textures listed by MaterialManager::initTextures, one task per file across the cores,
+// and builds the mip chain of each on the same task. Texels are stored in 8x8 tiles (256 bytes of rgba8) so a
+// filtered lookup touches one or two cache lines instead of a row each.
+
+class TextureManager {
+public:
+
+	static constexpr uint32_t TILE_SIZE = 8;
+
+	struct Mip {
+		uint32_t width;
+		uint32_t height;
+		uint32_t tilesX; // width rounded up to whole tiles
+		std::vector<uint8_t> texels; // rgba8, tile after tile, texels row major inside a tile
+	};
+
+	struct Texture {
+		std::string name; // file name in assets/textures
+		std::vector<Mip> mips; // full size first, down to 1x1
+	};
+
+	TextureManager() {};
+	~TextureManager() { cleanUp(); };
+
+	void loadMaterialTextures(MaterialManager* materialManager); // every file the material maps name, in parallel
+	Texture* load(const std::string& name); // single file, on the calling thread
+
+	static const uint8_t* texel(const Mip& mip, uint32_t x, uint32_t y);
+
+	void cleanUp();
+
+	std::unordered_map<std::string, Texture*> textures;
+
+private:
+
+	static bool decode(const std::string& path, uint32_t& width, uint32_t& height, std::vector<uint8_t>& rgba);
+	static Mip tile(uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba);
+	static void downsample(uint32_t width, uint32_t height, const std::vector<uint8_t>& src, std::vector<uint8_t>& dst); // 2x2 box, SSE2
+};
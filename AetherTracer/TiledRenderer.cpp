@@ -0,0 +1,100 @@
+#include "TiledRenderer.h"
+
+#include "AetherTracer.h"
+#include "BatchRenderer.h"
+#include "DX12Renderer.h"
+#include "ImageWriter.h"
+#include "Config.h"
+
+#include <vector>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+int TiledRenderer::run() {
+
+	if (config.sampleTarget <= 0 && config.renderDeadline <= 0.0f) {
+		std::cerr << "Tiled: needs --samples or --deadline per tile" << std::endl;
+		return 1;
+	}
+
+	int samples = config.sampleTarget;
+	float seconds = config.renderDeadline;
+
+	// anything that looks at neighbouring pixels would see the tile edge
+	config.resX = static_cast<uint32_t>(config.tileSize);
+	config.resY = static_cast<uint32_t>(config.tileSize);
+	config.accumulate = true;
+	config.denoise = false;
+	config.temporalReprojection = false;
+	config.dynamicResolution = false;
+	config.quitWhenFinished = false;
+
+	// each tile would meter only itself and the stitched image would show the seams
+	if (config.autoExposure) std::cout << "Tiled: auto exposure is off, tiles use --exposure " << config.exposure << std::endl;
+	config.autoExposure = false;
+
+	AetherTracer* tracer = new AetherTracer{};
+	tracer->init();
+
+	ResourceManager* rm = tracer->dx12Renderer->rm;
+	rm->imageWidth = width;
+	rm->imageHeight = height;
+
+	// the window decides the texture size, use whatever it came out as
+	uint32_t tileWidth = rm->width;
+	uint32_t tileHeight = rm->height;
+	uint32_t tilesX = (width + tileWidth - 1) / tileWidth;
+	uint32_t tilesY = (height + tileHeight - 1) / tileHeight;
+
+	std::cout << "Tiled: " << width << "x" << height << " as " << tilesX << "x" << tilesY << " tiles of " << tileWidth << "x" << tileHeight << std::endl;
+
+	ScanlineWriter writer;
+	if (!writer.open(config.outputPath, width, height)) {
+		tracer->shutdown();
+		delete tracer;
+		return 1;
+	}
+
+	std::vector<uint8_t> band(static_cast<size_t>(width) * tileHeight * 4);
+	std::vector<uint8_t> pixels;
+	bool complete = true;
+
+	for (uint32_t ty = 0; ty < tilesY && complete; ty++) {
+
+		uint32_t y0 = ty * tileHeight;
+		uint32_t rows = std::min(tileHeight, height - y0);
+
+		for (uint32_t tx = 0; tx < tilesX; tx++) {
+
+			uint32_t x0 = tx * tileWidth;
+			uint32_t columns = std::min(tileWidth, width - x0);
+
+			rm->tileOriginX = x0;
+			rm->tileOriginY = y0;
+
+			if (!BatchRenderer::renderShot(tracer, samples, seconds)) {
+				std::cout << "Tiled: window closed, stopping" << std::endl;
+				complete = false;
+				break;
+			}
+
+			// edge tiles hang over the image, only the part inside is kept
+			tracer->dx12Renderer->readRenderTarget(pixels);
+			for (uint32_t row = 0; row < rows; row++) {
+				memcpy(band.data() + (static_cast<size_t>(row) * width + x0) * 4, pixels.data() + static_cast<size_t>(row) * tileWidth * 4, static_cast<size_t>(columns) * 4);
+			}
+
+			std::cout << "Tiled: tile " << ty * tilesX + tx + 1 << "/" << tilesX * tilesY << std::endl;
+		}
+
+		if (complete) complete = writer.writeRows(rows, band.data());
+	}
+
+	bool written = writer.close();
+
+	tracer->shutdown();
+	delete tracer;
+
+	return complete && written ? 0 : 1;
+}
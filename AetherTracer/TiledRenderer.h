@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+// Renders an output far larger than the GPU textures, e.g. print resolutions. The renderer is created at tile size
+// and the camera covers the full image, each dispatch traces one tile of it with the same random numbers a single
+// full size dispatch would use. Tiles go across a band, finished bands are streamed to the PNG, so GPU memory
+// depends on the tile size and CPU memory on one band of 8 bit rows.
+
+class TiledRenderer {
+public:
+
+	TiledRenderer(uint32_t width, uint32_t height) : width(width), height(height) {};
+	~TiledRenderer() {};
+
+	int run();
+
+private:
+
+	uint32_t width;
+	uint32_t height;
+};
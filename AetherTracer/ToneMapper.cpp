@@ -0,0 +1,252 @@
+#include "ToneMapper.h"
+
+#include <immintrin.h>
+#include <intrin.h>
+
+#include <future>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+	constexpr float LUMINANCE_R = 0.2126f;
+	constexpr float LUMINANCE_G = 0.7152f;
+	constexpr float LUMINANCE_B = 0.0722f;
+
+	// runs fn(firstRow, lastRow) on one band of rows per hardware thread
+	template <typename Fn>
+	void forEachBand(uint32_t height, Fn fn) {
+
+		uint32_t bands = std::min(std::max(std::thread::hardware_concurrency(), 1u), height);
+		std::vector<std::future<void>> tasks;
+		for (uint32_t band = 1; band < bands; band++) {
+			tasks.push_back(std::async(std::launch::async, fn, band, height * band / bands, height * (band + 1) / bands));
+		}
+		fn(0, 0, bands > 0 ? height / bands : height);
+		for (std::future<void>& task : tasks) task.get();
+	}
+
+	// 8 rgba pixels to one register per channel, p0..p3 in the low lane, p4..p7 in the high lane
+	inline void loadPixels(const float* pixels, __m256& r, __m256& g, __m256& b, __m256& a) {
+
+		__m256 p04 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pixels + 0)), _mm_loadu_ps(pixels + 16), 1);
+		__m256 p15 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pixels + 4)), _mm_loadu_ps(pixels + 20), 1);
+		__m256 p26 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pixels + 8)), _mm_loadu_ps(pixels + 24), 1);
+		__m256 p37 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pixels + 12)), _mm_loadu_ps(pixels + 28), 1);
+
+		__m256 rg01 = _mm256_unpacklo_ps(p04, p15);
+		__m256 rg23 = _mm256_unpacklo_ps(p26, p37);
+		__m256 ba01 = _mm256_unpackhi_ps(p04, p15);
+		__m256 ba23 = _mm256_unpackhi_ps(p26, p37);
+
+		r = _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(1, 0, 1, 0));
+		g = _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(3, 2, 3, 2));
+		b = _mm256_shuffle_ps(ba01, ba23, _MM_SHUFFLE(1, 0, 1, 0));
+		a = _mm256_shuffle_ps(ba01, ba23, _MM_SHUFFLE(3, 2, 3, 2));
+	}
+
+	inline float meanLuminance(const float* pixel, float exposure, float& scale) {
+		scale = exposure / std::max(pixel[3], 1.0f);
+		return (LUMINANCE_R * pixel[0] + LUMINANCE_G * pixel[1] + LUMINANCE_B * pixel[2]) * scale;
+	}
+
+	void reduceRowsAVX2(const float* accumulation, uint32_t width, uint32_t first, uint32_t last, float& maxLuminance, double& sum) {
+
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 weightR = _mm256_set1_ps(LUMINANCE_R);
+		const __m256 weightG = _mm256_set1_ps(LUMINANCE_G);
+		const __m256 weightB = _mm256_set1_ps(LUMINANCE_B);
+
+		__m256 maxVector = _mm256_setzero_ps();
+
+		for (uint32_t y = first; y < last; y++) {
+			const float* row = accumulation + static_cast<size_t>(y) * width * 4;
+			__m256 sumVector = _mm256_setzero_ps();
+
+			uint32_t x = 0;
+			for (; x + 8 <= width; x += 8) {
+				__m256 r, g, b, a;
+				loadPixels(row + x * 4, r, g, b, a);
+
+				__m256 rcp = _mm256_div_ps(one, _mm256_max_ps(a, one));
+				__m256 luminance = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, weightR), _mm256_mul_ps(g, weightG)), _mm256_mul_ps(b, weightB)), rcp);
+
+				maxVector = _mm256_max_ps(maxVector, luminance);
+				sumVector = _mm256_add_ps(sumVector, luminance);
+			}
+
+			// a row of floats is summed before it goes into the double
+			alignas(32) float lanes[8];
+			_mm256_store_ps(lanes, sumVector);
+			double rowSum = 0.0;
+			for (float lane : lanes) rowSum += lane;
+
+			for (; x < width; x++) {
+				float scale;
+				float luminance = meanLuminance(row + x * 4, 1.0f, scale);
+				maxLuminance = std::max(maxLuminance, luminance);
+				rowSum += luminance;
+			}
+			sum += rowSum;
+		}
+
+		alignas(32) float lanes[8];
+		_mm256_store_ps(lanes, maxVector);
+		for (float lane : lanes) maxLuminance = std::max(maxLuminance, lane);
+	}
+
+	void reduceRowsScalar(const float* accumulation, uint32_t width, uint32_t first, uint32_t last, float& maxLuminance, double& sum) {
+		for (uint32_t y = first; y < last; y++) {
+			const float* row = accumulation + static_cast<size_t>(y) * width * 4;
+			double rowSum = 0.0;
+			for (uint32_t x = 0; x < width; x++) {
+				float scale;
+				float luminance = meanLuminance(row + x * 4, 1.0f, scale);
+				maxLuminance = std::max(maxLuminance, luminance);
+				rowSum += luminance;
+			}
+			sum += rowSum;
+		}
+	}
+
+	inline uint32_t mapPixel(const float* pixel, float exposure, float invMaxSquared, const uint32_t* lut) {
+
+		float scale;
+		float luminance = meanLuminance(pixel, exposure, scale);
+
+		// extended Reinhard mapped / luminance, the colour keeps its ratios
+		if (luminance > 0.0f) scale *= (1.0f + luminance * invMaxSquared) / (1.0f + luminance);
+
+		uint32_t out = 0xFF000000u;
+		for (int c = 0; c < 3; c++) {
+			float value = std::clamp(pixel[c] * scale, 0.0f, 1.0f);
+			out |= lut[static_cast<uint32_t>(std::sqrt(value) * (ToneMapper::GAMMA_LUT_SIZE - 1) + 0.5f)] << (8 * c);
+		}
+		return out;
+	}
+
+	void mapRowsAVX2(const float* accumulation, uint32_t width, uint32_t first, uint32_t last, float exposure, float invMaxSquared, const uint32_t* lut, uint8_t* rgba) {
+
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 exposureVector = _mm256_set1_ps(exposure);
+		const __m256 weightR = _mm256_set1_ps(LUMINANCE_R);
+		const __m256 weightG = _mm256_set1_ps(LUMINANCE_G);
+		const __m256 weightB = _mm256_set1_ps(LUMINANCE_B);
+		const __m256 invMax = _mm256_set1_ps(invMaxSquared);
+		const __m256 lutScale = _mm256_set1_ps(static_cast<float>(ToneMapper::GAMMA_LUT_SIZE - 1));
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+		const int* table = reinterpret_cast<const int*>(lut);
+
+		for (uint32_t y = first; y < last; y++) {
+			const float* row = accumulation + static_cast<size_t>(y) * width * 4;
+			uint32_t* out = reinterpret_cast<uint32_t*>(rgba) + static_cast<size_t>(y) * width;
+
+			uint32_t x = 0;
+			for (; x + 8 <= width; x += 8) {
+				__m256 r, g, b, a;
+				loadPixels(row + x * 4, r, g, b, a);
+
+				// exposed mean colour, then the Reinhard ratio, the exposure and the sample count folded into one scale
+				__m256 rcp = _mm256_div_ps(exposureVector, _mm256_max_ps(a, one));
+				__m256 luminance = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, weightR), _mm256_mul_ps(g, weightG)), _mm256_mul_ps(b, weightB)), rcp);
+				__m256 ratio = _mm256_div_ps(_mm256_add_ps(one, _mm256_mul_ps(luminance, invMax)), _mm256_add_ps(one, luminance));
+				__m256 scale = _mm256_mul_ps(rcp, _mm256_blendv_ps(one, ratio, _mm256_cmp_ps(luminance, zero, _CMP_GT_OQ)));
+
+				__m256i ir = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_sqrt_ps(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(r, scale), zero), one)), lutScale), half));
+				__m256i ig = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_sqrt_ps(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(g, scale), zero), one)), lutScale), half));
+				__m256i ib = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_sqrt_ps(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(b, scale), zero), one)), lutScale), half));
+
+				__m256i packed = _mm256_or_si256(alpha, _mm256_i32gather_epi32(table, ir, 4));
+				packed = _mm256_or_si256(packed, _mm256_slli_epi32(_mm256_i32gather_epi32(table, ig, 4), 8));
+				packed = _mm256_or_si256(packed, _mm256_slli_epi32(_mm256_i32gather_epi32(table, ib, 4), 16));
+
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), packed);
+			}
+
+			for (; x < width; x++) out[x] = mapPixel(row + x * 4, exposure, invMaxSquared, lut);
+		}
+	}
+
+	void mapRowsScalar(const float* accumulation, uint32_t width, uint32_t first, uint32_t last, float exposure, float invMaxSquared, const uint32_t* lut, uint8_t* rgba) {
+		for (uint32_t y = first; y < last; y++) {
+			const float* row = accumulation + static_cast<size_t>(y) * width * 4;
+			uint32_t* out = reinterpret_cast<uint32_t*>(rgba) + static_cast<size_t>(y) * width;
+			for (uint32_t x = 0; x < width; x++) out[x] = mapPixel(row + x * 4, exposure, invMaxSquared, lut);
+		}
+	}
+}
+
+ToneMapper::ToneMapper() {
+
+	gammaLUT.resize(GAMMA_LUT_SIZE);
+	for (uint32_t i = 0; i < GAMMA_LUT_SIZE; i++) {
+		float root = static_cast<float>(i) / (GAMMA_LUT_SIZE - 1);
+		float linear = root * root;
+		gammaLUT[i] = static_cast<uint32_t>(std::lround(std::pow(linear, 1.0f / 2.2f) * 255.0f));
+	}
+}
+
+bool ToneMapper::hasAVX2() {
+
+	static const bool supported = []() {
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+
+		// the OS has to save the ymm registers as well
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	}();
+	return supported;
+}
+
+ToneMapper::Luminance ToneMapper::reduce(const float* accumulation, uint32_t width, uint32_t height) const {
+
+	uint32_t bands = std::min(std::max(std::thread::hardware_concurrency(), 1u), std::max(height, 1u));
+	std::vector<float> maxima(bands, 0.0f);
+	std::vector<double> sums(bands, 0.0);
+	bool avx2 = hasAVX2();
+
+	forEachBand(height, [&](uint32_t band, uint32_t first, uint32_t last) {
+		if (avx2) reduceRowsAVX2(accumulation, width, first, last, maxima[band], sums[band]);
+		else reduceRowsScalar(accumulation, width, first, last, maxima[band], sums[band]);
+	});
+
+	Luminance luminance = { 0.0f, 0.0f };
+	double sum = 0.0;
+	for (uint32_t band = 0; band < bands; band++) {
+		luminance.max = std::max(luminance.max, maxima[band]);
+		sum += sums[band];
+	}
+	size_t pixels = static_cast<size_t>(width) * height;
+	luminance.average = pixels > 0 ? static_cast<float>(sum / pixels) : 0.0f;
+	return luminance;
+}
+
+void ToneMapper::map(const float* accumulation, uint32_t width, uint32_t height, float maxLuminance, float exposure, uint8_t* rgba) const {
+
+	// the white point moves with the exposure, the brightest pixel still maps to white
+	float white = maxLuminance * exposure;
+	float invMaxSquared = 1.0f / std::max(white * white, 1e-8f);
+	bool avx2 = hasAVX2();
+	const uint32_t* lut = gammaLUT.data();
+
+	forEachBand(height, [&](uint32_t band, uint32_t first, uint32_t last) {
+		if (avx2) mapRowsAVX2(accumulation, width, first, last, exposure, invMaxSquared, lut, rgba);
+		else mapRowsScalar(accumulation, width, first, last, exposure, invMaxSquared, lut, rgba);
+	});
+}
+
+void ToneMapper::apply(const std::vector<float>& accumulation, uint32_t width, uint32_t height, float exposure, std::vector<uint8_t>& rgba) const {
+	rgba.resize(static_cast<size_t>(width) * height * 4);
+	Luminance luminance = reduce(accumulation.data(), width, height);
+	map(accumulation.data(), width, height, luminance.max, exposure, rgba.data());
+}
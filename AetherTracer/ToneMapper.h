@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// CPU counterpart of the tone map pass in postprocessingshader.hlsl, exposure then extended Reinhard on luminance then
+// gamma 2.2, for accumulations that never reach the GPU render target. Input is the raw accumulation, rgb sum and
+// sample count per pixel, the divide by the count and the exposure are one scale in the same pass. Rows are split across threads and mapped 8 pixels at
+// a time with AVX2 when the CPU has it, gamma is a table lookup.
+
+class ToneMapper {
+public:
+
+	struct Luminance {
+		float max;
+		float average;
+	};
+
+	ToneMapper();
+	~ToneMapper() {};
+
+	Luminance reduce(const float* accumulation, uint32_t width, uint32_t height) const; // of the mean colours
+	void map(const float* accumulation, uint32_t width, uint32_t height, float maxLuminance, float exposure, uint8_t* rgba) const; // maxLuminance before exposure, as reduce returns it
+	void apply(const std::vector<float>& accumulation, uint32_t width, uint32_t height, float exposure, std::vector<uint8_t>& rgba) const; // white point at the max luminance
+
+	static bool hasAVX2();
+
+	static constexpr uint32_t GAMMA_LUT_SIZE = 4096;
+
+private:
+
+	std::vector<uint32_t> gammaLUT; // indexed by sqrt of the linear value so the steep end near black gets more entries, 32 bit for the AVX2 gather
+};
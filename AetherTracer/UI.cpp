@@ -9,10 +9,22 @@ bool UI::isWindowHovered = false;
 bool UI::accelUpdate = false; // reset by the renderer
 bool UI::accumulationUpdate = false; // reset by the renderer
 bool UI::renderUI = true;
+bool UI::runBenchmark = false; // reset by the app
+bool UI::runLightSamplingComparison = false; // reset by the app
+bool UI::saveSnapshot = false; // reset by the app
 
 uint64_t UI::raysPerSecond = 0;
 float UI::frameTime = 0;
 uint32_t UI::numRays = 0;
+uint32_t UI::activeTiles = 0;
+uint32_t UI::numTiles = 0;
+float UI::passCost = 0;
+uint32_t UI::internalWidth = 0;
+uint32_t UI::internalHeight = 0;
+uint64_t UI::textureCacheHits = 0;
+uint64_t UI::textureCacheMisses = 0;
+uint64_t UI::textureCacheEvictions = 0;
+uint32_t UI::textureCachePages = 0;
 
 void UI::renderSettings() {
 
@@ -31,6 +43,12 @@ void UI::renderSettings() {
 
     ImGui::Text("Num Rays: %d", numRays);
 
+    if (config.textureCacheMB > 0) {
+        uint64_t lookups = textureCacheHits + textureCacheMisses;
+        ImGui::Text("Texture Cache: %u pages, %.1f%% hits", textureCachePages, lookups ? 100.0 * textureCacheHits / lookups : 0.0);
+        ImGui::Text("Misses: %llu  Evictions: %llu", textureCacheMisses, textureCacheEvictions);
+    }
+
     if (ImGui::Checkbox("Accumulate", &config.accumulate));
 
     ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x); // Set width to the available space
@@ -63,6 +81,150 @@ void UI::renderSettings() {
         accumulationUpdate = true;
     }
 
+    if (ImGui::Checkbox("Light Sampling", &config.lightSampling)) {
+        accumulationUpdate = true;
+    }
+
+    ImGui::Checkbox("Auto Exposure", &config.autoExposure);
+
+    if (config.autoExposure) {
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderFloat("##Exposure low percentile", &config.exposureLowPercentile, 0.0f, 1.0f, "Low Percentile %.2f");
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderFloat("##Exposure high percentile", &config.exposureHighPercentile, 0.0f, 1.0f, "High Percentile %.2f");
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderFloat("##Exposure speed", &config.exposureSpeed, 0.1f, 10.0f, "Adaptation %.1f /s");
+    }
+
+    ImGui::Checkbox("Time Budget", &config.timeBudget);
+
+    if (config.timeBudget) {
+
+        ImGui::Text("Pass Cost: %.2f ms", passCost);
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderFloat("##Target frame time", &config.targetFrameTime, 4.0f, 100.0f, "Target Frame Time %.0f ms");
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderInt("##Max passes", &config.maxPassesPerFrame, 1, 256, "Max Passes %i");
+    }
+
+    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+    ImGui::SliderFloat("##Deadline", &config.renderDeadline, 0.0f, 600.0f, config.renderDeadline > 0.0f ? "Deadline %.0f s" : "No Deadline");
+
+    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+    ImGui::SliderInt("##Sample target", &config.sampleTarget, 0, 65536, config.sampleTarget > 0 ? "Sample Target %i" : "No Sample Target", ImGuiSliderFlags_Logarithmic);
+
+    if (ImGui::Checkbox("Deterministic", &config.deterministic)) {
+        accumulationUpdate = true;
+    }
+
+    const char* samplers[] = { "Random", "Sobol (Owen)", "Blue Noise" };
+    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+    if (ImGui::Combo("##Sampler", &config.sampler, samplers, IM_ARRAYSIZE(samplers))) {
+        accumulationUpdate = true;
+    }
+
+    if (ImGui::Button("Convergence Benchmark")) {
+        runBenchmark = true;
+    }
+    if (ImGui::Button("Light Sampling Comparison")) {
+        runLightSamplingComparison = true;
+    }
+
+    if (ImGui::Button("Save Snapshot")) {
+        saveSnapshot = true;
+    }
+
+    if (ImGui::Checkbox("Adaptive Sampling", &config.adaptiveSampling)) {
+        accumulationUpdate = true;
+    }
+
+    if (config.adaptiveSampling) {
+
+        ImGui::Text("Active Tiles: %u / %u", activeTiles, numTiles);
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderFloat("##Adaptive threshold", &config.adaptiveThreshold, 0.001f, 0.2f, "Error Threshold %.3f", ImGuiSliderFlags_Logarithmic);
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        if (ImGui::SliderInt("##Adaptive min samples", &config.adaptiveMinSamples, 2, 256, "Min Samples %i")) {
+            accumulationUpdate = true;
+        }
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderInt("##Adaptive max boost", &config.adaptiveMaxBoost, 1, 32, "Max Boost %ix");
+
+        ImGui::Checkbox("Sample Heatmap", &config.adaptiveHeatmap);
+    }
+
+    ImGui::Checkbox("Dynamic Resolution", &config.dynamicResolution);
+
+    if (config.dynamicResolution) {
+
+        ImGui::Text("Internal: %u x %u", internalWidth, internalHeight);
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderInt("##Settle frames", &config.resolutionSettleFrames, 1, 60, "Settle Frames %i");
+    }
+
+    ImGui::Checkbox("Temporal Reprojection", &config.temporalReprojection);
+
+    if (config.temporalReprojection) {
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderInt("##Max history", &config.maxHistory, 1, 256, "Max History %i", ImGuiSliderFlags_Logarithmic);
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderFloat("##History depth tolerance", &config.historyDepthTolerance, 0.005f, 0.5f, "Depth Tolerance %.3f", ImGuiSliderFlags_Logarithmic);
+    }
+
+    if (ImGui::Checkbox("Denoise", &config.denoise)) {
+        accumulationUpdate = true; // starts writing its guides
+    }
+
+    if (ImGui::TreeNode("AOVs")) {
+
+        // turning one on needs a fresh accumulation, the running means would start part way through
+        bool changed = false;
+        changed |= ImGui::Checkbox("Albedo", &config.aovAlbedo);
+        changed |= ImGui::Checkbox("Normal", &config.aovNormal);
+        changed |= ImGui::Checkbox("Depth", &config.aovDepth);
+        changed |= ImGui::Checkbox("Instance / Material ID", &config.aovIDs);
+        changed |= ImGui::Checkbox("Motion Vectors", &config.aovMotion);
+
+        const char* views[] = { "Beauty", "Albedo", "Normal", "Depth", "Instance ID", "Material ID", "Motion" };
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        changed |= ImGui::Combo("##AOV view", &config.aovView, views, IM_ARRAYSIZE(views));
+
+        if (changed) {
+            accumulationUpdate = true;
+        }
+
+        ImGui::TreePop();
+    }
+
+    if (config.denoise) {
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderInt("##Denoise iterations", &config.denoiseIterations, 0, 8, "Iterations %i");
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderFloat("##Denoise budget", &config.denoiseBudgetMs, 0.0f, 8.0f, config.denoiseBudgetMs > 0.0f ? "Budget %.2f ms" : "No Budget");
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderFloat("##Sigma normal", &config.sigmaNormal, 1.0f, 256.0f, "Normal Sigma %.0f", ImGuiSliderFlags_Logarithmic);
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderFloat("##Sigma depth", &config.sigmaDepth, 0.1f, 10.0f, "Depth Sigma %.1f", ImGuiSliderFlags_Logarithmic);
+
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+        ImGui::SliderFloat("##Sigma luminance", &config.sigmaLuminance, 0.5f, 32.0f, "Luminance Sigma %.1f", ImGuiSliderFlags_Logarithmic);
+    }
+
 
     ImGui::End();
 
@@ -10,6 +10,9 @@ public:
 	static bool accumulationUpdate;
 	static bool isWindowHovered;
 	static bool renderUI;
+	static bool runBenchmark;
+	static bool runLightSamplingComparison;
+	static bool saveSnapshot;
 
 	static void renderSettings();
 
@@ -17,5 +20,14 @@ public:
 	
 	static uint64_t raysPerSecond;
 	static uint32_t numRays;
+	static uint32_t activeTiles;
+	static uint32_t numTiles;
+	static float passCost;
+	static uint32_t internalWidth;
+	static uint32_t internalHeight;
+	static uint64_t textureCacheHits;
+	static uint64_t textureCacheMisses;
+	static uint64_t textureCacheEvictions;
+	static uint32_t textureCachePages;
 };
 
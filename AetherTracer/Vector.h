@@ -1,6 +1,7 @@
 #pragma once
 
 #include <numbers>
+#include <algorithm>
 #include <iostream>
 
 namespace PT	{
@@ -118,6 +119,22 @@ namespace PT	{
 		return { x, y, z };
 	}
 
+	static float Dot(const Vector3& vec, const Vector3& other) {
+		return vec.x * other.x + vec.y * other.y + vec.z * other.z;
+	}
+
+	static float Length(const Vector3& vec) {
+		return sqrtf(Dot(vec, vec));
+	}
+
+	static Vector3 Min(const Vector3& vec, const Vector3& other) {
+		return { std::min(vec.x, other.x), std::min(vec.y, other.y), std::min(vec.z, other.z) };
+	}
+
+	static Vector3 Max(const Vector3& vec, const Vector3& other) {
+		return { std::max(vec.x, other.x), std::max(vec.y, other.y), std::max(vec.z, other.z) };
+	}
+
 	static float toRadians(float deg) {
 	
 		return (deg * static_cast<float>(std::numbers::pi)) / 180.0f;
@@ -1,4 +1,5 @@
 #include "Window.h"
+#include "Config.h"
 #include "Imgui.h"
 #include <imgui_impl_sdl3.h>
 #include <imgui_impl_dx12.h>
@@ -14,6 +15,7 @@ Window::Window(const std::string& title, uint32_t w, uint32_t h) {
     }
 
     Uint32 flags = SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY;
+    if (config.headless) flags = SDL_WINDOW_HIDDEN; // swap chain still needs a window, sized exactly to the render
     // If you know you'll use Vulkan later, add SDL_WINDOW_VULKAN here (or set via properties)
 
     m_window = SDL_CreateWindow(title.c_str(), w, h, flags);
@@ -1,68 +1,392 @@
 cbuffer Params : register(b0)
 {
-    uint stage;
     float exposure;
     uint numIterations;
+    bool adaptiveSampling;
+    float adaptiveThreshold;
+    uint adaptiveMinSamples;
+    bool heatmap;
+    uint aovView;
+    bool denoise;
+    uint denoiseIterations;
+    float sigmaNormal;
+    float sigmaDepth;
+    float sigmaLuminance;
+    uint internalWidth; // traced region in the top left of the accumulation, smaller than the output under dynamic resolution
+    uint internalHeight;
+    bool autoExposure;
+    float exposureLowPercentile; // share of the histogram below the range averaged for exposure
+    float exposureHighPercentile; // above it fireflies and bright emitters are ignored
+    float exposureAdaptation; // blend from the current exposure to the target this frame
+}
+
+cbuffer Stage : register(b1)
+{
+    uint stage;
+    uint stepWidth; // a-trous hole spacing
 }
 
 Texture2D<float4> accumulationTexture : register(t0);
 RWTexture2D<float4> Output : register(u0);
 
-RWBuffer<uint> maxLumBuffer : register(u1);
+RWBuffer<uint> histogramBuffer : register(u1); // HISTOGRAM_BINS counts of this frame, then the adapted exposure
+
+RWTexture2D<float2> varianceTexture : register(u2); // x = running mean luminance, y = M2
+RWBuffer<uint> tileMask : register(u3);
+RWBuffer<uint> adaptiveCounter : register(u4);
+
+RWTexture2D<float4> albedoTexture : register(u5); // first hit AOVs from the ray tracing stage
+RWTexture2D<float4> normalTexture : register(u6);
+RWTexture2D<float> depthTexture : register(u7); // 0 = miss
+RWTexture2D<float4> denoiseA : register(u8); // rgb demodulated colour, a luminance variance
+RWTexture2D<float4> denoiseB : register(u9);
+RWTexture2D<uint> idTexture : register(u10); // instance << 16 | material
+RWTexture2D<float2> motionTexture : register(u11);
+
+static const uint AOV_VIEW_BEAUTY = 0;
+static const uint AOV_VIEW_ALBEDO = 1;
+static const uint AOV_VIEW_NORMAL = 2;
+static const uint AOV_VIEW_DEPTH = 3;
+static const uint AOV_VIEW_INSTANCE_ID = 4;
+static const uint AOV_VIEW_MATERIAL_ID = 5;
+static const uint AOV_VIEW_MOTION = 6;
+static const uint AOV_NO_ID = 0xFFFFFFFF;
+
+// bin 0 holds black pixels, bins 1 - 255 split log2 luminance from HISTOGRAM_MIN_LOG over HISTOGRAM_LOG_RANGE
+static const uint HISTOGRAM_BINS = 256;
+static const uint EXPOSURE_SLOT = HISTOGRAM_BINS; // adapted exposure in EV, float bits
+static const float HISTOGRAM_MIN_LOG = -10.0f;
+static const float HISTOGRAM_LOG_RANGE = 22.0f;
+static const float EXPOSURE_KEY = 0.18f; // middle grey the averaged luminance is mapped to
 
-groupshared float g_maxLum[256];
+groupshared uint g_histogram[HISTOGRAM_BINS];
+groupshared uint g_tileActive;
 
-void maxLuminance(uint3 dispatchID : SV_DispatchThreadID, uint3 groupThreadID : SV_GroupThreadID, uint groupIndex : SV_GroupIndex)
+uint2 internalSize()
 {
-    uint2 dim;
+    return uint2(internalWidth, internalHeight);
+}
+
+bool pixelConverged(uint2 pixel)
+{
+    float n = accumulationTexture.Load(int3(pixel, 0)).a;
     
-    accumulationTexture.GetDimensions(dim.x, dim.y);
-    if (dispatchID.x >= dim.x || dispatchID.y >= dim.y)
+    if (n < max((float) adaptiveMinSamples, 2.0f))
+        return false;
+    
+    float2 meanM2 = varianceTexture[pixel];
+    
+    // standard error of the mean, relative to the pixel brightness. dark pixels get an absolute floor
+    float variance = meanM2.y / (n - 1.0f);
+    float standardError = sqrt(variance / n);
+    
+    return standardError <= adaptiveThreshold * max(meanM2.x, 0.05f);
+}
+
+// one group per 16x16 tile, a tile stays active until every pixel in it has converged
+void adaptiveTiles(uint3 dispatchID : SV_DispatchThreadID, uint3 groupID : SV_GroupID, uint groupIndex : SV_GroupIndex)
+{
+    uint2 dim = internalSize();
+    
+    if (groupIndex == 0)
     {
-        g_maxLum[groupIndex] = 0.0f;
+        g_tileActive = 0;
     }
+    GroupMemoryBarrierWithGroupSync();
     
+    if (dispatchID.x < dim.x && dispatchID.y < dim.y && !pixelConverged(dispatchID.xy))
+    {
+        InterlockedOr(g_tileActive, 1);
+    }
+    GroupMemoryBarrierWithGroupSync();
     
-    float3 accum = accumulationTexture.Load(int3(dispatchID.xy, 0)).rgb;
-    float luminance = 0.2126f * accum.r + 0.7152f * accum.g + 0.0722f * accum.b;
+    if (groupIndex == 0)
+    {
+        uint tilesX = (dim.x + 15) / 16;
+        tileMask[groupID.x + groupID.y * tilesX] = g_tileActive;
+        
+        if (g_tileActive)
+        {
+            InterlockedAdd(adaptiveCounter[0], 1);
+        }
+    }
+}
+
+float getLuminance(float3 c)
+{
+    return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+}
+
+float3 safeAlbedo(uint2 pixel)
+{
+    return max(albedoTexture[pixel].rgb, 0.01f);
+}
+
+// divides the albedo out so the filter only blurs lighting, texture and material detail is multiplied back after
+void denoisePrepare(uint3 dispatchID : SV_DispatchThreadID)
+{
+    uint2 dim = internalSize();
+    if (dispatchID.x >= dim.x || dispatchID.y >= dim.y)
+        return;
     
-    g_maxLum[groupIndex] = luminance;
-    GroupMemoryBarrierWithGroupSync();
+    float4 sample = accumulationTexture.Load(int3(dispatchID.xy, 0));
+    float n = max(sample.a, 1.0f);
+    float3 albedo = safeAlbedo(dispatchID.xy);
     
-    // parallel reduction in groupshared memory
-    for (uint i = 128; i > 0; i >>= 1)
+    // variance of the mean from the adaptive sampling moments, scaled into demodulated space
+    float variance = n > 1.0f ? varianceTexture[dispatchID.xy].y / ((n - 1.0f) * n) : 1.0f;
+    float albedoLum = max(getLuminance(albedo), 0.01f);
+    
+    denoiseA[dispatchID.xy] = float4(sample.rgb / n / albedo, variance / (albedoLum * albedoLum));
+}
+
+// one edge avoiding a-trous pass, Dammertz et al. with the SVGF luminance weight
+void denoiseATrous(uint3 dispatchID : SV_DispatchThreadID)
+{
+    uint2 dim = internalSize();
+    if (dispatchID.x >= dim.x || dispatchID.y >= dim.y)
+        return;
+    
+    const float kernel[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+    
+    bool readA = (firstbitlow(stepWidth) & 1) == 0;
+    
+    int2 p = int2(dispatchID.xy);
+    float4 centre = readA ? denoiseA[p] : denoiseB[p];
+    float3 centreNormal = normalTexture[p].xyz;
+    float centreDepth = depthTexture[p];
+    float centreLum = getLuminance(centre.rgb);
+    
+    // sky has nothing to filter against
+    if (centreDepth <= 0.0f)
+    {
+        if (readA)
+            denoiseB[p] = centre;
+        else
+            denoiseA[p] = centre;
+        return;
+    }
+    
+    float lumScale = sigmaLuminance * sqrt(max(centre.a, 0.0f)) + 1e-4f;
+    
+    float3 colour = 0.0f;
+    float variance = 0.0f;
+    float weightSum = 0.0f;
+    
+    for (int y = -2; y <= 2; y++)
     {
-        if (groupIndex < i)
+        for (int x = -2; x <= 2; x++)
         {
-            g_maxLum[groupIndex] = max(g_maxLum[groupIndex], g_maxLum[groupIndex + i]);
+            int2 q = p + int2(x, y) * int(stepWidth);
+            if (q.x < 0 || q.y < 0 || q.x >= int(dim.x) || q.y >= int(dim.y))
+                continue;
+            
+            float depth = depthTexture[q];
+            if (depth <= 0.0f)
+                continue;
+            
+            float4 s = readA ? denoiseA[q] : denoiseB[q];
+            
+            float wNormal = pow(saturate(dot(centreNormal, normalTexture[q].xyz)), sigmaNormal);
+            float wDepth = exp(-abs(depth - centreDepth) / (sigmaDepth * centreDepth * 0.01f * length(float2(x, y)) * stepWidth + 1e-4f));
+            float wLum = exp(-abs(getLuminance(s.rgb) - centreLum) / lumScale);
+            
+            float w = kernel[abs(x)] * kernel[abs(y)] * wNormal * wDepth * wLum;
+            
+            colour += s.rgb * w;
+            variance += s.a * w * w;
+            weightSum += w;
         }
-        GroupMemoryBarrierWithGroupSync();
     }
     
-    // one thread per group does global atomic max
-    if (groupIndex == 0)
+    // the centre always contributes, weightSum is never zero
+    float4 result = float4(colour / weightSum, variance / (weightSum * weightSum));
+    
+    if (readA)
+        denoiseB[p] = result;
+    else
+        denoiseA[p] = result;
+}
+
+float3 idColour(uint id)
+{
+    // hash to a stable colour per id
+    id = id * 747796405u + 2891336453u;
+    id = ((id >> ((id >> 28u) + 4u)) ^ id) * 277803737u;
+    id = (id >> 22u) ^ id;
+    return float3(id & 0xFF, (id >> 8) & 0xFF, (id >> 16) & 0xFF) / 255.0f;
+}
+
+float3 aovDebug(uint2 pixel)
+{
+    uint id = idTexture[pixel];
+    
+    switch (aovView)
+    {
+        case AOV_VIEW_ALBEDO:
+            return albedoTexture[pixel].rgb;
+        case AOV_VIEW_NORMAL:
+            return normalTexture[pixel].xyz * 0.5f + 0.5f;
+        case AOV_VIEW_DEPTH:
+            return depthTexture[pixel] > 0.0f ? 1.0f / (1.0f + 0.1f * depthTexture[pixel]) : 0.0f;
+        case AOV_VIEW_INSTANCE_ID:
+            return id == AOV_NO_ID ? 0.0f : idColour(id >> 16);
+        case AOV_VIEW_MATERIAL_ID:
+            return id == AOV_NO_ID ? 0.0f : idColour(id & 0xFFFF);
+        case AOV_VIEW_MOTION:
+            return float3(abs(motionTexture[pixel]) * 50.0f, 0.0f);
+    }
+    return 0.0f;
+}
+
+// linear colour of a traced pixel, denoised if the denoiser ran
+float3 linearColour(uint2 pixel)
+{
+    // alpha counts the samples of each pixel, adaptive sampling gives pixels different counts
+    float4 sample = accumulationTexture.Load(int3(pixel, 0));
+    float3 colour = sample.rgb / max(sample.a, 1.0f);
+    
+    if (denoise && depthTexture[pixel] > 0.0f)
+    {
+        float3 filtered = (denoiseIterations & 1) ? denoiseB[pixel].rgb : denoiseA[pixel].rgb;
+        colour = filtered * safeAlbedo(pixel);
+    }
+    return colour;
+}
+
+// bilinear from the traced region, taps on a different surface than the nearest one are dropped so edges stay sharp
+float3 upscale(uint2 pixel, uint2 outputSize)
+{
+    uint2 inputSize = internalSize();
+    float2 src = (pixel + 0.5f) * float2(inputSize) / float2(outputSize) - 0.5f;
+    int2 base = int2(floor(src));
+    float2 f = src - base;
+    
+    int2 nearest = clamp(int2(round(src)), int2(0, 0), int2(inputSize) - 1);
+    float refDepth = depthTexture[nearest];
+    
+    float3 colour = 0.0f;
+    float weightSum = 0.0f;
+    
+    for (int i = 0; i < 4; i++)
+    {
+        int2 offset = int2(i & 1, i >> 1);
+        int2 tap = clamp(base + offset, int2(0, 0), int2(inputSize) - 1);
+        
+        float depth = depthTexture[tap];
+        float wDepth = refDepth > 0.0f ? exp(-abs(depth - refDepth) / (0.02f * refDepth)) : (depth > 0.0f ? 0.0f : 1.0f);
+        float w = (offset.x ? f.x : 1.0f - f.x) * (offset.y ? f.y : 1.0f - f.y) * wDepth;
+        
+        colour += linearColour(tap) * w;
+        weightSum += w;
+    }
+    
+    // the nearest tap always passes its own depth test
+    return weightSum > 1e-4f ? colour / weightSum : linearColour(nearest);
+}
+
+uint luminanceBin(float luminance)
+{
+    if (luminance < 1e-5f)
+        return 0;
+    float t = saturate((log2(luminance) - HISTOGRAM_MIN_LOG) / HISTOGRAM_LOG_RANGE);
+    return uint(t * (HISTOGRAM_BINS - 2) + 1.0f);
+}
+
+float binLuminanceLog(uint bin)
+{
+    return HISTOGRAM_MIN_LOG + (bin - 0.5f) / (HISTOGRAM_BINS - 2) * HISTOGRAM_LOG_RANGE;
+}
+
+// one histogram per group in groupshared memory, merged into the global one with a single atomic per bin
+void luminanceHistogram(uint3 dispatchID, uint groupIndex)
+{
+    g_histogram[groupIndex] = 0;
+    GroupMemoryBarrierWithGroupSync();
+    
+    uint2 dim = internalSize();
+    if (dispatchID.x < dim.x && dispatchID.y < dim.y)
     {
-        //uint lumBits = asuint(g_maxLum[0]);
-        uint lumBits = asuint(20.0f);
-        InterlockedMax(maxLumBuffer[0], lumBits);
+        InterlockedAdd(g_histogram[luminanceBin(getLuminance(linearColour(dispatchID.xy)))], 1);
+    }
+    GroupMemoryBarrierWithGroupSync();
+    
+    if (g_histogram[groupIndex] > 0)
+    {
+        InterlockedAdd(histogramBuffer[groupIndex], g_histogram[groupIndex]);
+    }
+}
 
+// single group, averages the log luminance between the two percentiles and moves the exposure towards it.
+// the histogram is cleared for the next frame on the way
+void adaptExposure(uint groupIndex)
+{
+    g_histogram[groupIndex] = histogramBuffer[groupIndex];
+    histogramBuffer[groupIndex] = 0;
+    GroupMemoryBarrierWithGroupSync();
+    
+    if (groupIndex != 0)
+        return;
+    
+    // black pixels are left out, a scene against an empty sky would otherwise never settle
+    float total = 0.0f;
+    for (uint i = 1; i < HISTOGRAM_BINS; i++)
+        total += g_histogram[i];
+    
+    float low = total * exposureLowPercentile;
+    float high = total * exposureHighPercentile;
+    float cumulative = 0.0f;
+    float logSum = 0.0f;
+    float weight = 0.0f;
+    
+    for (uint bin = 1; bin < HISTOGRAM_BINS; bin++)
+    {
+        float count = g_histogram[bin];
+        float inside = clamp(cumulative + count, low, high) - clamp(cumulative, low, high);
+        logSum += inside * binLuminanceLog(bin);
+        weight += inside;
+        cumulative += count;
     }
     
+    if (weight <= 0.0f)
+        return;
+    
+    float target = log2(EXPOSURE_KEY) - logSum / weight;
+    float current = asfloat(histogramBuffer[EXPOSURE_SLOT]);
+    histogramBuffer[EXPOSURE_SLOT] = asuint(lerp(current, target, exposureAdaptation));
 }
 
 void toneMap(uint3 dispatchID : SV_DispatchThreadID, uint3 groupThreadID : SV_GroupThreadID, uint groupIndex : SV_GroupIndex)
 {
-    //float maxLuminance = asfloat(maxLumBuffer[0]);
     float maxLuminance = 15.0f;
     
     uint2 dim;
-    accumulationTexture.GetDimensions(dim.x, dim.y);
+    Output.GetDimensions(dim.x, dim.y);
     if (dispatchID.x >= dim.x || dispatchID.y >= dim.y)
         return;
     
-    float3 accum = accumulationTexture.Load(int3(dispatchID.xy, 0)).rgb;
+    bool scaled = any(internalSize() != dim);
+    uint2 source = scaled ? min(uint2((dispatchID.xy + 0.5f) * float2(internalSize()) / float2(dim)), internalSize() - 1) : dispatchID.xy;
     
-    accum /= (float) numIterations;
+    float4 sample = accumulationTexture.Load(int3(source, 0));
+    
+    if (aovView != AOV_VIEW_BEAUTY)
+    {
+        Output[dispatchID.xy] = float4(aovDebug(source), 1.0f);
+        return;
+    }
+    
+    if (heatmap)
+    {
+        // share of the frame's samples this pixel received, blue = few, red = many
+        float t = saturate(sample.a / max((float) numIterations, 1.0f));
+        float3 heat = saturate(float3(2.0f * t - 0.5f, 1.0f - abs(2.0f * t - 1.0f), 1.5f - 2.0f * t));
+        Output[dispatchID.xy] = float4(heat, 1.0f);
+        return;
+    }
+    
+    float3 accum = scaled ? upscale(dispatchID.xy, dim) : linearColour(dispatchID.xy);
+    accum *= autoExposure ? exposure * exp2(asfloat(histogramBuffer[EXPOSURE_SLOT])) : exposure;
     
     float luminance = 0.2126f * accum.r + 0.7152f * accum.g + 0.0722f * accum.b;
     
@@ -83,15 +407,31 @@ void toneMap(uint3 dispatchID : SV_DispatchThreadID, uint3 groupThreadID : SV_Gr
 }
 
 [numthreads(16, 16, 1)]
-void main(uint3 dispatchID : SV_DispatchThreadID, uint3 groupThreadID : SV_GroupThreadID, uint groupIndex : SV_GroupIndex)
+void main(uint3 dispatchID : SV_DispatchThreadID, uint3 groupThreadID : SV_GroupThreadID, uint3 groupID : SV_GroupID, uint groupIndex : SV_GroupIndex)
 {
     if (stage == 0)
     {
-        maxLuminance(dispatchID, groupThreadID, groupIndex);
+        luminanceHistogram(dispatchID, groupIndex);
     }
     else if (stage == 1)
     {
         toneMap(dispatchID, groupThreadID, groupIndex);
     }
+    else if (stage == 2)
+    {
+        adaptiveTiles(dispatchID, groupID, groupIndex);
+    }
+    else if (stage == 3)
+    {
+        denoisePrepare(dispatchID);
+    }
+    else if (stage == 4)
+    {
+        denoiseATrous(dispatchID);
+    }
+    else if (stage == 5)
+    {
+        adaptExposure(groupIndex);
+    }
 
 }
\ No newline at end of file
@@ -1,14 +1,16 @@
-﻿struct [raypayload] Payload // 76 bytes
+﻿struct [raypayload] Payload // 88 bytes, matches DX12Payload in ResourceManager.h
 {
     float3 throughput : read(caller, closesthit, miss) : write(caller, closesthit, miss);
     float3 emission : read(caller, closesthit, miss) : write(caller, closesthit, miss);
+    float3 radiance : read(caller, closesthit) : write(caller, closesthit); // light sampled at the hits so far
+    bool diffuseBounce : read(caller, closesthit) : write(caller, closesthit); // ray was spawned by the diffuse lobe
     float3 pos : read(caller, closesthit, miss) : write(caller, closesthit, miss);
     float3 dir : read(caller, closesthit, miss) : write(caller, closesthit, miss);
     uint bounceNum : read(caller, closesthit, miss) : write(caller, closesthit, miss);
     bool missed : read(caller, closesthit, miss) : write(caller, closesthit, miss);
     bool internal : read(caller, closesthit, miss) : write(caller, closesthit, miss);
     uint2 pixelIndex : read(caller, closesthit, miss) : write(caller);
-    uint2 dims : read(caller, closesthit, miss) : write(caller);
+    uint sampleIndex : read(caller, closesthit, miss) : write(caller); // keys the random numbers together with pixel and bounce
 };
 
 struct Vertex
@@ -28,9 +30,42 @@ struct Material
     float emission;
 };
 
+struct LightNode
+{
+    float3 boundsMin;
+    float power;
+    float3 boundsMax;
+    float cosTheta_o;
+    float3 axis;
+    float cosTheta_e;
+    uint secondChild; // leaf: triangle index
+    uint isLeaf;
+};
+
+struct LightTriangle
+{
+    float3 p0;
+    float3 p1;
+    float3 p2;
+    float3 emission;
+};
+
 // UAV, SRVs and CBVs
 RWTexture2D<float4> accumulationTexture : register(u0, space0);
-RWBuffer<uint64_t> randPattern : register(u1, space0);
+RWTexture2D<float2> varianceTexture : register(u2, space0); // x = running mean luminance, y = M2
+RWBuffer<uint> tileMask : register(u3, space0);
+// first hit AOVs, only the ones in aovMask are written
+RWTexture2D<float4> albedoTexture : register(u4, space0); // mean over the samples
+RWTexture2D<float4> normalTexture : register(u5, space0);
+RWTexture2D<float> depthTexture : register(u6, space0); // 0 = miss
+RWTexture2D<uint> idTexture : register(u7, space0); // instance << 16 | material, AOV_NO_ID = miss
+RWTexture2D<float2> motionTexture : register(u8, space0); // uv offset to last frame
+
+// last frame's accumulation and first hit, copied before a camera move clears them
+Texture2D<float4> HistoryAccumulation : register(t7, space5);
+Texture2D<float2> HistoryVariance : register(t8, space5);
+Texture2D<float> HistoryDepth : register(t9, space5);
+Texture2D<float4> HistoryNormal : register(t10, space5);
 
 RaytracingAccelerationStructure scene : register(t0, space0);
 
@@ -40,17 +75,38 @@ Buffer<uint> IndexBuffers[] : register(t2, space2);
 StructuredBuffer<Material> Materials : register(t3, space3);
 Buffer<uint> materialIndexBuffer : register(t3, space4);
 
+StructuredBuffer<LightNode> LightNodes : register(t4, space5);
+StructuredBuffer<LightTriangle> LightTriangles : register(t5, space5);
+
+Buffer<float> BlueNoise : register(t6, space5); // 64x64 tileable mask, values in [0, 1)
+
 cbuffer Camerab : register(b0)
 {
     float3 camPos;
     float pad0;
     row_major float4x4 InvVieProj;
-    uint numFrames;
+    uint seed;
     bool sky;
     float skyBrightness;
     uint minBounces;
     uint maxBounces;
     bool jitter;
+    uint numLights;
+    bool lightSampling;
+    bool adaptiveSampling;
+    uint adaptiveMinSamples;
+    uint samplerType;
+    uint sequenceSeed; // changes when accumulation restarts, scrambles the low discrepancy sequences
+    uint aovMask;
+    bool reprojectHistory; // camera moved this frame, warp the history into the new view
+    uint maxHistory; // samples a reprojected pixel keeps at most
+    float depthTolerance; // relative
+    row_major float4x4 prevViewProj;
+    uint sampleOffset; // first sample of the range a render worker was given, shifts every sequence
+    uint tileOriginX; // pixel of the full image at dispatch (0, 0), non zero when rendering tiles
+    uint tileOriginY;
+    uint imageWidth; // full image the camera covers, the dispatch size unless tiled
+    uint imageHeight;
 }
 
 
@@ -59,16 +115,257 @@ static const float3 skyTop = float3(0.24, 0.44, 0.9);
 static const float3 skyBottom = float3(0.75, 0.86, 1.0);
 static const float PI = 3.141592653589793; // why not
 
-float randomPCG(inout uint64_t state)
+static const uint RR_DIMENSION = 0xFFFF; // russian roulette, kept apart from the dimensions used while shading
+
+static const uint AOV_ALBEDO = 1 << 0;
+static const uint AOV_NORMAL = 1 << 1;
+static const uint AOV_DEPTH = 1 << 2;
+static const uint AOV_IDS = 1 << 3;
+static const uint AOV_MOTION = 1 << 4;
+static const uint AOV_NO_ID = 0xFFFFFFFF;
+
+static const float HISTORY_NORMAL_THRESHOLD = 0.9f; // cos of the largest normal change still accepted
+
+// Stateless counter-based RNG, every number is a hash of (pixel, sample index, bounce, dimension)
+// so nothing is stored per pixel between dispatches
+
+struct RNG
+{
+    uint4 key;
+    uint dimension;
+    uint2 pixel;
+    uint sampleIndex;
+    uint bounce;
+};
+
+// Jarzynski and Olano, Hash Functions for GPU Rendering
+uint4 pcg4d(uint4 v)
+{
+    v = v * 1664525u + 1013904223u;
+    
+    v.x += v.y * v.w;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v.w += v.y * v.z;
+    
+    v ^= v >> 16u;
+    
+    v.x += v.y * v.w;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v.w += v.y * v.z;
+    
+    return v;
+}
+
+RNG initRNG(uint2 pixel, uint sampleIndex, uint bounce)
+{
+    RNG rng;
+    pixel += uint2(tileOriginX, tileOriginY); // keyed by the image pixel so tiles match a single dispatch
+    sampleIndex += sampleOffset;
+    rng.key = pcg4d(uint4(pixel, sampleIndex, seed));
+    rng.key.w ^= bounce << 16;
+    rng.dimension = 0;
+    rng.pixel = pixel;
+    rng.sampleIndex = sampleIndex;
+    rng.bounce = bounce;
+    return rng;
+}
+
+float random(inout RNG rng)
+{
+    uint4 h = pcg4d(uint4(rng.key.xyz, rng.key.w ^ rng.dimension));
+    rng.dimension++;
+    return float(h.x >> 8) * (1.0f / 16777216.0f); // 24 bits, never rounds up to 1
+}
+
+// Samplers
+// every draw in Shade() reads its own slot, each slot gets a differently scrambled sequence per pixel and bounce
+
+static const uint SAMPLER_RANDOM = 0;
+static const uint SAMPLER_SOBOL = 1;
+static const uint SAMPLER_BLUE_NOISE = 2;
+
+static const uint SAMPLE_CAMERA = 0;
+static const uint SAMPLE_LOBE = 1;
+static const uint SAMPLE_VNDF = 2;
+static const uint SAMPLE_HEMISPHERE = 3;
+static const uint SAMPLE_LIGHT = 4;
+
+static const uint BLUE_NOISE_SIZE = 64;
+
+static const uint sobolDirections[4][32] = {
+    { 0x80000000, 0x40000000, 0x20000000, 0x10000000, 0x08000000, 0x04000000, 0x02000000, 0x01000000, 0x00800000, 0x00400000, 0x00200000, 0x00100000, 0x00080000, 0x00040000, 0x00020000, 0x00010000, 0x00008000, 0x00004000, 0x00002000, 0x00001000, 0x00000800, 0x00000400, 0x00000200, 0x00000100, 0x00000080, 0x00000040, 0x00000020, 0x00000010, 0x00000008, 0x00000004, 0x00000002, 0x00000001 },
+    { 0x80000000, 0xc0000000, 0xa0000000, 0xf0000000, 0x88000000, 0xcc000000, 0xaa000000, 0xff000000, 0x80800000, 0xc0c00000, 0xa0a00000, 0xf0f00000, 0x88880000, 0xcccc0000, 0xaaaa0000, 0xffff0000, 0x80008000, 0xc000c000, 0xa000a000, 0xf000f000, 0x88008800, 0xcc00cc00, 0xaa00aa00, 0xff00ff00, 0x80808080, 0xc0c0c0c0, 0xa0a0a0a0, 0xf0f0f0f0, 0x88888888, 0xcccccccc, 0xaaaaaaaa, 0xffffffff },
+    { 0x80000000, 0xc0000000, 0x60000000, 0x90000000, 0xe8000000, 0x5c000000, 0x8e000000, 0xc5000000, 0x68800000, 0x9cc00000, 0xee600000, 0x55900000, 0x80680000, 0xc09c0000, 0x60ee0000, 0x90550000, 0xe8808000, 0x5cc0c000, 0x8e606000, 0xc5909000, 0x6868e800, 0x9c9c5c00, 0xeeee8e00, 0x5555c500, 0x8000e880, 0xc0005cc0, 0x60008e60, 0x9000c590, 0xe8006868, 0x5c009c9c, 0x8e00eeee, 0xc5005555 },
+    { 0x80000000, 0xc0000000, 0x20000000, 0x50000000, 0xf8000000, 0x74000000, 0xa2000000, 0x93000000, 0xd8800000, 0x25400000, 0x59e00000, 0xe6d00000, 0x78080000, 0xb40c0000, 0x82020000, 0xc3050000, 0x208f8000, 0x51474000, 0xfbea2000, 0x75d93000, 0xa0858800, 0x914e5400, 0xdbe79e00, 0x25db6d00, 0x58800080, 0xe54000c0, 0x79e00020, 0xb6d00050, 0x800800f8, 0xc00c0074, 0x200200a2, 0x50050093 }
+};
+
+float toUnitFloat(uint x)
+{
+    return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Burley, Practical Hash-based Owen Scrambling
+uint laineKarrasPermutation(uint x, uint seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+uint nestedUniformScramble(uint x, uint seed)
+{
+    x = reversebits(x);
+    x = laineKarrasPermutation(x, seed);
+    return reversebits(x);
+}
+
+uint sobol(uint index, uint dim)
+{
+    uint x = 0;
+    for (uint bit = 0; index != 0; bit++, index >>= 1)
+    {
+        if (index & 1)
+        {
+            x ^= sobolDirections[dim][bit];
+        }
+    }
+    return x;
+}
+
+float4 sobolOwen4D(uint index, uint seed)
+{
+    // shuffling the index keeps the padded dimensions decorrelated
+    index = nestedUniformScramble(index, seed);
+    
+    uint4 x;
+    x.x = nestedUniformScramble(sobol(index, 0), pcg4d(uint4(seed, 0, 0, 0)).x);
+    x.y = nestedUniformScramble(sobol(index, 1), pcg4d(uint4(seed, 1, 0, 0)).x);
+    x.z = nestedUniformScramble(sobol(index, 2), pcg4d(uint4(seed, 2, 0, 0)).x);
+    x.w = nestedUniformScramble(sobol(index, 3), pcg4d(uint4(seed, 3, 0, 0)).x);
+    
+    return float4(toUnitFloat(x.x), toUnitFloat(x.y), toUnitFloat(x.z), toUnitFloat(x.w));
+}
+
+float4 blueNoise4D(uint2 pixel, uint sampleIndex, uint dimension)
 {
-    uint64_t oldstate = state;
-    state = oldstate * 6364136223846793005ULL + 2891336453ULL;
+    // each dimension reads the mask at its own toroidal offset, successive samples rotate by the golden ratio
+    float4 result;
+    [unroll]
+    for (uint i = 0; i < 4; i++)
+    {
+        uint2 offset = pcg4d(uint4(dimension, i, sequenceSeed, 0)).xy;
+        uint2 p = (pixel + offset) % BLUE_NOISE_SIZE;
+        float value = BlueNoise[p.x + p.y * BLUE_NOISE_SIZE];
+        result[i] = frac(value + float(sampleIndex) * 0.618033988749895f);
+    }
+    return min(result, 0.99999994f);
+}
 
-    uint32_t xorshifted = uint32_t(((oldstate >> 18u) ^ oldstate) >> 27u);
-    uint32_t rot = uint32_t(oldstate >> 59u);
+float4 sample4D(inout RNG rng, uint slot)
+{
+    uint dimension = (rng.bounce << 8) | slot;
     
-    uint32_t result = (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31u));
-    return float(result) * (1.0f / 4294967296.0f);
+    if (samplerType == SAMPLER_SOBOL)
+    {
+        uint scrambleSeed = pcg4d(uint4(rng.pixel, dimension, sequenceSeed)).x;
+        return sobolOwen4D(rng.sampleIndex, scrambleSeed);
+    }
+    
+    if (samplerType == SAMPLER_BLUE_NOISE)
+    {
+        return blueNoise4D(rng.pixel, rng.sampleIndex, dimension);
+    }
+    
+    return float4(random(rng), random(rng), random(rng), random(rng));
+}
+
+float2 sample2D(inout RNG rng, uint slot)
+{
+    return sample4D(rng, slot).xy;
+}
+
+float3 cameraForward()
+{
+    float4 centre = mul(float4(0.0f, 0.0f, 0.0f, 1.0f), InvVieProj);
+    return normalize(centre.xyz / centre.w - camPos);
+}
+
+// backward reprojection, the first hit of this sample is projected with last frame's camera and the history there is
+// bilinearly filtered over the taps that pass the depth and normal test. returns the history as sum and count
+float4 reproject(uint2 pixel, float3 dir, out float2 meanM2)
+{
+    meanM2 = float2(0.0f, 0.0f);
+    
+    uint2 dims = DispatchRaysDimensions().xy;
+    float depth = depthTexture[pixel];
+    float3 normal = normalTexture[pixel].xyz;
+    
+    // sky is at infinity, only the direction moves
+    float4 prevClip = depth > 0.0f ? mul(float4(camPos + dir * depth / dot(dir, cameraForward()), 1.0f), prevViewProj) : mul(float4(dir, 0.0f), prevViewProj);
+    if (prevClip.w <= 0.0f)
+        return float4(0.0f, 0.0f, 0.0f, 0.0f);
+    
+    float2 prevUV = float2(prevClip.x, -prevClip.y) / prevClip.w * 0.5f + 0.5f;
+    float2 prevPixel = prevUV * dims - 0.5f;
+    int2 base = int2(floor(prevPixel));
+    float2 f = prevPixel - base;
+    
+    float3 mean = 0.0f;
+    float count = 0.0f;
+    float2 moments = 0.0f;
+    float weightSum = 0.0f;
+    
+    for (int i = 0; i < 4; i++)
+    {
+        int2 offset = int2(i & 1, i >> 1);
+        int2 tap = base + offset;
+        if (tap.x < 0 || tap.y < 0 || tap.x >= int(dims.x) || tap.y >= int(dims.y))
+            continue;
+        
+        float historyDepth = HistoryDepth[tap];
+        if (depth > 0.0f)
+        {
+            // disocclusion, the surface seen last frame is not this one
+            if (historyDepth <= 0.0f || abs(historyDepth - prevClip.w) > depthTolerance * prevClip.w)
+                continue;
+            if (dot(HistoryNormal[tap].xyz, normal) < HISTORY_NORMAL_THRESHOLD)
+                continue;
+        }
+        else if (historyDepth > 0.0f)
+        {
+            continue;
+        }
+        
+        float4 history = HistoryAccumulation[tap];
+        if (history.a <= 0.0f)
+            continue;
+        
+        float w = (offset.x ? f.x : 1.0f - f.x) * (offset.y ? f.y : 1.0f - f.y);
+        float2 historyMeanM2 = HistoryVariance[tap];
+        
+        mean += history.rgb / history.a * w;
+        count += history.a * w;
+        moments += float2(historyMeanM2.x, historyMeanM2.y / max(history.a - 1.0f, 1.0f)) * w;
+        weightSum += w;
+    }
+    
+    if (weightSum <= 1e-4f)
+        return float4(0.0f, 0.0f, 0.0f, 0.0f);
+    
+    mean /= weightSum;
+    moments /= weightSum;
+    count = min(floor(count / weightSum), (float) maxHistory);
+    if (count < 1.0f)
+        return float4(0.0f, 0.0f, 0.0f, 0.0f);
+    
+    // M2 rebuilt from the per sample variance for the capped count
+    meanM2 = float2(moments.x, moments.y * max(count - 1.0f, 0.0f));
+    return float4(mean * count, count);
 }
 
 [shader("raygeneration")]
@@ -77,12 +374,22 @@ void RayGeneration()
     uint2 pixelIndex = DispatchRaysIndex().xy;
     uint2 dims = DispatchRaysDimensions().xy;
     
-    uint64_t state = randPattern[pixelIndex.x + pixelIndex.y * dims.x];
-    randomPCG(state); // initialize
+    float4 accum = accumulationTexture[pixelIndex];
+    
+    // converged tiles are skipped, every pixel still gets the minimum sample count
+    if (adaptiveSampling && accum.a >= adaptiveMinSamples)
+    {
+        uint tilesX = (dims.x + 15) / 16;
+        if (tileMask[pixelIndex.x / 16 + (pixelIndex.y / 16) * tilesX] == 0)
+            return;
+    }
     
-    float2 jitterAmount = jitter == true ? float2(randomPCG(state), randomPCG(state)) - 0.5f : float2(0.0f, 0.0f);
+    uint sampleIndex = uint(accum.a);
+    RNG rng = initRNG(pixelIndex, sampleIndex, 0);
     
-    float2 uv = (pixelIndex + 0.5f + jitterAmount) / float2(dims);
+    float2 jitterAmount = jitter == true ? sample2D(rng, SAMPLE_CAMERA) - 0.5f : float2(0.0f, 0.0f);
+    
+    float2 uv = (pixelIndex + uint2(tileOriginX, tileOriginY) + 0.5f + jitterAmount) / float2(imageWidth, imageHeight);
     
     // NDC [-1 , 1]
     
@@ -91,6 +398,7 @@ void RayGeneration()
     
     float4 target = mul(float4(ndc.x, ndc.y, 0.0f, 1.0f), InvVieProj);
     float3 worldPos = target.xyz / target.w;
+    float3 primaryDir = normalize(worldPos - camPos);
    
     RayDesc ray;
     ray.Origin = camPos;
@@ -101,9 +409,11 @@ void RayGeneration()
     Payload payload;
     payload.throughput = float3(1.0f, 1.0f, 1.0f);
     payload.emission = float3(0.0f, 0.0f, 0.0f);
+    payload.radiance = float3(0.0f, 0.0f, 0.0f);
+    payload.diffuseBounce = false;
     payload.missed = false;
     payload.pixelIndex = pixelIndex;
-    payload.dims = dims;
+    payload.sampleIndex = sampleIndex;
     payload.bounceNum = 0;
     payload.internal = false;
     float3 finalColor = float3(0.0f, 0.0f, 0.0f);
@@ -119,7 +429,13 @@ void RayGeneration()
         // terminate ray if at end of path
         if (payload.missed || payload.emission.x > 0.0f || payload.emission.y > 0.0f || payload.emission.z > 0.0f)
         {
-            finalColor += payload.throughput * payload.emission;
+            // emitters reached through a diffuse bounce were already counted by light sampling, Shade clears
+            // diffuseBounce for hits on the side light sampling can't reach
+            bool sampledLight = lightSampling && numLights > 0 && payload.diffuseBounce && !payload.missed;
+            if (!sampledLight)
+            {
+                finalColor += payload.throughput * payload.emission;
+            }
             break;
         }
         
@@ -127,9 +443,9 @@ void RayGeneration()
         if (i > minBounces)
         {
             float maxComponent = max(payload.throughput.x, max(payload.throughput.y, payload.throughput.z));
-            uint64_t state = randPattern[pixelIndex.x + pixelIndex.y * dims.x];
-            float rand = randomPCG(state);
-            randPattern[payload.pixelIndex.x + payload.pixelIndex.y * payload.dims.x] = state; // write back updated state
+            RNG rrRng = initRNG(pixelIndex, sampleIndex, payload.bounceNum);
+            rrRng.dimension = RR_DIMENSION;
+            float rand = random(rrRng);
             if (rand > maxComponent)
             {
                 finalColor += payload.throughput * payload.emission;
@@ -144,7 +460,29 @@ void RayGeneration()
     }
     
     
-    accumulationTexture[pixelIndex] += float4(finalColor, 1.0f);
+    finalColor += payload.radiance;
+    
+    // first sample after a camera move starts from the reprojected history instead of nothing
+    if (reprojectHistory && sampleIndex == 0)
+    {
+        float2 historyMeanM2;
+        accum = reproject(pixelIndex, primaryDir, historyMeanM2);
+        if (accum.a > 0.0f)
+        {
+            varianceTexture[pixelIndex] = historyMeanM2;
+        }
+    }
+    
+    // Welford update of the luminance variance, alpha holds the number of samples so far
+    float n = accum.a;
+    float luminance = dot(finalColor, float3(0.2126f, 0.7152f, 0.0722f));
+    float2 meanM2 = n > 0.0f ? varianceTexture[pixelIndex] : float2(0.0f, 0.0f);
+    float delta = luminance - meanM2.x;
+    meanM2.x += delta / (n + 1.0f);
+    meanM2.y += delta * (luminance - meanM2.x);
+    varianceTexture[pixelIndex] = meanM2;
+    
+    accumulationTexture[pixelIndex] = accum + float4(finalColor, 1.0f);
     }
 
 float3 SampleHemisphere(float a, float b)
@@ -304,7 +642,7 @@ float3 EvalBRDF_GGX(float3 omega_i, float3 omega_o, float alpha, float3 f0, floa
     return (d * g * f) / denom;
 }
 
-float3 specularDirection(inout Payload payload, Material mat, float3 worldNormal, float2 uv, inout uint64_t state)
+float3 specularDirection(inout Payload payload, Material mat, float3 worldNormal, float2 uv, inout RNG rng)
 {
     float3 wi = WorldRayDirection() * -1;
     wi = normalize(wi);
@@ -320,7 +658,7 @@ float3 specularDirection(inout Payload payload, Material mat, float3 worldNormal
     // transform view dir to local space
     float3 viewDirLocal = worldToLocal(wi, onb);
     
-    float2 xi = float2(randomPCG(state), randomPCG(state));
+    float2 xi = sample2D(rng, SAMPLE_VNDF);
     
     // sample local outgoing direction
     float3 lightDirLocal = SampleBRDF_GGX(viewDirLocal, alpha, float3(xi.x, xi.y, 0.0f));
@@ -331,7 +669,7 @@ float3 specularDirection(inout Payload payload, Material mat, float3 worldNormal
     return wo;
 }
 
-float3 specularThroughput(inout Payload payload, Material mat, float3 worldNormal, float2 uv, inout uint64_t state)
+float3 specularThroughput(inout Payload payload, Material mat, float3 worldNormal, float2 uv, inout RNG rng)
 {
     float3 wo = WorldRayDirection() * -1.0f;
     float3 wi = payload.dir;
@@ -368,10 +706,11 @@ float3 specularThroughput(inout Payload payload, Material mat, float3 worldNorma
     return throughput;
 }
 
-float3 diffuseDirection(inout Payload payload, Material mat, float3 worldNormal, float2 uv, inout uint64_t state)
+float3 diffuseDirection(inout Payload payload, Material mat, float3 worldNormal, float2 uv, inout RNG rng)
 {
-    float rand1 = randomPCG(state);
-    float rand2 = randomPCG(state);
+    float2 xi = sample2D(rng, SAMPLE_HEMISPHERE);
+    float rand1 = xi.x;
+    float rand2 = xi.y;
     
     float3 localDir = SampleHemisphere(rand1, rand2);
     float3 worldDir = localToWorld(localDir, BuildONB(worldNormal));
@@ -379,12 +718,12 @@ float3 diffuseDirection(inout Payload payload, Material mat, float3 worldNormal,
     return worldDir;
 }
 
-float3 diffuseThroughput(inout Payload payload, Material mat, float3 worldNormal, float2 uv, inout uint64_t state)
+float3 diffuseThroughput(inout Payload payload, Material mat, float3 worldNormal, float2 uv, inout RNG rng)
 {
     return mat.color;
 }
 
-float3 refractionDirection(inout Payload payload, Material mat, float3 worldNormal, float2 uv, inout bool TIR, inout uint64_t state)
+float3 refractionDirection(inout Payload payload, Material mat, float3 worldNormal, float2 uv, inout bool TIR, inout RNG rng)
 {
     float3 wi = normalize(WorldRayDirection());
 
@@ -415,7 +754,7 @@ float3 refractionDirection(inout Payload payload, Material mat, float3 worldNorm
     return refraction;
 }
 
-float3 refractionThroughput(inout Payload payload, Material mat, float3 worldNormal, float2 uv, bool TIR, inout uint64_t state)
+float3 refractionThroughput(inout Payload payload, Material mat, float3 worldNormal, float2 uv, bool TIR, inout RNG rng)
 {     
     if (TIR)
     {
@@ -438,7 +777,209 @@ float3 refractionThroughput(inout Payload payload, Material mat, float3 worldNor
     return throughput;
 }
 
-void Shade(inout Payload payload, float2 uv, inout uint64_t state)
+// Light BVH sampling
+
+float cosSubClamped(float sinTheta_a, float cosTheta_a, float sinTheta_b, float cosTheta_b)
+{
+    if (cosTheta_a > cosTheta_b)
+    {
+        return 1.0f;
+    }
+    return cosTheta_a * cosTheta_b + sinTheta_a * sinTheta_b;
+}
+
+float sinSubClamped(float sinTheta_a, float cosTheta_a, float sinTheta_b, float cosTheta_b)
+{
+    if (cosTheta_a > cosTheta_b)
+    {
+        return 0.0f;
+    }
+    return sinTheta_a * cosTheta_b - cosTheta_a * sinTheta_b;
+}
+
+// estimated contribution of everything below a node at the shading point
+float lightImportance(LightNode node, float3 pos, float3 normal)
+{
+    float3 center = (node.boundsMin + node.boundsMax) * 0.5f;
+    float radius = length(node.boundsMax - node.boundsMin) * 0.5f;
+    
+    float d2 = dot(pos - center, pos - center);
+    d2 = max(d2, radius); // don't blow up close to or inside the bounds
+    
+    float3 wi = normalize(pos - center);
+    float cosTheta_w = dot(node.axis, wi);
+    float sinTheta_w = sqrt(max(0.0f, 1.0f - cosTheta_w * cosTheta_w));
+    
+    // cone subtended by the bounds' bounding sphere
+    float cosTheta_b = -1.0f;
+    if (d2 > radius * radius)
+    {
+        float sin2Theta_b = radius * radius / dot(pos - center, pos - center);
+        cosTheta_b = sqrt(max(0.0f, 1.0f - sin2Theta_b));
+    }
+    float sinTheta_b = sqrt(max(0.0f, 1.0f - cosTheta_b * cosTheta_b));
+    
+    // smallest angle between the emission cone and the direction to the point
+    float sinTheta_o = sqrt(max(0.0f, 1.0f - node.cosTheta_o * node.cosTheta_o));
+    float cosTheta_x = cosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, node.cosTheta_o);
+    float sinTheta_x = sinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, node.cosTheta_o);
+    float cosTheta_p = cosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+    
+    if (cosTheta_p <= node.cosTheta_e)
+    {
+        return 0.0f;
+    }
+    
+    float importance = node.power * cosTheta_p / d2;
+    
+    // best case cosine at the receiver
+    float cosTheta_i = abs(dot(wi, normal));
+    float sinTheta_i = sqrt(max(0.0f, 1.0f - cosTheta_i * cosTheta_i));
+    importance *= cosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b);
+    
+    return max(importance, 0.0f);
+}
+
+// walk the tree choosing children by importance, returns the light triangle and the probability of picking it
+bool sampleLightBVH(float3 pos, float3 normal, float u, out uint lightIndex, out float pmf)
+{
+    lightIndex = 0;
+    pmf = 1.0f;
+    
+    uint nodeIndex = 0;
+    
+    if (lightImportance(LightNodes[0], pos, normal) <= 0.0f)
+    {
+        return false;
+    }
+    
+    [loop]
+    for (uint depth = 0; depth < 64; depth++)
+    {
+        LightNode node = LightNodes[nodeIndex];
+        
+        if (node.isLeaf)
+        {
+            lightIndex = node.secondChild;
+            return true;
+        }
+        
+        float importance0 = lightImportance(LightNodes[nodeIndex + 1], pos, normal);
+        float importance1 = lightImportance(LightNodes[node.secondChild], pos, normal);
+        
+        if (importance0 <= 0.0f && importance1 <= 0.0f)
+        {
+            return false;
+        }
+        
+        // reuse the random number, rescaled into the chosen interval
+        float p0 = importance0 / (importance0 + importance1);
+        if (u < p0)
+        {
+            nodeIndex = nodeIndex + 1;
+            u = min(u / p0, 0.99999994f);
+            pmf *= p0;
+        }
+        else
+        {
+            nodeIndex = node.secondChild;
+            u = min((u - p0) / (1.0f - p0), 0.99999994f);
+            pmf *= 1.0f - p0;
+        }
+    }
+    
+    return false;
+}
+
+// radiance from one light sample, divided by its solid angle pdf, without the brdf
+float3 sampleDirectLight(float3 pos, float3 normal, inout RNG rng)
+{
+    float4 xi = sample4D(rng, SAMPLE_LIGHT);
+    
+    uint lightIndex;
+    float pmf;
+    if (!sampleLightBVH(pos, normal, xi.x, lightIndex, pmf))
+    {
+        return float3(0.0f, 0.0f, 0.0f);
+    }
+    
+    LightTriangle light = LightTriangles[lightIndex];
+    
+    // uniform point on the triangle
+    float su = sqrt(xi.y);
+    float b1 = 1.0f - su;
+    float b2 = xi.z * su;
+    float3 lightPos = light.p0 + (light.p1 - light.p0) * b1 + (light.p2 - light.p0) * b2;
+    
+    float3 cr = cross(light.p1 - light.p0, light.p2 - light.p0);
+    float area = 0.5f * length(cr);
+    float3 lightNormal = normalize(cr);
+    
+    float3 toLight = lightPos - pos;
+    float dist2 = dot(toLight, toLight);
+    float dist = sqrt(dist2);
+    float3 wi = toLight / dist;
+    
+    float cosSurface = dot(normal, wi);
+    float cosLight = dot(lightNormal, -wi);
+    
+    if (cosSurface <= 0.0f || cosLight <= 0.0f || area <= 0.0f)
+    {
+        return float3(0.0f, 0.0f, 0.0f);
+    }
+    
+    // shadow ray
+    RayDesc shadowRay;
+    shadowRay.Origin = pos;
+    shadowRay.Direction = wi;
+    shadowRay.TMin = 0.001f;
+    shadowRay.TMax = dist - 0.002f;
+    
+    RayQuery<RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_SKIP_PROCEDURAL_PRIMITIVES> query;
+    query.TraceRayInline(scene, RAY_FLAG_NONE, 0xFF, shadowRay);
+    query.Proceed();
+    
+    if (query.CommittedStatus() != COMMITTED_NOTHING)
+    {
+        return float3(0.0f, 0.0f, 0.0f);
+    }
+    
+    // area pdf to solid angle
+    float pdf = pmf * dist2 / (cosLight * area);
+    
+    return light.emission * cosSurface / pdf;
+}
+
+// w = 0 for points at infinity
+float2 motionVector(uint2 pixel, float4 worldPos)
+{
+    float4 clip = mul(worldPos, prevViewProj);
+    float2 prevUV = float2(clip.x, -clip.y) / clip.w * 0.5f + 0.5f;
+    float2 uv = (pixel + 0.5f) / float2(DispatchRaysDimensions().xy);
+    return prevUV - uv;
+}
+
+void writeAOVs(uint2 pixel, uint sampleIndex, float3 albedo, float3 normal, float depth, uint id, float4 worldPos)
+{
+    if (aovMask == 0)
+        return;
+    
+    // running mean, the first sample replaces whatever the last accumulation left behind
+    float w = 1.0f / (sampleIndex + 1.0f);
+    
+    if (aovMask & AOV_ALBEDO)
+        albedoTexture[pixel] = sampleIndex == 0 ? float4(albedo, 1.0f) : lerp(albedoTexture[pixel], float4(albedo, 1.0f), w);
+    if (aovMask & AOV_NORMAL)
+        normalTexture[pixel] = sampleIndex == 0 ? float4(normal, 0.0f) : lerp(normalTexture[pixel], float4(normal, 0.0f), w);
+    if (aovMask & AOV_DEPTH)
+        depthTexture[pixel] = sampleIndex == 0 ? depth : lerp(depthTexture[pixel], depth, w);
+    if (aovMask & AOV_IDS)
+        idTexture[pixel] = id;
+    if (aovMask & AOV_MOTION)
+        motionTexture[pixel] = motionVector(pixel, worldPos);
+}
+
+void Shade(inout Payload payload, float2 uv, inout RNG rng)
 {
     uint instanceIndex = InstanceIndex(); // auto generated
     uint instanceID = InstanceID(); // for vertice/index buffers
@@ -467,14 +1008,37 @@ void Shade(inout Payload payload, float2 uv, inout uint64_t state)
     // Update ray
     float3 rayPos = WorldRayOrigin() + WorldRayDirection() * RayTCurrent();
     
+    if (payload.bounceNum == 1)
+    {
+        writeAOVs(payload.pixelIndex, payload.sampleIndex, mat.color, worldNormal, RayTCurrent() * dot(WorldRayDirection(), cameraForward()), (instanceIndex << 16) | (matID & 0xFFFF), float4(rayPos, 1.0f));
+    }
+    
     payload.pos = rayPos;    
     payload.emission = mat.color * mat.emission;
     
+    // path ends on emitters, keep the throughput that reached it
+    if (mat.emission > 0.0f)
+    {
+        // light sampling only reaches the side LightManager orients the light triangles to, a hit on the other side
+        // wasn't counted by next event estimation at the last bounce and has to be added by the caller
+        float3 geometricNormal = cross(v1.position - v0.position, v2.position - v0.position);
+        if (dot(geometricNormal, v0.normal + v1.normal + v2.normal) < 0.0f)
+        {
+            geometricNormal = -geometricNormal;
+        }
+        if (dot(mul(geometricNormal, (float3x3) ObjectToWorld4x3()), WorldRayDirection()) >= 0.0f)
+        {
+            payload.diffuseBounce = false;
+        }
+        return;
+    }
+    
     float cosTheta_i = abs(dot(WorldRayDirection(), worldNormal));
     
     // Sample lobe
-    float randomSample = randomPCG(state);
-    float randomSample2 = randomPCG(state);
+    float2 lobeSample = sample2D(rng, SAMPLE_LOBE);
+    float randomSample = lobeSample.x;
+    float randomSample2 = lobeSample.y;
     float p_specular = mat.metallic;
     float p_transmission = mat.transmission * (1.0f - mat.metallic);
     float p_diffuse = 1.0f - (p_specular + p_transmission);
@@ -483,11 +1047,13 @@ void Shade(inout Payload payload, float2 uv, inout uint64_t state)
     // Lobe selection
     bool TIR = false;
   
+    payload.diffuseBounce = false;
+  
     // Specular lobe
     if (randomSample <= p_specular)
     {
-        payload.dir = specularDirection(payload, mat, worldNormal, uv, state);
-        payload.throughput *= specularThroughput(payload, mat, worldNormal, uv, state);
+        payload.dir = specularDirection(payload, mat, worldNormal, uv, rng);
+        payload.throughput *= specularThroughput(payload, mat, worldNormal, uv, rng);
     }
     // Transmission lobe
     else if (randomSample <= p_specular + p_transmission)
@@ -495,21 +1061,28 @@ void Shade(inout Payload payload, float2 uv, inout uint64_t state)
         // Specular (Glass)
         if (randomSample2 < F)
         {
-            payload.dir = specularDirection(payload, mat, worldNormal, uv, state);
-            payload.throughput *= specularThroughput(payload, mat, worldNormal, uv, state);
+            payload.dir = specularDirection(payload, mat, worldNormal, uv, rng);
+            payload.throughput *= specularThroughput(payload, mat, worldNormal, uv, rng);
         }
         // Refraction
         else
         {
-            payload.dir = refractionDirection(payload, mat, worldNormal, uv, TIR, state);
-            payload.throughput *= refractionThroughput(payload, mat, worldNormal, uv, TIR, state);
+            payload.dir = refractionDirection(payload, mat, worldNormal, uv, TIR, rng);
+            payload.throughput *= refractionThroughput(payload, mat, worldNormal, uv, TIR, rng);
         }
     }
         // Diffuse lobe
     else if (randomSample <= p_specular + p_transmission + p_diffuse)
     {
-        payload.dir = diffuseDirection(payload, mat, worldNormal, uv, state);
-        payload.throughput *= diffuseThroughput(payload, mat, worldNormal, uv, state);
+        // next event estimation, lambertian brdf
+        if (lightSampling && numLights > 0)
+        {
+            payload.radiance += payload.throughput * (mat.color / PI) * sampleDirectLight(rayPos, worldNormal, rng);
+            payload.diffuseBounce = true;
+        }
+        
+        payload.dir = diffuseDirection(payload, mat, worldNormal, uv, rng);
+        payload.throughput *= diffuseThroughput(payload, mat, worldNormal, uv, rng);
      }
     
     
@@ -519,14 +1092,11 @@ void Shade(inout Payload payload, float2 uv, inout uint64_t state)
 [shader("closesthit")]
 void ClosestHit(inout Payload payload, BuiltInTriangleIntersectionAttributes attribs)
 {
-    uint64_t state = randPattern[payload.pixelIndex.x + payload.pixelIndex.y * payload.dims.x];
-    randomPCG(state); // initialize
-    
     float2 uv = attribs.barycentrics;
     payload.bounceNum++;
-    Shade(payload, uv, state);
     
-    randPattern[payload.pixelIndex.x + payload.pixelIndex.y * payload.dims.x] = state; // write back updated state
+    RNG rng = initRNG(payload.pixelIndex, payload.sampleIndex, payload.bounceNum);
+    Shade(payload, uv, rng);
     return;
 }
 
@@ -534,6 +1104,11 @@ void ClosestHit(inout Payload payload, BuiltInTriangleIntersectionAttributes att
 void Miss(inout Payload payload)
 {
     payload.missed = true;
+    if (payload.bounceNum == 0)
+    {
+        writeAOVs(payload.pixelIndex, payload.sampleIndex, float3(1.0f, 1.0f, 1.0f), float3(0.0f, 0.0f, 0.0f), 0.0f, AOV_NO_ID, float4(WorldRayDirection(), 0.0f));
+    }
+    
     if (!sky)
     {
         payload.throughput *= float3(0.0f, 0.0f, 0.0f);